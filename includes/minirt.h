@@ -4,6 +4,7 @@
 # include <stdlib.h>
 # include <fcntl.h>
 # include <math.h>
+# include <stddef.h>
 #include "../libft/libft.h"
 #include <limits.h>
 #include <string.h>  // for strtok
@@ -12,6 +13,13 @@
 
 
 # include <unistd.h>
+# include <pthread.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <float.h>
+# ifdef __SSE2__
+#  include <immintrin.h>
+# endif
 # include "MLX42/include/MLX42/MLX42.h"
 
 
@@ -19,6 +27,59 @@
 # define MAX_LIGHTS 10000
 # define EPSILON 0.0001
 
+/*
+** Mesh vertices are stored, and triangles intersected, in single precision
+** unless the build defines RT_DOUBLE (make PRECISION=double) for scenes
+** whose coordinates span too wide a range for floats. Rays leaving a
+** surface start RAY_OFFSET_ULPS units of that precision off it.
+*/
+# ifdef RT_DOUBLE
+#  define REAL_EPSILON DBL_EPSILON
+# else
+#  define REAL_EPSILON FLT_EPSILON
+# endif
+# define RAY_OFFSET_ULPS 4
+
+# define BVH_MAX_LEAF 4
+# define BVH_MEDIAN_DEPTH 40
+# define BVH_STACK_SIZE 256
+# define BVH4_SLACK 1.000001f
+# define BVH_TRAVERSAL_COST 1.0
+# define BVH_INTERSECT_COST 2.0
+# define BVH_BINS 32
+# define BVH_TASK_MIN 4096
+# define BVH_TASKS_PER_THREAD 8
+# define BVH_PARALLEL_MIN 16384
+# define SBVH_ALPHA 0.00001
+# define SBVH_BUDGET 1.0
+# define GRID_DENSITY 8.0
+# define GRID_MAX_RES 512
+# define GRID_MAX_CELLS 4194304
+# define GRID_AUTO_MIN 1000
+# define GRID_AUTO_SPREAD 4.0
+# define GRID_AUTO_FILL 0.5
+# define GRID_AUTO_COVER 0.5
+# define GRID_MAILBOX 16
+# define GRID_BATCH 32
+# define PRIM_CHUNK 8
+# define QUADRIC_FIELDS 21
+# define PACKET_SIDE 4
+# define PACKET_SIZE 16
+# define BVH_REFIT_LIMIT 1.5
+# define EDIT_STEP 0.02
+
+# define RENDER_TILE 32
+# define MAX_SAMPLES 64
+# define MAX_THREADS 256
+# define PLY_MAX_ELEMENTS 16
+# define PARSE_MAX_TOKENS 16
+# define RTB_MAGIC "MINIRTB"
+# define RTB_VERSION 7
+# define RTB_ALIGN 64
+# define BVH_CACHE_MAGIC "MINIBVH"
+# define BVH_CACHE_VERSION 4
+# define PLY_MAX_PROPS 32
+
 
 
 typedef struct s_color
@@ -40,8 +101,21 @@ typedef struct s_ray
 	t_vector	origin;
 	t_vector	direction;
 	double		t;
+	uint32_t	prim; // triangle hit inside a mesh, or part of a quadric
 }	t_ray;
 
+/*
+** Part of a cylinder or cone a ray hit, left in ray->prim by the kernels.
+** The near cap lies at a cylinder's center, the far cap at the other end
+** of the axis: a cylinder's top, a cone's base.
+*/
+typedef enum e_part
+{
+	PART_SIDE,
+	PART_NEAR_CAP,
+	PART_FAR_CAP
+}	t_part;
+
 
 typedef struct s_light
 {
@@ -58,10 +132,41 @@ typedef enum e_object_type
 	CYLINDER,
 	CONE,
 	HYPERBOLOID,
-	TRIANGLE
+	TRIANGLE,
+	MESH
 }	t_object_type;
 
 
+/*
+** World to object space transform: the rows of the inverse of a linear
+** map, then a translation. Mesh instances use it for a uniform scale and
+** a rotation, with `identity` set for meshes already in world space.
+** Quadrics keep their frame in it, the axis as the last row, so the
+** kernels run on an axis-aligned shape.
+*/
+typedef struct s_xform
+{
+	t_vector	inv[3];
+	t_vector	offset;
+	double		scale;
+	int			identity;
+}	t_xform;
+
+/*
+** Cylinders, cones and hyperboloids in one form: in their frame, the
+** surface Ax^2 + By^2 + Cz^2 + D = 0 with the inside negative, its side
+** kept between two heights and within a radius of the origin, and closed
+** by flat caps at the heights in `cap` (INFINITY where there is none).
+*/
+typedef struct s_quadric
+{
+	t_xform		frame;
+	double		coef[4];
+	double		slab[2];
+	double		cap[2];
+	double		clip2;
+}	t_quadric;
+
 typedef struct s_sphere
 {
 	t_vector	center;
@@ -75,6 +180,9 @@ typedef struct s_plane
 	t_vector	normal;
 }	t_plane;
 
+/*
+** The fields after the parsed ones are derived by finalize_object.
+*/
 typedef struct s_cylinder
 {
 	t_vector	center;
@@ -82,6 +190,8 @@ typedef struct s_cylinder
 	double		diameter;
 	double		radius;
 	double		height;
+	t_vector	top; // center of the far cap
+	t_quadric	quadric; // center at the origin, axis along z
 }	t_cylinder;
 
 typedef struct s_triangle
@@ -90,6 +200,8 @@ typedef struct s_triangle
     t_vector    v2;
     t_vector    v3;
     t_vector    normal;
+    t_vector    edge1;      // v2 - v1
+    t_vector    edge2;      // v3 - v1
 }   t_triangle;
 
 
@@ -99,6 +211,11 @@ typedef struct s_cone
 	t_vector	axis;
 	double		angle;
 	double		height;
+	double		cos2; // cos(angle) squared
+	double		slope2; // 1 + tan(angle) squared, for the normal
+	t_vector	base; // center of the base cap
+	double		base_radius;
+	t_quadric	quadric; // vertex at the origin, axis along z
 }	t_cone;
 
 typedef struct s_hyperboloid
@@ -109,6 +226,8 @@ typedef struct s_hyperboloid
     double      b;
     double      c;
     double      height;
+    t_vector    inv2;       // 1 / a^2, 1 / b^2, 1 / c^2
+    t_quadric   quadric;    // center at the origin, axis along z
 }   t_hyperboloid;
 
 typedef struct s_texture
@@ -118,9 +237,370 @@ typedef struct s_texture
     uint32_t    *data;
     uint32_t    *bump_map;
     int         has_bump_map;
+    char        *path;          // resolved file, kept for .rtb output
 }   t_texture;
 
 
+typedef struct s_aabb
+{
+	t_vector	min;
+	t_vector	max;
+}	t_aabb;
+
+/*
+** Depth-first layout: the left child of an interior node is the next node,
+** `first` holds the right child. Leaves have a non-zero `count` and `first`
+** indexes into the primitive list.
+*/
+typedef struct s_bvh_node
+{
+	t_aabb		bounds;
+	uint32_t	first;
+	uint32_t	count;
+}	t_bvh_node;
+
+/*
+** Collapsed 4-wide node, derived from the binary tree for traversal. Child
+** bounds are stored per axis so one SIMD sequence tests all four. A child
+** with a non-zero count is a leaf whose prims start at `child`. Unused
+** slots point at the root (child 0, count 0), which is nobody's child, and
+** have bounds at +INFINITY that only a ray without a hit yet can enter.
+*/
+typedef struct s_bvh4_node
+{
+	float		min[3][4];
+	float		max[3][4];
+	uint32_t	child[4];
+	uint32_t	count[4];
+}	t_bvh4_node;
+
+typedef struct s_bvh4_entry
+{
+	uint32_t	child;
+	uint32_t	count;
+	float		t;
+}	t_bvh4_entry;
+
+/*
+** Ray in single precision. `pad` widens every box by the error of rounding
+** the origin, so no box the double ray enters is missed.
+*/
+typedef struct s_bvh4_ray
+{
+	float	origin[3];
+	float	inv_dir[3];
+	float	pad[3];
+}	t_bvh4_ray;
+
+/*
+** Primary rays of a PACKET_SIDE square of pixels, traced together, and the
+** object each ray hit, or -1. Leaves only test the rays in `active`.
+*/
+typedef struct s_packet
+{
+	t_ray		rays[PACKET_SIZE];
+	int			hit[PACKET_SIZE];
+	uint32_t	count;
+	uint32_t	active;
+}	t_packet;
+
+/*
+** The active rays of a packet in single precision, for interval slab
+** tests. They share `origin`, and along each axis all their inverse
+** directions `inv` have the sign `sign` and lie in [inv_lo, inv_hi].
+** `tfar` is how far each still looks, -INFINITY for the other lanes, and
+** `tmax` the farthest of them; `hit` gathers the rays that found a hit.
+*/
+typedef struct s_bvh4_packet
+{
+	float		origin[3];
+	float		pad[3];
+	float		inv[3][PACKET_SIZE];
+	float		tfar[PACKET_SIZE];
+	float		inv_lo[3];
+	float		inv_hi[3];
+	int			sign[3];
+	uint32_t	active;
+	uint32_t	hit;
+	float		tmax;
+}	t_bvh4_packet;
+
+/*
+** Stack entry of a packet traversal; leaves keep the wide node and slot
+** holding their box.
+*/
+typedef struct s_packet_entry
+{
+	uint32_t	child;
+	uint32_t	count;
+	float		t;
+	uint32_t	node;
+	uint32_t	slot;
+}	t_packet_entry;
+
+/*
+** Tests the primitives of one leaf against the active rays of the packet
+** and returns the mask of rays that found a closer hit.
+*/
+typedef uint32_t	(*t_packet_leaf_fn)(void *ctx, t_packet *p,
+		uint32_t *prims, uint32_t count);
+
+typedef struct s_bvh
+{
+	t_bvh_node	*nodes;
+	size_t		node_count;
+	uint32_t	*prims;
+	size_t		prim_count;
+	uint32_t	*unbounded;
+	size_t		unbounded_count;
+	t_bvh4_node	*wide;
+	size_t		wide_count;
+	int			mapped; // arrays live in a file mapping, not owned
+}	t_bvh;
+
+typedef struct s_bvh_key
+{
+	double		key;
+	uint32_t	prim;
+}	t_bvh_key;
+
+/*
+** A range of the primitive list to be built into a subtree rooted at
+** `node`, which owns the 2 * count - 1 node slots from there on.
+*/
+typedef struct s_bvh_task
+{
+	uint32_t	first;
+	uint32_t	count;
+	uint32_t	node;
+	int			depth;
+}	t_bvh_task;
+
+typedef struct s_bvh_build
+{
+	t_bvh			*bvh;
+	t_aabb			*boxes;
+	t_vector		*centroids;
+	t_bvh_key		*keys;
+	int				threads;
+	int				top; // still splitting the shared levels near the root
+	uint32_t		task_min;
+	t_bvh_task		*tasks;
+	size_t			task_count;
+	size_t			task_cap;
+	size_t			next_task;
+	pthread_mutex_t	lock;
+}	t_bvh_build;
+
+typedef struct s_bvh_bins
+{
+	t_aabb		bounds[3][BVH_BINS];
+	uint32_t	count[3][BVH_BINS];
+}	t_bvh_bins;
+
+/*
+** One pass over prims[first, first + count): pass 0 gathers the bounds of
+** the boxes and of their centroids, pass 1 bins the centroids on each axis.
+*/
+typedef struct s_bvh_range
+{
+	t_bvh_build	*b;
+	uint32_t	first;
+	uint32_t	count;
+	int			pass;
+	t_aabb		bounds;
+	t_aabb		cbounds;
+	double		scale[3];
+	t_bvh_bins	bins;
+}	t_bvh_range;
+
+# ifdef RT_DOUBLE
+typedef double	t_real;
+# else
+typedef float	t_real;
+# endif
+
+typedef struct s_vertex
+{
+	t_real	x;
+	t_real	y;
+	t_real	z;
+}	t_vertex;
+
+typedef struct s_mesh
+{
+	t_vertex	*vertices;
+	uint32_t	*indices;
+	size_t		vertex_count;
+	size_t		vertex_cap;
+	size_t		tri_count;
+	size_t		tri_cap;
+	uint32_t	*lookup;
+	size_t		lookup_cap;
+	int			open;
+	uint32_t	id;
+	char		*path; // file a `mesh` line loaded it from, or NULL
+	size_t		users; // mesh objects referencing it
+	t_bvh		bvh;
+}	t_mesh;
+
+/*
+** SBVH triangle reference: a triangle, or once spatial splits have cut it,
+** the part of it inside `box`. A triangle can have several references.
+*/
+typedef struct s_sbvh_ref
+{
+	t_aabb		box;
+	uint32_t	prim;
+}	t_sbvh_ref;
+
+/*
+** The references of one node. `budget` is how many more references
+** spatial splits in its subtree may add.
+*/
+typedef struct s_sbvh_refs
+{
+	t_sbvh_ref	*refs;
+	uint32_t	count;
+	int			depth;
+	size_t		budget;
+}	t_sbvh_refs;
+
+typedef struct s_sbvh
+{
+	t_bvh		*bvh;
+	t_mesh		*mesh;
+	double		min_overlap; // child overlap area that makes one worth trying
+}	t_sbvh;
+
+/*
+** Spatial bins on one axis: the clipped pieces merged into each bin, and
+** how many references start (enter) and end (exit) in it.
+*/
+typedef struct s_sbvh_bins
+{
+	t_aabb		bounds[BVH_BINS];
+	uint32_t	enter[BVH_BINS];
+	uint32_t	exit[BVH_BINS];
+	t_sbvh_refs	*in;
+	int			axis;
+	double		min;
+	double		scale;
+}	t_sbvh_bins;
+
+typedef struct s_sbvh_plane
+{
+	int		axis;
+	double	pos;
+}	t_sbvh_plane;
+
+/*
+** Best split of a node: the object split by centroid bin through `r`
+** (`bin` is 0 when there is none), or when `spatial` is set, the cut at
+** `plane`.
+*/
+typedef struct s_sbvh_split
+{
+	double			cost;
+	int				axis;
+	int				bin;
+	int				spatial;
+	t_sbvh_plane	plane;
+	t_bvh_range		r;
+}	t_sbvh_split;
+
+/*
+** Scene-level accelerator over the bounded objects; a scene asks for one
+** with an `accel` line, ACCEL_AUTO picks from primitive statistics.
+*/
+typedef enum e_accel
+{
+	ACCEL_AUTO,
+	ACCEL_BVH,
+	ACCEL_GRID
+}	t_accel;
+
+/*
+** Uniform grid over the bounded objects. Cell c, numbered x first, holds
+** the object ids prims[cells[c]] .. prims[cells[c + 1] - 1].
+*/
+typedef struct s_grid
+{
+	t_aabb		bounds;
+	int			res[3];
+	double		size[3];
+	double		inv[3];
+	uint32_t	*cells;
+	size_t		cell_count;
+	uint32_t	*prims;
+}	t_grid;
+
+/*
+** 3D-DDA state: the current cell and its index, and per axis the step
+** direction, the index change of a step, the ray distance to the next cell
+** wall and the distance between walls.
+*/
+typedef struct s_grid_walk
+{
+	int		cell[3];
+	size_t	index;
+	int		step[3];
+	long	skip[3];
+	double	next[3];
+	double	delta[3];
+}	t_grid_walk;
+
+/*
+** A mesh object only points at the shared vertex and index buffers and
+** hierarchy; the object itself carries the material (color) and where the
+** mesh is placed. `bounds` are in world space.
+*/
+typedef struct s_mesh_ref
+{
+	t_mesh		*data;
+	t_aabb		bounds;
+	t_xform		xform;
+}	t_mesh_ref;
+
+/*
+** Leaf context of a mesh query. Triangles whose determinant is below
+** `min_det` count as edge-on; instances scale it to their own space.
+*/
+typedef struct s_mesh_query
+{
+	t_mesh		*mesh;
+	double		min_det;
+	int			avx2;
+}	t_mesh_query;
+
+/*
+** Up to PRIM_CHUNK triangles of a mesh leaf and the hit distance of each.
+*/
+typedef struct s_tri_run
+{
+	uint32_t	*tris;
+	uint32_t	count;
+	double		t[PRIM_CHUNK];
+}	t_tri_run;
+
+typedef int	(*t_leaf_fn)(void *ctx, t_ray *ray, uint32_t *prims,
+		uint32_t count);
+
+/*
+** Objects spanning several cells would be tested once per cell; the last
+** GRID_MAILBOX ids tested are remembered and skipped, and the others are
+** handed to the leaf callback in batches.
+*/
+typedef struct s_grid_visit
+{
+	t_leaf_fn	leaf;
+	void		*ctx;
+	int			any; // occlusion: stop at the first blocker
+	uint32_t	recent[GRID_MAILBOX];
+	int			next;
+	uint32_t	batch[GRID_BATCH];
+}	t_grid_visit;
+
 typedef struct s_object
 {
 	t_object_type	type;
@@ -133,12 +613,33 @@ typedef struct s_object
 		t_cone		cone;
 		t_hyperboloid hyperboloid;
 		t_triangle	triangle;
-		
+		t_mesh_ref	mesh;
 	};
 	t_texture        *texture;      // Add this for bump mapping
 
 }	t_object;
 
+/*
+** Everything shading needs about one hit, derived once. `local` is the
+** point relative to the object: the unit direction from a sphere's
+** center, the offset from a plane's point, a cylinder's center or a
+** cone's vertex, or the point in a hyperboloid's frame. On cylinders and
+** cones, `height` is its projection on the axis and `radial` the rest.
+** `u` and `v` are only set on textured objects.
+*/
+typedef struct s_hit
+{
+	t_object	*obj;
+	t_vector	point;
+	t_vector	local;
+	t_vector	radial;
+	double		height;
+	t_vector	normal;
+	double		u;
+	double		v;
+	uint32_t	prim;
+}	t_hit;
+
 
 
 typedef struct s_ambient
@@ -161,12 +662,101 @@ typedef struct s_canvas
 	size_t	h;
 }	t_canvas;
 
-typedef struct s_viewport
+/*
+** The camera of one frame: its orthonormal basis, the size of the image
+** plane at distance 1, and the sub-pixel offset of each sample. One
+** sample per pixel goes through the pixel's grid point.
+*/
+typedef struct s_view
+{
+	t_vector	origin;
+	t_vector	forward;
+	t_vector	right;
+	t_vector	up;
+	double		width;
+	double		height;
+	double		last_x;
+	double		last_y;
+	int			samples;
+	double		jitter[MAX_SAMPLES][2];
+}	t_view;
+
+typedef struct s_mapped_file
+{
+	char		*data;
+	size_t		size;
+}	t_mapped_file;
+
+/*
+** Hot copies of the sphere and plane parameters, one stream per field, so
+** the leaf loops read nothing but what their kernel needs. Entries follow
+** the order of the scene hierarchy's primitives, which keeps the spheres
+** of a leaf next to each other; `type` and `slot` map every object id to
+** its entry.
+*/
+typedef struct s_sphere_soa
+{
+	double		*x;
+	double		*y;
+	double		*z;
+	double		*r2;
+	uint32_t	*id;
+	size_t		count;
+}	t_sphere_soa;
+
+typedef struct s_plane_soa
+{
+	double		*px;
+	double		*py;
+	double		*pz;
+	double		*nx;
+	double		*ny;
+	double		*nz;
+	uint32_t	*id;
+	size_t		count;
+}	t_plane_soa;
+
+typedef enum e_stream
+{
+	STREAM_NONE,
+	STREAM_SPHERES,
+	STREAM_PLANES,
+	STREAM_QUADRICS
+}	t_stream;
+
+/*
+** The t_quadric of every cylinder, cone and hyperboloid, field by field:
+** frame rows then offset, coefficients, slab, caps and clip radius.
+*/
+typedef struct s_quadric_soa
+{
+	double		*f[QUADRIC_FIELDS];
+	uint32_t	*id;
+	size_t		count;
+}	t_quadric_soa;
+
+typedef struct s_prims
+{
+	uint8_t			*type;
+	uint32_t		*slot;
+	double			*data;
+	t_sphere_soa	spheres;
+	t_plane_soa		planes;
+	t_quadric_soa	quadrics;
+	int				avx2; // see simd_avx2
+}	t_prims;
+
+/*
+** Up to PRIM_CHUNK consecutive stream entries, the nearest root of each,
+** and for quadrics the part it lies on.
+*/
+typedef struct s_prim_run
 {
-	double	width;
-	double	height;
-	double	dist;
-}	t_viewport;
+	uint32_t	first;
+	uint32_t	count;
+	double		t[PRIM_CHUNK];
+	uint32_t	part[PRIM_CHUNK];
+}	t_prim_run;
 
 typedef struct s_scene
 {
@@ -177,10 +767,304 @@ typedef struct s_scene
 	t_light		*lights;
 	size_t		obj_count;
 	size_t		light_count;
-	t_viewport	viewport;
 	int			checkerboard; // Optional checkerboard toggle
+	t_accel		accel;
+	t_bvh		bvh;
+	t_grid		grid;
+	t_prims		prims;
+	t_mesh		**meshes;
+	size_t		mesh_count;
+	size_t		mesh_cap;
+	t_mapped_file	compiled; // backing .rtb mapping, if loaded from one
+	t_mapped_file	bvh_cache; // backing BVH cache entry, on a cache hit
 }	t_scene;
 
+typedef struct s_scene_hit
+{
+	t_scene	*scene;
+	int		index;
+}	t_scene_hit;
+
+/*
+** Lets moved objects be refit into the scene hierarchy: the parent of each
+** binary node, the leaf holding each object, the wide slot showing each
+** node (see bvh_collapse_slots), and the running SAH cost against the
+** limit that asks for a rebuild.
+*/
+typedef struct s_bvh_refit
+{
+	uint32_t	*parent;
+	uint32_t	*leaf;
+	uint32_t	*slot;
+	double		cost;
+	double		limit;
+}	t_bvh_refit;
+
+/*
+** Scene hierarchy being built on a background thread from a snapshot of
+** the bounds of objects `ids`. `done` and `ok` are written under `lock`.
+*/
+typedef struct s_bvh_rebuild
+{
+	pthread_t		thread;
+	pthread_mutex_t	lock;
+	int				running;
+	int				done;
+	int				ok;
+	t_bvh			bvh;
+	t_aabb			*boxes;
+	uint32_t		*ids;
+	size_t			count;
+	int				threads;
+}	t_bvh_rebuild;
+
+/*
+** Interactive window state. Key presses move the selected object or light
+** and mark the frame dirty; the loop hook renders dirty frames.
+*/
+typedef struct s_editor
+{
+	mlx_t			*mlx;
+	mlx_image_t		*img;
+	uint32_t		*pixels;
+	t_scene			*scene;
+	int				threads;
+	int				samples;
+	int				lights; // the selection is a light, not an object
+	size_t			selected;
+	double			step;
+	int				dirty;
+	t_bvh_refit		refit;
+	t_bvh_rebuild	rebuild;
+}	t_editor;
+
+typedef struct s_options
+{
+	char	*scene_path;
+	char	*output_path;
+	char	*compile_path;
+	char	*cache_dir;
+	int		threads;
+	int		sbvh;
+	int		samples;
+}	t_options;
+
+typedef enum e_image_format
+{
+	IMAGE_NONE,
+	IMAGE_PPM,
+	IMAGE_PNG
+}	t_image_format;
+
+typedef struct s_writer
+{
+	int				fd;
+	int				ok;
+	uint32_t		crc;
+	size_t			len;
+	unsigned char	buf[65536];
+}	t_writer;
+
+typedef struct s_zlib_stored
+{
+	size_t		remaining;
+	size_t		block_left;
+	uint32_t	adler;
+}	t_zlib_stored;
+
+/*
+** Decimal digits of the mantissa, at most 19 so they fit in 64 bits.
+** `exp10` is the power of ten still to apply; `inexact` is set when
+** non-zero digits had to be dropped.
+*/
+typedef struct s_decimal
+{
+	uint64_t	mantissa;
+	int			digits;
+	long		exp10;
+	int			inexact;
+	int			seen;
+}	t_decimal;
+
+typedef enum e_ply_type
+{
+	PLY_NONE,
+	PLY_INT8,
+	PLY_UINT8,
+	PLY_INT16,
+	PLY_UINT16,
+	PLY_INT32,
+	PLY_UINT32,
+	PLY_FLOAT32,
+	PLY_FLOAT64
+}	t_ply_type;
+
+typedef enum e_ply_role
+{
+	PLY_SKIP,
+	PLY_X,
+	PLY_Y,
+	PLY_Z,
+	PLY_INDICES
+}	t_ply_role;
+
+/*
+** `count_type` is PLY_NONE for scalar properties and the type of the
+** length prefix for list properties.
+*/
+typedef struct s_ply_prop
+{
+	t_ply_type	type;
+	t_ply_type	count_type;
+	t_ply_role	role;
+}	t_ply_prop;
+
+typedef struct s_ply_element
+{
+	int			is_vertex;
+	int			is_face;
+	size_t		count;
+	int			prop_count;
+	t_ply_prop	props[PLY_MAX_PROPS];
+}	t_ply_element;
+
+typedef struct s_ply
+{
+	int						swap;
+	int						elem_count;
+	t_ply_element			elems[PLY_MAX_ELEMENTS];
+	const unsigned char		*cur;
+	const unsigned char		*end;
+}	t_ply;
+
+typedef struct s_rtb_section
+{
+	uint64_t	offset;
+	uint64_t	count;
+}	t_rtb_section;
+
+/*
+** Compiled scene header. The struct sizes guard against loading a file
+** written by a build with a different in-memory layout.
+*/
+typedef struct s_rtb_header
+{
+	char			magic[8];
+	uint32_t		version;
+	uint32_t		byte_order;
+	uint32_t		object_size;
+	uint32_t		light_size;
+	uint32_t		node_size;
+	uint32_t		vector_size;
+	uint32_t		vertex_size;
+	t_camera		camera;
+	t_ambient		ambient;
+	int64_t			checkerboard;
+	int64_t			accel;
+	t_rtb_section	lights;
+	t_rtb_section	objects;
+	t_rtb_section	fixups;
+	t_rtb_section	meshes;
+	t_rtb_section	nodes;
+	t_rtb_section	prims;
+	t_rtb_section	unbounded;
+	t_rtb_section	strings;
+}	t_rtb_header;
+
+typedef struct s_rtb_mesh
+{
+	t_rtb_section	vertices;
+	t_rtb_section	indices;
+	t_rtb_section	nodes;
+	t_rtb_section	prims;
+}	t_rtb_mesh;
+
+/*
+** Objects holding pointers: their mesh index (UINT32_MAX for none) and the
+** offset of their texture path in the string section (UINT64_MAX for none).
+*/
+typedef struct s_rtb_fixup
+{
+	uint32_t	object;
+	uint32_t	mesh;
+	uint64_t	texture;
+}	t_rtb_fixup;
+
+/*
+** BVH cache entry: the scene hierarchy and one t_bvh_cache_mesh per mesh,
+** stored like .rtb sections. `key` is the geometry hash the entry was
+** built from and `checksum` covers every hierarchy array.
+*/
+typedef struct s_bvh_cache_header
+{
+	char			magic[8];
+	uint32_t		version;
+	uint32_t		node_size;
+	uint64_t		key;
+	uint64_t		checksum;
+	uint64_t		accel;
+	t_rtb_section	nodes;
+	t_rtb_section	prims;
+	t_rtb_section	unbounded;
+	t_rtb_section	meshes;
+}	t_bvh_cache_header;
+
+typedef struct s_bvh_cache_mesh
+{
+	t_rtb_section	nodes;
+	t_rtb_section	prims;
+}	t_bvh_cache_mesh;
+
+typedef struct s_rtb_out
+{
+	t_writer	*w;
+	uint64_t	pos;
+}	t_rtb_out;
+
+typedef struct s_tile_deque
+{
+	pthread_mutex_t	lock;
+	uint32_t		*tiles;
+	size_t			top;
+	size_t			bottom;
+}	t_tile_deque;
+
+/*
+** A tile being rendered. For the current sample, `col` and `row` hold the
+** offsets of each column and row on the image plane, so the direction of
+** a pixel is two additions away from the camera's; `sum` adds up the
+** colour channels of the samples taken so far.
+*/
+typedef struct s_tile
+{
+	size_t		x0;
+	size_t		y0;
+	size_t		w;
+	size_t		h;
+	t_vector	col[RENDER_TILE];
+	t_vector	row[RENDER_TILE];
+	uint32_t	sum[RENDER_TILE * RENDER_TILE][3];
+}	t_tile;
+
+typedef struct s_renderer
+{
+	t_scene			*scene;
+	uint32_t		*pixels;
+	t_tile_deque	*deques;
+	int				threads;
+	size_t			tiles_x;
+	size_t			tiles_y;
+	t_view			view;
+}	t_renderer;
+
+typedef struct s_worker
+{
+	t_renderer	*renderer;
+	int			id;
+	pthread_t	thread;
+	int			started;
+}	t_worker;
+
 /* ==== Vector Ops ==== */
 t_vector	vec_add(t_vector v1, t_vector v2);
 t_vector	vec_sub(t_vector v1, t_vector v2);
@@ -190,16 +1074,40 @@ double		vec_dot(t_vector v1, t_vector v2);
 double		vec_length(t_vector v);
 t_vector	vec_normalize(t_vector v);
 t_vector	vec_cross(t_vector v1, t_vector v2);
+double		vec_axis(t_vector v, int axis);
+t_vector	vertex_to_vec(t_vertex v);
+t_vertex	vec_to_vertex(t_vector v);
 
 /* ==== Ray Tracing ==== */
 t_ray		ray_create(t_vector origin, t_vector direction);
 t_vector	ray_at(t_ray ray, double t);
-t_vector	ray_dir(t_scene *scene, size_t x, size_t y);
-uint32_t	ray_get_color(t_scene *scene, t_ray *ray);
+uint32_t	ray_get_color(t_scene *scene, t_ray *ray, int hit_index);
+
+/* ==== Rendering ==== */
+int			parse_options(t_options *opts, int argc, char **argv);
+int			is_compiled_path(char *path);
+int			render_frame(t_scene *scene, uint32_t *pixels, int threads,
+				int samples);
+void		camera_view(t_view *view, t_scene *scene, int samples);
+void		camera_tile(t_view *view, t_tile *tile, int sample);
+t_vector	camera_dir(t_view *view, t_tile *tile, size_t x, size_t y);
+int			image_format(char *path);
+int			write_image(char *path, uint32_t *pixels, size_t width,
+				size_t height);
+void		writer_put(t_writer *w, const void *data, size_t len);
+void		writer_flush(t_writer *w);
 
 /* ==== Scene ==== */
-t_viewport	viewport_dim(t_canvas canvas, t_camera camera);
-int			read_map(t_scene *scene, int fd);
+int			read_map(t_scene *scene, char *path);
+void		finalize_object(t_object *obj);
+void		finalize_scene(t_scene *scene);
+int			compile_scene(t_scene *scene, char *path);
+int			load_compiled_scene(t_scene *scene, char *path);
+t_rtb_section	rtb_reserve(uint64_t *offset, size_t count, size_t elem);
+void		rtb_put(t_rtb_out *out, uint64_t offset, const void *data,
+				size_t size);
+void		*rtb_section_ptr(t_mapped_file *file, t_rtb_section sec,
+				size_t elem);
 int			parse_line(t_scene *scene, char *line);
 int			parse_ambient(t_scene *scene, char **parts);
 int			parse_camera(t_scene *scene, char **parts);
@@ -208,30 +1116,112 @@ int			parse_sphere(t_scene *scene, char **parts);
 int			parse_plane(t_scene *scene, char **parts);
 
 /* ==== Utils ==== */
-double		ft_atof(const char *str);
-t_vector	parse_vector(char *str);
-t_color		parse_color(char *str);
+int			parse_vector(char *str, t_vector *out);
+int			parse_color(char *str, t_color *out);
+const char	*scan_double(const char *s, const char *end, double *out);
+int			parse_double(const char *str, double *out);
 void		key_hook(mlx_key_data_t data, void *param);
+int			editor_start(t_editor *ed, mlx_t *mlx, t_scene *scene,
+				t_options *opts);
+void		editor_stop(t_editor *ed);
+void		edit_key_hook(mlx_key_data_t data, void *param);
+void		edit_loop_hook(void *param);
 t_color		apply_checkerboard(t_color base_color, t_vector hit_point); // Optional
 
 t_texture    *load_texture(char *path);
-t_vector     bump_map_normal(t_object obj, t_vector normal, t_vector point);
+t_vector     bump_map_normal(t_texture *texture, t_vector normal, double u,
+                double v);
 t_color      get_texture_color(t_texture *texture, double u, double v);
-int 		intersect_hyperboloid(t_ray *ray, t_hyperboloid hyp);
-t_vector    hyperboloid_normal(t_vector hit_point, t_hyperboloid hyp);
-void        calculate_uv(t_object obj, t_vector point, double *u, double *v);
+t_vector    hyperboloid_normal(t_vector local, t_hyperboloid *hyp);
+void        calculate_uv(t_hit *hit);
 int parse_hyperboloid(t_scene *scene, char **parts);
-int solve_quadratic(double coeffs[3], double *t1, double *t2);
 
 /* ==== Intersections ==== */
 int			intersect_sphere(t_ray *ray, t_sphere sphere);
 int			intersect_plane(t_ray *ray, t_plane plane);
-int			intersect_cylinder(t_ray *ray, t_cylinder cylinder);
-int			intersect_cone(t_ray *ray, t_cone cone);
-int			intersect_object(t_ray *ray, t_object obj);
+t_quadric	*object_quadric(t_object *obj);
+double		quadric_distance(t_quadric *q, t_ray *ray, uint32_t *part);
+int			intersect_quadric(t_ray *ray, t_quadric *q);
+int			intersect_object(t_ray *ray, t_object *obj);
+
+/* ==== Occlusion (shadow rays) ==== */
+int			occlude_sphere(t_ray *ray, t_sphere sphere);
+int			occlude_plane(t_ray *ray, t_plane plane);
+int			occlude_triangle(t_ray *ray, t_triangle triangle);
+int			occlude_object(t_ray *ray, t_object *obj);
+
+/* ==== Acceleration ==== */
+t_aabb		aabb_empty(void);
+t_aabb		aabb_union(t_aabb a, t_aabb b);
+t_aabb		aabb_grow(t_aabb box, t_vector p);
+t_aabb		aabb_intersection(t_aabb a, t_aabb b);
+double		aabb_area(t_aabb box);
+t_vector	aabb_centroid(t_aabb box);
+int			object_bounds(t_object obj, t_aabb *box);
+int			bvh_build(t_bvh *bvh, t_aabb *boxes, size_t count, int threads);
+int			bvh_compare_keys(const void *a, const void *b);
+int			bvh_build_node(t_bvh_build *b, t_bvh_task t);
+int			bvh_push_task(t_bvh_build *b, t_bvh_task t);
+int			bvh_run_tasks(t_bvh_build *b);
+void		bvh_scan(t_bvh_range *r, int pass);
+int			bvh_bin_index(double v, double min, double scale);
+int			bvh_bin_of(t_bvh_range *r, t_vector c, int axis);
+void		bvh_bin_box(t_bvh_range *r, t_vector c, t_aabb *box);
+void		bvh_bin_scale(t_bvh_range *r);
+double		bvh_best_bin(t_bvh_range *r, int *axis, int *bin);
+uint32_t	bvh_partition(t_bvh_range *r, int axis, int bin);
+int			build_bvh(t_scene *scene, int threads);
+int			bvh_collapse(t_bvh *bvh);
+int			bvh_collapse_slots(t_bvh *bvh, uint32_t *slots);
+void		bvh4_update_slot(t_bvh *bvh, uint32_t slot, t_aabb *box);
+int			bvh_refit_init(t_bvh_refit *r, t_scene *scene);
+int			bvh_refit(t_bvh_refit *r, t_scene *scene, uint32_t id);
+void		bvh_refit_all(t_scene *scene);
+void		bvh_refit_free(t_bvh_refit *r);
+int			bvh_rebuild_start(t_bvh_rebuild *rb, t_scene *scene, int threads);
+int			bvh_rebuild_poll(t_bvh_rebuild *rb, t_scene *scene,
+				t_bvh_refit *refit);
+void		bvh_rebuild_stop(t_bvh_rebuild *rb);
+int			collapse_hierarchies(t_scene *scene);
+void		free_bvh(t_bvh *bvh);
+int			bvh_intersect(t_bvh *bvh, t_ray *ray, t_leaf_fn leaf, void *ctx);
+int			bvh_occluded(t_bvh *bvh, t_ray *ray, t_leaf_fn leaf, void *ctx);
+int			build_hierarchies(t_scene *scene, t_options *opts);
+int			sbvh_build(t_bvh *bvh, t_mesh *mesh);
+int			sbvh_split_ref(t_sbvh *s, t_sbvh_ref *ref, t_sbvh_plane pl,
+				t_sbvh_ref out[2]);
+double		sbvh_object_split(t_sbvh_refs *in, t_aabb bounds,
+				t_sbvh_split *best);
+void		sbvh_spatial_split(t_sbvh *s, t_sbvh_refs *in, t_sbvh_split *best);
+int			build_grid(t_scene *scene);
+int			grid_preferred(t_aabb *boxes, size_t count);
+void		free_grid(t_grid *g);
+int			grid_intersect(t_grid *g, t_ray *ray, t_leaf_fn leaf, void *ctx);
+int			grid_occluded(t_grid *g, t_ray *ray, t_leaf_fn leaf, void *ctx);
+int			build_prims(t_scene *scene);
+void		prims_update(t_scene *scene, uint32_t id);
+void		free_prims(t_prims *p);
+int			simd_avx2(void);
+void		sphere_roots(t_sphere_soa *s, t_ray *ray, t_prim_run *run,
+				int avx2);
+void		quadric_store(t_quadric_soa *s, uint32_t j, t_quadric *q);
+void		quadric_roots(t_quadric_soa *s, t_ray *ray, t_prim_run *run,
+				int avx2);
+void		triangle_distances(t_mesh_query *q, t_ray *ray, t_tri_run *run);
+int			prims_intersect(t_scene *scene, t_ray *ray, uint32_t *ids,
+				uint32_t count);
+int			prims_occluded(t_scene *scene, t_ray *ray, uint32_t *ids,
+				uint32_t count);
+int			scene_intersect(t_scene *scene, t_ray *ray);
+int			bvh_intersect_packet(t_bvh *bvh, t_packet *p, t_packet_leaf_fn leaf,
+				void *ctx);
+void		scene_intersect_packet(t_scene *scene, t_packet *p);
+int			scene_occluded(t_scene *scene, t_ray *ray);
 
 
 /* ==== Lighting and Colors ==== */
+void		hit_record(t_hit *hit, t_scene *scene, t_ray *ray, int index);
+t_vector	offset_origin(t_vector point, t_vector normal);
 t_color		calculate_lighting(t_scene *scene, t_ray *ray, int obj_idx);
 int			is_in_shadow(t_scene *scene, t_vector point, t_vector light_dir, double light_dist);
 uint32_t	color_to_int(t_color color);
@@ -246,6 +1236,33 @@ int parse_sphere_compact(t_scene *scene, char **parts);
 int     intersect_triangle(t_ray *ray, t_triangle triangle);
 t_vector triangle_normal(t_triangle triangle);
 int     parse_triangle(t_scene *scene, char **parts);
+int     parse_mesh(t_scene *scene, char **parts);
+int     parse_accel(t_scene *scene, char **parts);
+
+/* ==== Meshes ==== */
+int			mesh_add_triangle(t_scene *scene, t_vector v[3], t_color color);
+int			build_meshes(t_scene *scene, int threads, int sbvh);
+void		free_meshes(t_scene *scene);
+int			intersect_mesh(t_ray *ray, t_mesh_ref *ref);
+uint32_t	intersect_mesh_packet(t_mesh_ref *ref, t_packet *p);
+int			occlude_mesh(t_ray *ray, t_mesh_ref *ref);
+t_vector	mesh_normal(t_mesh_ref *ref, uint32_t tri);
+t_mesh		*mesh_new(t_scene *scene, t_color color, int open);
+t_mesh_ref	*mesh_instance(t_scene *scene, t_mesh *mesh, t_color color);
+t_mesh		*mesh_find(t_scene *scene, char *path);
+t_xform		instance_xform(t_vector position, double scale,
+				t_vector rotation);
+t_ray		instance_ray(t_xform *x, t_ray *ray);
+t_vector	instance_normal(t_xform *x, t_vector n);
+void		instance_bounds(t_mesh_ref *ref);
+void		bake_instances(t_scene *scene);
+int			mesh_push_vertex(t_mesh *mesh, t_vector v);
+int			mesh_push_triangle(t_mesh *mesh, uint32_t a, uint32_t b, uint32_t c);
+int			load_mesh_file(t_mesh *mesh, char *path);
+int			load_ply(t_mesh *mesh, const unsigned char *s,
+				const unsigned char *end);
+int			map_file(char *path, t_mapped_file *file, int writable);
+void		unmap_file(t_mapped_file *file);
 
 
 # endif
\ No newline at end of file
@@ -41,7 +41,6 @@ char				*ft_strnstr(const char *haystack, const char *needle,
 size_t				ft_strlcpy(char *dst, const char *src, size_t dstsize);
 size_t				ft_strlcat(char *dst, const char *src, size_t dstsize);
 int64_t				ft_atoi(const char *str);
-// float				ft_atof(const char *str);
 void				*ft_calloc(size_t count, size_t size);
 char				*ft_strdup(const char *s1);
 char				*ft_substr(char const *s, unsigned int start, size_t len);
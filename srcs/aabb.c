@@ -0,0 +1,146 @@
+#include "../includes/minirt.h"
+
+t_aabb	aabb_empty(void)
+{
+	t_aabb	box;
+
+	box.min = (t_vector){INFINITY, INFINITY, INFINITY};
+	box.max = (t_vector){-INFINITY, -INFINITY, -INFINITY};
+	return (box);
+}
+
+/*
+** Bounds are never NaN, so plain compares do; unlike fmin/fmax they
+** compile to single min/max instructions.
+*/
+t_aabb	aabb_union(t_aabb a, t_aabb b)
+{
+	t_aabb	box;
+
+	box.min.x = (b.min.x < a.min.x) ? b.min.x : a.min.x;
+	box.min.y = (b.min.y < a.min.y) ? b.min.y : a.min.y;
+	box.min.z = (b.min.z < a.min.z) ? b.min.z : a.min.z;
+	box.max.x = (b.max.x > a.max.x) ? b.max.x : a.max.x;
+	box.max.y = (b.max.y > a.max.y) ? b.max.y : a.max.y;
+	box.max.z = (b.max.z > a.max.z) ? b.max.z : a.max.z;
+	return (box);
+}
+
+t_aabb	aabb_grow(t_aabb box, t_vector p)
+{
+	return (aabb_union(box, (t_aabb){p, p}));
+}
+
+/*
+** Inverted on some axis when the boxes do not overlap.
+*/
+t_aabb	aabb_intersection(t_aabb a, t_aabb b)
+{
+	t_aabb	box;
+
+	box.min.x = (b.min.x > a.min.x) ? b.min.x : a.min.x;
+	box.min.y = (b.min.y > a.min.y) ? b.min.y : a.min.y;
+	box.min.z = (b.min.z > a.min.z) ? b.min.z : a.min.z;
+	box.max.x = (b.max.x < a.max.x) ? b.max.x : a.max.x;
+	box.max.y = (b.max.y < a.max.y) ? b.max.y : a.max.y;
+	box.max.z = (b.max.z < a.max.z) ? b.max.z : a.max.z;
+	return (box);
+}
+
+/*
+** Half the surface area; the SAH only ever compares ratios of areas.
+*/
+double	aabb_area(t_aabb box)
+{
+	t_vector	d;
+
+	if (box.max.x < box.min.x)
+		return (0);
+	d = vec_sub(box.max, box.min);
+	return (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+t_vector	aabb_centroid(t_aabb box)
+{
+	return (vec_mul(vec_add(box.min, box.max), 0.5));
+}
+
+/*
+** Per-axis half extent of a disk of the given radius lying in the plane
+** perpendicular to `axis` (which must be normalized).
+*/
+static t_vector	disk_extent(t_vector axis, double radius)
+{
+	t_vector	e;
+
+	e.x = radius * sqrt(fmax(0.0, 1.0 - axis.x * axis.x));
+	e.y = radius * sqrt(fmax(0.0, 1.0 - axis.y * axis.y));
+	e.z = radius * sqrt(fmax(0.0, 1.0 - axis.z * axis.z));
+	return (e);
+}
+
+static t_aabb	disk_bounds(t_vector center, t_vector axis, double radius)
+{
+	t_vector	e;
+
+	e = disk_extent(axis, radius);
+	return ((t_aabb){vec_sub(center, e), vec_add(center, e)});
+}
+
+static t_aabb	triangle_bounds(t_triangle tri)
+{
+	t_aabb	box;
+
+	box = (t_aabb){tri.v1, tri.v1};
+	box = aabb_grow(box, tri.v2);
+	return (aabb_grow(box, tri.v3));
+}
+
+static int	bounds_finite(t_aabb box)
+{
+	return (isfinite(box.min.x) && isfinite(box.min.y) && isfinite(box.min.z)
+		&& isfinite(box.max.x) && isfinite(box.max.y) && isfinite(box.max.z));
+}
+
+/*
+** Fills `box` with the world-space bounds of `obj`. Returns 0 for objects
+** that have no finite bounds (planes, degenerate cones, empty meshes),
+** which the acceleration structure keeps in a separate list. Mesh bounds
+** are only known once build_meshes has run.
+*/
+int	object_bounds(t_object obj, t_aabb *box)
+{
+	t_vector	r;
+
+	if (obj.type == SPHERE)
+	{
+		r = (t_vector){obj.sphere.radius, obj.sphere.radius, obj.sphere.radius};
+		*box = (t_aabb){vec_sub(obj.sphere.center, r), vec_add(obj.sphere.center, r)};
+	}
+	else if (obj.type == CYLINDER)
+	{
+		*box = aabb_union(
+				disk_bounds(obj.cylinder.center, obj.cylinder.axis, obj.cylinder.radius),
+				disk_bounds(obj.cylinder.top, obj.cylinder.axis,
+					obj.cylinder.radius));
+	}
+	else if (obj.type == CONE)
+	{
+		*box = aabb_grow(disk_bounds(obj.cone.base, obj.cone.axis,
+					fabs(obj.cone.base_radius)), obj.cone.vertex);
+	}
+	else if (obj.type == HYPERBOLOID)
+	{
+		r = (t_vector){obj.hyperboloid.height, obj.hyperboloid.height,
+			obj.hyperboloid.height};
+		*box = (t_aabb){vec_sub(obj.hyperboloid.center, r),
+			vec_add(obj.hyperboloid.center, r)};
+	}
+	else if (obj.type == TRIANGLE)
+		*box = triangle_bounds(obj.triangle);
+	else if (obj.type == MESH)
+		*box = obj.mesh.bounds;
+	else
+		return (0);
+	return (bounds_finite(*box));
+}
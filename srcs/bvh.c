@@ -0,0 +1,253 @@
+#include "../includes/minirt.h"
+
+int	bvh_compare_keys(const void *a, const void *b)
+{
+	double	ka;
+	double	kb;
+
+	ka = ((const t_bvh_key *)a)->key;
+	kb = ((const t_bvh_key *)b)->key;
+	if (ka < kb)
+		return (-1);
+	return (ka > kb);
+}
+
+/*
+** Past BVH_MEDIAN_DEPTH, and when no plane separates the centroids, the
+** range is cut at the centroid median of its widest axis so that the tree
+** depth (and the traversal stack) stays bounded on degenerate input.
+*/
+static uint32_t	median_split(t_bvh_range *r)
+{
+	t_bvh_key	*keys;
+	uint32_t	*prims;
+	t_vector	d;
+	int			axis;
+	uint32_t	i;
+
+	d = vec_sub(r->cbounds.max, r->cbounds.min);
+	axis = (d.y > d.x);
+	if (d.z > vec_axis(d, axis))
+		axis = 2;
+	keys = r->b->keys + r->first;
+	prims = r->b->bvh->prims + r->first;
+	i = 0;
+	while (i < r->count)
+	{
+		keys[i].prim = prims[i];
+		keys[i].key = vec_axis(r->b->centroids[prims[i]], axis);
+		i++;
+	}
+	qsort(keys, r->count, sizeof(t_bvh_key), bvh_compare_keys);
+	i = 0;
+	while (i < r->count)
+	{
+		prims[i] = keys[i].prim;
+		i++;
+	}
+	return (r->count / 2);
+}
+
+/*
+** Binned SAH object partition. Returns the size of the left half, or 0 to
+** keep the range as a leaf, and stores the bounds of the whole range.
+*/
+static uint32_t	split_task(t_bvh_build *b, t_bvh_task t, t_aabb *bounds)
+{
+	t_bvh_range	r;
+	double		cost;
+	int			axis;
+	int			bin;
+
+	r.b = b;
+	r.first = t.first;
+	r.count = t.count;
+	bvh_scan(&r, 0);
+	*bounds = r.bounds;
+	if (t.count <= 1)
+		return (0);
+	if (t.depth >= BVH_MEDIAN_DEPTH)
+		return (median_split(&r));
+	bvh_scan(&r, 1);
+	cost = bvh_best_bin(&r, &axis, &bin);
+	if (t.count <= BVH_MAX_LEAF && cost >= BVH_INTERSECT_COST * t.count)
+		return (0);
+	if (cost == INFINITY)
+		return (median_split(&r));
+	return (bvh_partition(&r, axis, bin));
+}
+
+/*
+** The left child takes the slot after its parent and the right child the
+** first slot past the 2 * split - 1 reserved for the left subtree, so
+** subtrees never share slots and can be built by different threads. While
+** b->top is set, ranges below b->task_min are queued instead.
+*/
+int	bvh_build_node(t_bvh_build *b, t_bvh_task t)
+{
+	t_bvh_node	*node;
+	t_aabb		bounds;
+	uint32_t	split;
+
+	if (b->top && t.count < b->task_min)
+		return (bvh_push_task(b, t));
+	split = split_task(b, t, &bounds);
+	node = &b->bvh->nodes[t.node];
+	node->bounds = bounds;
+	node->first = t.first;
+	node->count = t.count;
+	if (split == 0)
+		return (1);
+	node->first = t.node + 2 * split;
+	node->count = 0;
+	return (bvh_build_node(b, (t_bvh_task){t.first, split, t.node + 1,
+			t.depth + 1}) && bvh_build_node(b, (t_bvh_task){t.first + split,
+			t.count - split, t.node + 2 * split, t.depth + 1}));
+}
+
+/*
+** Closes the gaps left by the reserved slots, in depth-first order. A node
+** only ever moves to a lower slot and every slot is read before anything
+** is written over it, so this runs in place.
+*/
+static uint32_t	compact(t_bvh *bvh, uint32_t slot)
+{
+	t_bvh_node	node;
+	uint32_t	index;
+
+	node = bvh->nodes[slot];
+	index = bvh->node_count++;
+	bvh->nodes[index] = node;
+	if (node.count == 0)
+	{
+		compact(bvh, slot + 1);
+		bvh->nodes[index].first = compact(bvh, node.first);
+	}
+	return (index);
+}
+
+static int	build_tree(t_bvh_build *b, size_t count)
+{
+	t_bvh_node	*nodes;
+	int			ok;
+
+	b->task_min = count / ((size_t)b->threads * BVH_TASKS_PER_THREAD);
+	if (b->task_min < BVH_TASK_MIN)
+		b->task_min = BVH_TASK_MIN;
+	b->top = (b->threads > 1 && count >= b->task_min);
+	ok = bvh_build_node(b, (t_bvh_task){0, count, 0, 0});
+	b->top = 0;
+	ok = ok && bvh_run_tasks(b);
+	free(b->tasks);
+	if (!ok)
+		return (0);
+	compact(b->bvh, 0);
+	nodes = realloc(b->bvh->nodes, sizeof(t_bvh_node) * b->bvh->node_count);
+	if (nodes)
+		b->bvh->nodes = nodes;
+	return (bvh_collapse(b->bvh));
+}
+
+/*
+** Builds a hierarchy over `count` boxes on up to `threads` threads; the
+** tree is the same whatever the thread count. On return bvh->prims is a
+** permutation of 0..count-1 in leaf order; callers remap it to their own
+** primitive ids.
+*/
+int	bvh_build(t_bvh *bvh, t_aabb *boxes, size_t count, int threads)
+{
+	t_bvh_build	b;
+	size_t		i;
+
+	bvh->node_count = 0;
+	bvh->prim_count = count;
+	if (count == 0)
+		return (1);
+	b = (t_bvh_build){.bvh = bvh, .boxes = boxes, .threads = threads,
+		.centroids = malloc(sizeof(t_vector) * count),
+		.keys = malloc(sizeof(t_bvh_key) * count)};
+	bvh->nodes = malloc(sizeof(t_bvh_node) * (2 * count - 1));
+	bvh->prims = malloc(sizeof(uint32_t) * count);
+	i = 0;
+	if (b.centroids && b.keys && bvh->nodes && bvh->prims)
+	{
+		while (i < count)
+		{
+			b.centroids[i] = aabb_centroid(boxes[i]);
+			bvh->prims[i] = i;
+			i++;
+		}
+		i = build_tree(&b, count);
+	}
+	free(b.centroids);
+	free(b.keys);
+	return (i && bvh->node_count > 0);
+}
+
+/*
+** Splits the scene into bounded objects, which go into the hierarchy, and
+** unbounded ones (planes) that every ray still tests directly. In grid
+** mode, asked for or picked by grid_preferred, the bounded ones are only
+** listed in bvh.prims and the grid is built over them instead.
+*/
+int	build_bvh(t_scene *scene, int threads)
+{
+	t_aabb		*boxes;
+	uint32_t	*ids;
+	size_t		count;
+	size_t		i;
+
+	scene->bvh = (t_bvh){0};
+	boxes = malloc(sizeof(t_aabb) * (scene->obj_count + 1));
+	ids = malloc(sizeof(uint32_t) * (scene->obj_count + 1));
+	scene->bvh.unbounded = malloc(sizeof(uint32_t) * (scene->obj_count + 1));
+	if (!boxes || !ids || !scene->bvh.unbounded)
+		return (free(boxes), free(ids), ft_putstr_fd(
+				"Error: Memory allocation failed\n", 2), 0);
+	count = 0;
+	i = 0;
+	while (i < scene->obj_count)
+	{
+		if (object_bounds(scene->objects[i], &boxes[count]))
+			ids[count++] = i;
+		else
+			scene->bvh.unbounded[scene->bvh.unbounded_count++] = i;
+		i++;
+	}
+	if (scene->accel == ACCEL_AUTO && grid_preferred(boxes, count))
+		scene->accel = ACCEL_GRID;
+	if (scene->accel == ACCEL_GRID)
+	{
+		free(boxes);
+		scene->bvh.prims = ids;
+		scene->bvh.prim_count = count;
+		if (!build_grid(scene))
+			return (ft_putstr_fd("Error: Could not build grid\n", 2), 0);
+		return (1);
+	}
+	scene->accel = ACCEL_BVH;
+	if (!bvh_build(&scene->bvh, boxes, count, threads))
+		return (free(boxes), free(ids), ft_putstr_fd(
+				"Error: Could not build BVH\n", 2), 0);
+	i = 0;
+	while (i < count)
+	{
+		scene->bvh.prims[i] = ids[scene->bvh.prims[i]];
+		i++;
+	}
+	free(boxes);
+	free(ids);
+	return (1);
+}
+
+void	free_bvh(t_bvh *bvh)
+{
+	if (!bvh->mapped)
+	{
+		free(bvh->nodes);
+		free(bvh->prims);
+		free(bvh->unbounded);
+	}
+	free(bvh->wide);
+	*bvh = (t_bvh){0};
+}
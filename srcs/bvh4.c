@@ -0,0 +1,175 @@
+#include "../includes/minirt.h"
+
+/*
+** Float bounds are rounded outwards so they always contain the double
+** ones.
+*/
+static float	round_down(double v)
+{
+	float	f;
+
+	f = (float)v;
+	if (f > v)
+		f = nextafterf(f, -INFINITY);
+	return (f);
+}
+
+static float	round_up(double v)
+{
+	float	f;
+
+	f = (float)v;
+	if (f < v)
+		f = nextafterf(f, INFINITY);
+	return (f);
+}
+
+static void	set_slot(t_bvh4_node *w, int i, t_aabb *box)
+{
+	if (!box)
+	{
+		w->min[0][i] = INFINITY;
+		w->min[1][i] = INFINITY;
+		w->min[2][i] = INFINITY;
+		w->max[0][i] = INFINITY;
+		w->max[1][i] = INFINITY;
+		w->max[2][i] = INFINITY;
+		w->child[i] = 0;
+		w->count[i] = 0;
+		return ;
+	}
+	w->min[0][i] = round_down(box->min.x);
+	w->min[1][i] = round_down(box->min.y);
+	w->min[2][i] = round_down(box->min.z);
+	w->max[0][i] = round_up(box->max.x);
+	w->max[1][i] = round_up(box->max.y);
+	w->max[2][i] = round_up(box->max.z);
+}
+
+/*
+** Gathers up to four descendants of `node` by repeatedly opening the
+** interior one with the largest surface area. Returns how many there are.
+*/
+static int	gather(t_bvh *bvh, uint32_t node, uint32_t kids[4])
+{
+	double	best;
+	int		open;
+	int		n;
+	int		i;
+
+	kids[0] = node;
+	n = 1;
+	while (n < 4)
+	{
+		open = -1;
+		best = -1.0;
+		i = -1;
+		while (++i < n)
+			if (bvh->nodes[kids[i]].count == 0
+				&& aabb_area(bvh->nodes[kids[i]].bounds) > best)
+			{
+				best = aabb_area(bvh->nodes[kids[i]].bounds);
+				open = i;
+			}
+		if (open < 0)
+			break ;
+		kids[n++] = bvh->nodes[kids[open]].first;
+		kids[open]++;
+	}
+	return (n);
+}
+
+/*
+** Emits the wide node for binary `node` and, depth first, the wide nodes
+** of its interior descendants. Returns its index. With `slots`, records
+** for every binary node placed in a slot the wide node * 4 + slot.
+*/
+static uint32_t	collapse(t_bvh *bvh, uint32_t node, uint32_t *slots)
+{
+	uint32_t	kids[4];
+	uint32_t	index;
+	int			n;
+	int			i;
+
+	index = bvh->wide_count++;
+	n = gather(bvh, node, kids);
+	i = 0;
+	while (i < 4)
+	{
+		if (i < n)
+		{
+			set_slot(&bvh->wide[index], i, &bvh->nodes[kids[i]].bounds);
+			if (slots)
+				slots[kids[i]] = index * 4 + i;
+			bvh->wide[index].count[i] = bvh->nodes[kids[i]].count;
+			bvh->wide[index].child[i] = bvh->nodes[kids[i]].first;
+			if (bvh->nodes[kids[i]].count == 0)
+				bvh->wide[index].child[i] = collapse(bvh, kids[i], slots);
+		}
+		else
+			set_slot(&bvh->wide[index], i, NULL);
+		i++;
+	}
+	return (index);
+}
+
+/*
+** Derives the 4-wide traversal tree from the binary one. The binary tree
+** stays the stored form (cache, .rtb, bounds), so this also runs after a
+** hierarchy is mapped from a file. `slots`, if given, has one entry per
+** binary node and is filled as in collapse; nodes opened into their
+** children and the root keep UINT32_MAX.
+*/
+int	bvh_collapse_slots(t_bvh *bvh, uint32_t *slots)
+{
+	t_bvh4_node	*tmp;
+
+	free(bvh->wide);
+	bvh->wide = NULL;
+	bvh->wide_count = 0;
+	if (bvh->node_count == 0)
+		return (1);
+	bvh->wide = malloc(sizeof(t_bvh4_node) * bvh->node_count);
+	if (!bvh->wide)
+		return (0);
+	if (slots)
+		ft_memset(slots, 0xff, sizeof(uint32_t) * bvh->node_count);
+	collapse(bvh, 0, slots);
+	tmp = realloc(bvh->wide, sizeof(t_bvh4_node) * bvh->wide_count);
+	if (tmp)
+		bvh->wide = tmp;
+	return (1);
+}
+
+int	bvh_collapse(t_bvh *bvh)
+{
+	return (bvh_collapse_slots(bvh, NULL));
+}
+
+/*
+** Copies the bounds of a binary node to its wide slot after a refit.
+*/
+void	bvh4_update_slot(t_bvh *bvh, uint32_t slot, t_aabb *box)
+{
+	set_slot(&bvh->wide[slot / 4], slot % 4, box);
+}
+
+/*
+** Collapses the scene and mesh hierarchies of a scene whose binary trees
+** were mapped from a cache entry or a compiled scene, and rebuilds the
+** grid of a scene in grid mode.
+*/
+int	collapse_hierarchies(t_scene *scene)
+{
+	size_t	i;
+
+	if (!bvh_collapse(&scene->bvh))
+		return (0);
+	i = 0;
+	while (i < scene->mesh_count)
+		if (!bvh_collapse(&scene->meshes[i++]->bvh))
+			return (0);
+	if (scene->accel == ACCEL_GRID)
+		return (build_grid(scene));
+	return (1);
+}
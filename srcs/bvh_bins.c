@@ -0,0 +1,292 @@
+#include "../includes/minirt.h"
+
+int	bvh_bin_index(double v, double min, double scale)
+{
+	double	k;
+
+	k = (v - min) * scale;
+	if (!(k > 0))
+		return (0);
+	if (k >= BVH_BINS)
+		return (BVH_BINS - 1);
+	return ((int)k);
+}
+
+int	bvh_bin_of(t_bvh_range *r, t_vector c, int axis)
+{
+	if (axis == 0)
+		return (bvh_bin_index(c.x, r->cbounds.min.x, r->scale[0]));
+	if (axis == 1)
+		return (bvh_bin_index(c.y, r->cbounds.min.y, r->scale[1]));
+	return (bvh_bin_index(c.z, r->cbounds.min.z, r->scale[2]));
+}
+
+/*
+** Bin bounds are only meaningful once the bin count is non-zero, so the
+** first box in a bin is stored rather than merged.
+*/
+static void	add_to_bin(t_bvh_bins *bins, int axis, int k, t_aabb *box)
+{
+	if (bins->count[axis][k]++ == 0)
+		bins->bounds[axis][k] = *box;
+	else
+		bins->bounds[axis][k] = aabb_union(bins->bounds[axis][k], *box);
+}
+
+/*
+** Adds a box to the bin its centroid falls in on each axis.
+*/
+void	bvh_bin_box(t_bvh_range *r, t_vector c, t_aabb *box)
+{
+	add_to_bin(&r->bins, 0, bvh_bin_index(c.x, r->cbounds.min.x, r->scale[0]),
+		box);
+	add_to_bin(&r->bins, 1, bvh_bin_index(c.y, r->cbounds.min.y, r->scale[1]),
+		box);
+	add_to_bin(&r->bins, 2, bvh_bin_index(c.z, r->cbounds.min.z, r->scale[2]),
+		box);
+}
+
+static void	*scan_worker(void *param)
+{
+	t_bvh_range	*r;
+	uint32_t	p;
+	uint32_t	i;
+
+	r = (t_bvh_range *)param;
+	if (r->pass == 0)
+	{
+		r->bounds = aabb_empty();
+		r->cbounds = aabb_empty();
+	}
+	if (r->pass == 1)
+		ft_bzero(r->bins.count, sizeof(r->bins.count));
+	i = 0;
+	while (i < r->count)
+	{
+		p = r->b->bvh->prims[r->first + i++];
+		if (r->pass == 1)
+			bvh_bin_box(r, r->b->centroids[p], &r->b->boxes[p]);
+		else
+		{
+			r->bounds = aabb_union(r->bounds, r->b->boxes[p]);
+			r->cbounds = aabb_grow(r->cbounds, r->b->centroids[p]);
+		}
+	}
+	return (NULL);
+}
+
+static void	merge_part(t_bvh_range *r, t_bvh_range *part)
+{
+	int	axis;
+	int	k;
+
+	if (r->pass == 0)
+	{
+		r->bounds = aabb_union(r->bounds, part->bounds);
+		r->cbounds = aabb_union(r->cbounds, part->cbounds);
+		return ;
+	}
+	axis = -1;
+	while (++axis < 3)
+	{
+		k = -1;
+		while (++k < BVH_BINS)
+		{
+			if (part->bins.count[axis][k] == 0)
+				continue ;
+			if (r->bins.count[axis][k] == 0)
+				r->bins.bounds[axis][k] = part->bins.bounds[axis][k];
+			else
+				r->bins.bounds[axis][k] = aabb_union(r->bins.bounds[axis][k],
+						part->bins.bounds[axis][k]);
+			r->bins.count[axis][k] += part->bins.count[axis][k];
+		}
+	}
+}
+
+/*
+** Large ranges near the root are cut into one chunk per thread. Bounds
+** unions and bin counts are exact, so the result does not depend on the
+** thread count.
+*/
+static void	scan_parallel(t_bvh_range *r, t_bvh_range *parts, int n)
+{
+	pthread_t	threads[MAX_THREADS];
+	int			started[MAX_THREADS];
+	int			i;
+
+	i = -1;
+	while (++i < n)
+	{
+		parts[i] = *r;
+		parts[i].first = r->first + (uint64_t)r->count * i / n;
+		parts[i].count = r->first + (uint64_t)r->count * (i + 1) / n
+			- parts[i].first;
+	}
+	i = 0;
+	while (++i < n)
+		started[i] = (pthread_create(&threads[i], NULL, scan_worker,
+					&parts[i]) == 0);
+	scan_worker(&parts[0]);
+	r->bounds = parts[0].bounds;
+	r->cbounds = parts[0].cbounds;
+	r->bins = parts[0].bins;
+	i = 0;
+	while (++i < n)
+	{
+		if (started[i])
+			pthread_join(threads[i], NULL);
+		else
+			scan_worker(&parts[i]);
+		merge_part(r, &parts[i]);
+	}
+}
+
+/*
+** Sets the per-axis scale that maps a centroid in r->cbounds to its bin.
+*/
+void	bvh_bin_scale(t_bvh_range *r)
+{
+	t_vector	extent;
+	int			axis;
+
+	extent = vec_sub(r->cbounds.max, r->cbounds.min);
+	axis = -1;
+	while (++axis < 3)
+	{
+		r->scale[axis] = 0.0;
+		if (vec_axis(extent, axis) > 0.0)
+			r->scale[axis] = BVH_BINS / vec_axis(extent, axis);
+	}
+}
+
+/*
+** Runs `pass` over the range. Pass 0 also sets the bin scale for pass 1
+** and for partitioning.
+*/
+void	bvh_scan(t_bvh_range *r, int pass)
+{
+	t_bvh_range	*parts;
+	int			n;
+
+	r->pass = pass;
+	n = r->count / BVH_PARALLEL_MIN;
+	if (n > r->b->threads)
+		n = r->b->threads;
+	parts = NULL;
+	if (n > 1)
+		parts = malloc(sizeof(t_bvh_range) * n);
+	if (parts)
+		scan_parallel(r, parts, n);
+	else
+		scan_worker(r);
+	free(parts);
+	if (pass == 0)
+		bvh_bin_scale(r);
+}
+
+/*
+** Sweeps the bins of one axis from both sides and keeps the plane with the
+** lowest SAH cost in *best, its first bin on the right in *bin.
+*/
+static int	sweep_bins(t_bvh_bins *bins, int axis, double parent_area,
+		double *best)
+{
+	double		right_area[BVH_BINS];
+	uint32_t	right_count[BVH_BINS];
+	t_aabb		acc;
+	uint32_t	n;
+	int			k;
+	int			found;
+	double		area;
+
+	area = 0.0;
+	acc = aabb_empty();
+	n = 0;
+	k = BVH_BINS;
+	while (--k > 0)
+	{
+		if (bins->count[axis][k] > 0)
+		{
+			acc = aabb_union(acc, bins->bounds[axis][k]);
+			n += bins->count[axis][k];
+			area = aabb_area(acc);
+		}
+		right_area[k] = area;
+		right_count[k] = n;
+	}
+	acc = aabb_empty();
+	n = 0;
+	found = 0;
+	while (++k < BVH_BINS)
+	{
+		if (bins->count[axis][k - 1] == 0)
+			continue ;
+		acc = aabb_union(acc, bins->bounds[axis][k - 1]);
+		n += bins->count[axis][k - 1];
+		if (right_count[k] > 0 && BVH_TRAVERSAL_COST
+			+ BVH_INTERSECT_COST * (aabb_area(acc) * n + right_area[k]
+				* right_count[k]) / parent_area < *best)
+		{
+			*best = BVH_TRAVERSAL_COST + BVH_INTERSECT_COST * (aabb_area(acc)
+					* n + right_area[k] * right_count[k]) / parent_area;
+			found = k;
+		}
+	}
+	return (found);
+}
+
+/*
+** Returns the SAH cost of the best binned plane over all three axes, or
+** INFINITY when no plane separates the centroids, and stores its axis and
+** its first bin on the right.
+*/
+double	bvh_best_bin(t_bvh_range *r, int *axis, int *bin)
+{
+	double	best;
+	int		a;
+	int		k;
+
+	best = INFINITY;
+	a = 0;
+	while (a < 3)
+	{
+		k = sweep_bins(&r->bins, a, fmax(aabb_area(r->bounds), EPSILON),
+				&best);
+		if (k > 0)
+		{
+			*axis = a;
+			*bin = k;
+		}
+		a++;
+	}
+	return (best);
+}
+
+/*
+** Moves the primitives binned left of `bin` to the front of the range and
+** returns how many there are.
+*/
+uint32_t	bvh_partition(t_bvh_range *r, int axis, int bin)
+{
+	uint32_t	*prims;
+	uint32_t	i;
+	uint32_t	j;
+	uint32_t	tmp;
+
+	prims = r->b->bvh->prims;
+	i = r->first;
+	j = r->first + r->count;
+	while (i < j)
+	{
+		if (bvh_bin_of(r, r->b->centroids[prims[i]], axis) < bin)
+			i++;
+		else
+		{
+			tmp = prims[i];
+			prims[i] = prims[--j];
+			prims[j] = tmp;
+		}
+	}
+	return (i - r->first);
+}
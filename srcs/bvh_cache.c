@@ -0,0 +1,346 @@
+#include "../includes/minirt.h"
+
+/*
+** Word-at-a-time multiplicative hash; used both for the geometry key and
+** for the entry checksum.
+*/
+static uint64_t	hash_bytes(uint64_t h, const void *data, size_t len)
+{
+	const unsigned char	*p;
+	uint64_t			w;
+
+	p = data;
+	while (len > 0)
+	{
+		w = 0;
+		if (len >= 8)
+			ft_memcpy(&w, p, 8);
+		else
+			ft_memcpy(&w, p, len);
+		h = (h ^ w) * 0x9E3779B97F4A7C15ull;
+		h ^= h >> 32;
+		if (len < 8)
+			break ;
+		p += 8;
+		len -= 8;
+	}
+	return (h);
+}
+
+/*
+** Only the fields a primitive's bounds and intersection depend on; colors
+** and textures are left out so material changes still hit the cache.
+** Quadric forms follow from the fields before them and hold padding,
+** so they are left out too.
+*/
+static uint64_t	hash_object(uint64_t h, t_object *obj)
+{
+	uint32_t	type;
+
+	type = obj->type;
+	h = hash_bytes(h, &type, sizeof(type));
+	if (obj->type == SPHERE)
+		return (hash_bytes(h, &obj->sphere, sizeof(t_sphere)));
+	if (obj->type == PLANE)
+		return (hash_bytes(h, &obj->plane, sizeof(t_plane)));
+	if (obj->type == CYLINDER)
+		return (hash_bytes(h, &obj->cylinder, offsetof(t_cylinder, quadric)));
+	if (obj->type == CONE)
+		return (hash_bytes(h, &obj->cone, offsetof(t_cone, quadric)));
+	if (obj->type == HYPERBOLOID)
+		return (hash_bytes(h, &obj->hyperboloid,
+				offsetof(t_hyperboloid, quadric)));
+	if (obj->type == TRIANGLE)
+		return (hash_bytes(h, &obj->triangle, sizeof(t_triangle)));
+	h = hash_bytes(h, &obj->mesh.data->id, sizeof(uint32_t));
+	h = hash_bytes(h, &obj->mesh.xform.identity, sizeof(int));
+	return (hash_bytes(h, &obj->mesh.xform, sizeof(t_vector) * 4
+			+ sizeof(double)));
+}
+
+/*
+** Shared meshes are hashed once, however many objects place them.
+*/
+static uint64_t	hash_mesh(uint64_t h, t_mesh *m)
+{
+	h = hash_bytes(h, &m->vertex_count, sizeof(size_t));
+	h = hash_bytes(h, &m->tri_count, sizeof(size_t));
+	h = hash_bytes(h, &m->users, sizeof(size_t));
+	h = hash_bytes(h, m->vertices, m->vertex_count * sizeof(t_vertex));
+	return (hash_bytes(h, m->indices, m->tri_count * 3 * sizeof(uint32_t)));
+}
+
+/*
+** The builder parameters are part of the key, so retuning the SAH gives
+** new entries instead of reusing hierarchies built with the old settings,
+** and SBVH and plain mesh hierarchies, and accelerator choices, are kept
+** apart.
+*/
+static uint64_t	geometry_key(t_scene *scene, int sbvh)
+{
+	static const double	params[] = {BVH_MAX_LEAF, BVH_MEDIAN_DEPTH,
+		BVH_TRAVERSAL_COST, BVH_INTERSECT_COST, BVH_BINS, sizeof(t_bvh_node),
+		SBVH_ALPHA, SBVH_BUDGET};
+	uint64_t			h;
+	size_t				i;
+
+	h = hash_bytes(BVH_CACHE_VERSION, params, sizeof(params));
+	h = hash_bytes(h, &sbvh, sizeof(int));
+	h = hash_bytes(h, &scene->accel, sizeof(t_accel));
+	h = hash_bytes(h, &scene->obj_count, sizeof(size_t));
+	i = 0;
+	while (i < scene->obj_count)
+		h = hash_object(h, &scene->objects[i++]);
+	h = hash_bytes(h, &scene->mesh_count, sizeof(size_t));
+	i = 0;
+	while (i < scene->mesh_count)
+		h = hash_mesh(h, scene->meshes[i++]);
+	return (h);
+}
+
+static uint64_t	hierarchy_checksum(t_scene *scene)
+{
+	t_bvh		*bvh;
+	size_t		i;
+	uint64_t	h;
+
+	h = BVH_CACHE_VERSION;
+	i = 0;
+	while (i <= scene->mesh_count)
+	{
+		bvh = &scene->bvh;
+		if (i > 0)
+			bvh = &scene->meshes[i - 1]->bvh;
+		h = hash_bytes(h, bvh->nodes, bvh->node_count * sizeof(t_bvh_node));
+		h = hash_bytes(h, bvh->prims, bvh->prim_count * sizeof(uint32_t));
+		h = hash_bytes(h, bvh->unbounded,
+				bvh->unbounded_count * sizeof(uint32_t));
+		i++;
+	}
+	return (h);
+}
+
+/*
+** "<dir>/<key>.bvh", or "<dir>/<key>.bvh.<pid>" for the temporary file an
+** entry is written to before being renamed into place.
+*/
+static char	*entry_path(char *dir, uint64_t key, int tmp)
+{
+	char	name[64];
+	size_t	len;
+	int		i;
+	char	*path;
+
+	name[0] = '/';
+	i = 16;
+	while (i > 0)
+	{
+		name[i--] = "0123456789abcdef"[key & 15];
+		key >>= 4;
+	}
+	ft_memcpy(name + 17, ".bvh", 5);
+	len = 21;
+	if (tmp)
+	{
+		key = getpid();
+		name[len++] = '.';
+		i = 8;
+		while (i-- > 0)
+			name[len++] = "0123456789abcdef"[(key >> (i * 4)) & 15];
+		name[len] = '\0';
+	}
+	path = ft_strjoin(dir, name);
+	return (path);
+}
+
+static int	map_bvh(t_mapped_file *f, t_bvh *bvh, t_rtb_section sec[3])
+{
+	bvh->nodes = rtb_section_ptr(f, sec[0], sizeof(t_bvh_node));
+	bvh->prims = rtb_section_ptr(f, sec[1], sizeof(uint32_t));
+	bvh->unbounded = rtb_section_ptr(f, sec[2], sizeof(uint32_t));
+	bvh->node_count = sec[0].count;
+	bvh->prim_count = sec[1].count;
+	bvh->unbounded_count = sec[2].count;
+	bvh->mapped = 1;
+	return (bvh->nodes && bvh->prims && bvh->unbounded);
+}
+
+static int	map_meshes(t_scene *scene, t_bvh_cache_header *h)
+{
+	t_bvh_cache_mesh	*rec;
+	size_t				i;
+
+	rec = rtb_section_ptr(&scene->bvh_cache, h->meshes,
+			sizeof(t_bvh_cache_mesh));
+	if (!rec || h->meshes.count != scene->mesh_count)
+		return (0);
+	i = 0;
+	while (i < scene->mesh_count)
+	{
+		if (!map_bvh(&scene->bvh_cache, &scene->meshes[i]->bvh,
+				(t_rtb_section [3]){rec[i].nodes, rec[i].prims, {0, 0}})
+			|| rec[i].prims.count < scene->meshes[i]->tri_count)
+			return (0);
+		i++;
+	}
+	return (1);
+}
+
+/*
+** Maps the entry for `key` and points every hierarchy into it. Anything
+** that does not match, including a missing file, leaves the scene as it
+** was and reports a miss.
+*/
+static int	load_entry(t_scene *scene, char *path, uint64_t key)
+{
+	t_bvh_cache_header	*h;
+	size_t				i;
+
+	if (!map_file(path, &scene->bvh_cache, 0))
+		return (0);
+	h = (t_bvh_cache_header *)scene->bvh_cache.data;
+	if (scene->bvh_cache.size >= sizeof(t_bvh_cache_header)
+		&& !ft_memcmp(h->magic, BVH_CACHE_MAGIC, sizeof(h->magic))
+		&& h->version == BVH_CACHE_VERSION
+		&& h->node_size == sizeof(t_bvh_node) && h->key == key
+		&& h->prims.count + h->unbounded.count == scene->obj_count
+		&& map_bvh(&scene->bvh_cache, &scene->bvh,
+			(t_rtb_section [3]){h->nodes, h->prims, h->unbounded})
+		&& map_meshes(scene, h) && hierarchy_checksum(scene) == h->checksum
+		&& (h->accel == ACCEL_BVH || h->accel == ACCEL_GRID))
+		return (scene->accel = h->accel, 1);
+	scene->bvh = (t_bvh){0};
+	i = 0;
+	while (i < scene->mesh_count)
+		scene->meshes[i++]->bvh = (t_bvh){0};
+	unmap_file(&scene->bvh_cache);
+	return (0);
+}
+
+static void	layout_entry(t_scene *scene, t_bvh_cache_header *h,
+		t_bvh_cache_mesh *meshes, uint64_t key)
+{
+	uint64_t	off;
+	t_bvh		*bvh;
+	size_t		i;
+
+	ft_bzero(h, sizeof(t_bvh_cache_header));
+	ft_memcpy(h->magic, BVH_CACHE_MAGIC, sizeof(h->magic));
+	h->version = BVH_CACHE_VERSION;
+	h->node_size = sizeof(t_bvh_node);
+	h->key = key;
+	h->checksum = hierarchy_checksum(scene);
+	h->accel = scene->accel;
+	off = 0;
+	rtb_reserve(&off, 1, sizeof(t_bvh_cache_header));
+	h->meshes = rtb_reserve(&off, scene->mesh_count, sizeof(t_bvh_cache_mesh));
+	h->nodes = rtb_reserve(&off, scene->bvh.node_count, sizeof(t_bvh_node));
+	h->prims = rtb_reserve(&off, scene->bvh.prim_count, sizeof(uint32_t));
+	h->unbounded = rtb_reserve(&off, scene->bvh.unbounded_count,
+			sizeof(uint32_t));
+	i = 0;
+	while (i < scene->mesh_count)
+	{
+		bvh = &scene->meshes[i]->bvh;
+		meshes[i].nodes = rtb_reserve(&off, bvh->node_count,
+				sizeof(t_bvh_node));
+		meshes[i++].prims = rtb_reserve(&off, bvh->prim_count,
+				sizeof(uint32_t));
+	}
+}
+
+static void	put_entry(t_rtb_out *out, t_scene *scene, t_bvh_cache_header *h,
+		t_bvh_cache_mesh *meshes)
+{
+	t_bvh	*bvh;
+	size_t	i;
+
+	rtb_put(out, 0, h, sizeof(t_bvh_cache_header));
+	rtb_put(out, h->meshes.offset, meshes,
+		h->meshes.count * sizeof(t_bvh_cache_mesh));
+	rtb_put(out, h->nodes.offset, scene->bvh.nodes,
+		h->nodes.count * sizeof(t_bvh_node));
+	rtb_put(out, h->prims.offset, scene->bvh.prims, h->prims.count * 4);
+	rtb_put(out, h->unbounded.offset, scene->bvh.unbounded,
+		h->unbounded.count * 4);
+	i = 0;
+	while (i < scene->mesh_count)
+	{
+		bvh = &scene->meshes[i]->bvh;
+		rtb_put(out, meshes[i].nodes.offset, bvh->nodes,
+			bvh->node_count * sizeof(t_bvh_node));
+		rtb_put(out, meshes[i].prims.offset, bvh->prims, bvh->prim_count * 4);
+		i++;
+	}
+}
+
+/*
+** Writes to a per-process temporary file and renames it into place, so
+** concurrent renders never map a half-written entry.
+*/
+static int	store_entry(t_scene *scene, char *dir, char *path, uint64_t key)
+{
+	t_bvh_cache_header	h;
+	t_bvh_cache_mesh	*meshes;
+	t_rtb_out			out;
+	char				*tmp;
+	int					ok;
+
+	meshes = malloc(sizeof(t_bvh_cache_mesh) * (scene->mesh_count + 1));
+	tmp = entry_path(dir, key, 1);
+	out = (t_rtb_out){malloc(sizeof(t_writer)), 0};
+	ok = (meshes && tmp && out.w);
+	if (ok)
+	{
+		layout_entry(scene, &h, meshes, key);
+		out.w->fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		out.w->ok = (out.w->fd >= 0);
+		out.w->len = 0;
+		out.w->crc = 0;
+		put_entry(&out, scene, &h, meshes);
+		writer_flush(out.w);
+		ok = out.w->ok;
+		if (out.w->fd >= 0 && close(out.w->fd) != 0)
+			ok = 0;
+		if (!ok || rename(tmp, path) != 0)
+			ok = (unlink(tmp), 0);
+	}
+	free(meshes);
+	free(tmp);
+	free(out.w);
+	return (ok);
+}
+
+/*
+** Closes the meshes and gets every hierarchy, from opts->cache_dir when it
+** holds an entry for the scene geometry, else by building them. A miss,
+** a stale or a corrupt entry all rebuild and replace the entry; failing to
+** write it only costs the next run a rebuild.
+*/
+int	build_hierarchies(t_scene *scene, t_options *opts)
+{
+	uint64_t	key;
+	char		*path;
+	int			hit;
+	int			ok;
+
+	if (!opts->cache_dir)
+		return (build_meshes(scene, opts->threads, opts->sbvh)
+			&& build_bvh(scene, opts->threads));
+	key = geometry_key(scene, opts->sbvh);
+	path = entry_path(opts->cache_dir, key, 0);
+	if (!path)
+		return (ft_putstr_fd("Error: Memory allocation failed\n", 2), 0);
+	hit = load_entry(scene, path, key);
+	ok = build_meshes(scene, opts->threads, opts->sbvh)
+		&& (hit || build_bvh(scene, opts->threads))
+		&& (!hit || collapse_hierarchies(scene));
+	if (ok && !hit)
+	{
+		mkdir(opts->cache_dir, 0755);
+		if (!store_entry(scene, opts->cache_dir, path, key))
+			ft_putstr_fd("Warning: Could not write BVH cache entry\n", 2);
+	}
+	free(path);
+	return (ok);
+}
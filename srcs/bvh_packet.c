@@ -0,0 +1,331 @@
+#include "../includes/minirt.h"
+
+/*
+** Single-precision inverse directions of the active rays, as init_ray
+** computes them, with zeroes in the other lanes. Returns 0 unless all the
+** active rays leave from the origin of ray `first`.
+*/
+static int	packet_inverse(t_bvh4_packet *b, t_packet *p, uint32_t first)
+{
+	t_ray		*r;
+	uint32_t	i;
+
+	i = -1;
+	while (++i < PACKET_SIZE)
+	{
+		r = &p->rays[i];
+		b->inv[0][i] = 0.0f;
+		b->inv[1][i] = 0.0f;
+		b->inv[2][i] = 0.0f;
+		if (!(b->active & (1u << i)))
+			continue ;
+		if (r->origin.x != p->rays[first].origin.x
+			|| r->origin.y != p->rays[first].origin.y
+			|| r->origin.z != p->rays[first].origin.z)
+			return (0);
+		b->inv[0][i] = 1.0 / r->direction.x;
+		b->inv[1][i] = 1.0 / r->direction.y;
+		b->inv[2][i] = 1.0 / r->direction.z;
+	}
+	return (1);
+}
+
+/*
+** Packets stay together only while all their active rays leave from one
+** point and agree on the direction along every axis. The inverse
+** directions are the values each ray would use on its own, so a box any
+** of them enters is entered by their interval. Lanes of other rays get a
+** zero inverse and never enter a box. Returns 0 for a packet that has to
+** be traced ray by ray.
+*/
+static int	packet_bounds(t_bvh4_packet *b, t_packet *p)
+{
+	uint32_t	first;
+	uint32_t	i;
+	int			axis;
+
+	first = 0;
+	while (!(b->active & (1u << first)))
+		first++;
+	if (!packet_inverse(b, p, first))
+		return (0);
+	axis = -1;
+	while (++axis < 3)
+	{
+		b->origin[axis] = vec_axis(p->rays[first].origin, axis);
+		b->pad[axis] = fabsf(b->origin[axis]) * 0x1p-21f + FLT_MIN;
+		b->sign[axis] = b->inv[axis][first] > 0.0f;
+		b->inv_lo[axis] = INFINITY;
+		b->inv_hi[axis] = -INFINITY;
+		i = -1;
+		while (++i < PACKET_SIZE)
+		{
+			if (!(b->active & (1u << i)))
+				continue ;
+			if (!isfinite(b->inv[axis][i])
+				|| (b->inv[axis][i] > 0.0f) != b->sign[axis])
+				return (0);
+			b->inv_lo[axis] = fminf(b->inv_lo[axis], b->inv[axis][i]);
+			b->inv_hi[axis] = fmaxf(b->inv_hi[axis], b->inv[axis][i]);
+		}
+	}
+	return (1);
+}
+
+/*
+** Loads the distances of the rays in `mask`, at the start and whenever a
+** leaf shrinks them.
+*/
+static void	packet_tfar(t_bvh4_packet *b, t_packet *p, uint32_t mask)
+{
+	uint32_t	i;
+
+	b->tmax = -INFINITY;
+	i = 0;
+	while (i < PACKET_SIZE)
+	{
+		if (mask & (1u << i))
+			b->tfar[i] = p->rays[i].t;
+		else if (!(b->active & (1u << i)))
+			b->tfar[i] = -INFINITY;
+		b->tmax = fmaxf(b->tmax, b->tfar[i]);
+		i++;
+	}
+}
+
+#ifdef __SSE2__
+
+/*
+** Interval slab test against the four children: the entry distance of
+** each is the smallest and the exit distance the largest any ray of the
+** packet can have, so a child is only culled when every ray misses it.
+*/
+static int	packet_hits(t_bvh4_node *n, t_bvh4_packet *b, float tnear[4])
+{
+	__m128	lo;
+	__m128	hi;
+	__m128	t[2];
+	__m128	inv[2];
+	int		axis;
+
+	lo = _mm_setzero_ps();
+	hi = _mm_set1_ps(b->tmax);
+	axis = -1;
+	while (++axis < 3)
+	{
+		t[0] = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(n->min[axis]),
+					_mm_set1_ps(b->pad[axis])), _mm_set1_ps(b->origin[axis]));
+		t[1] = _mm_sub_ps(_mm_add_ps(_mm_loadu_ps(n->max[axis]),
+					_mm_set1_ps(b->pad[axis])), _mm_set1_ps(b->origin[axis]));
+		inv[0] = _mm_set1_ps(b->inv_lo[axis]);
+		inv[1] = _mm_set1_ps(b->inv_hi[axis]);
+		lo = _mm_max_ps(_mm_min_ps(_mm_mul_ps(t[!b->sign[axis]], inv[0]),
+					_mm_mul_ps(t[!b->sign[axis]], inv[1])), lo);
+		hi = _mm_min_ps(_mm_max_ps(_mm_mul_ps(t[b->sign[axis]], inv[0]),
+					_mm_mul_ps(t[b->sign[axis]], inv[1])), hi);
+	}
+	_mm_storeu_ps(tnear, lo);
+	return (_mm_movemask_ps(_mm_cmple_ps(lo,
+				_mm_mul_ps(hi, _mm_set1_ps(BVH4_SLACK)))));
+}
+
+/*
+** Slab test of lanes i to i + 3 against a box whose near and far planes
+** along each axis lie at offsets t[0] and t[1] from the packet's origin.
+*/
+static int	lanes_enter(__m128 t[2][3], t_bvh4_packet *b, int i)
+{
+	__m128	lo;
+	__m128	hi;
+	__m128	inv;
+	int		axis;
+
+	lo = _mm_setzero_ps();
+	hi = _mm_loadu_ps(b->tfar + i);
+	axis = -1;
+	while (++axis < 3)
+	{
+		inv = _mm_loadu_ps(b->inv[axis] + i);
+		lo = _mm_max_ps(_mm_mul_ps(t[0][axis], inv), lo);
+		hi = _mm_min_ps(_mm_mul_ps(t[1][axis], inv), hi);
+	}
+	return (_mm_movemask_ps(_mm_cmple_ps(lo,
+				_mm_mul_ps(hi, _mm_set1_ps(BVH4_SLACK)))));
+}
+
+/*
+** The active rays that enter the box in `slot` of node `n`, four at a
+** time, by the same slab test each would run on its own.
+*/
+static uint32_t	leaf_rays(t_bvh4_node *n, uint32_t slot, t_bvh4_packet *b)
+{
+	__m128		t[2][3];
+	float		plane[2];
+	uint32_t	mask;
+	int			i;
+
+	i = -1;
+	while (++i < 3)
+	{
+		plane[0] = n->min[i][slot] - b->pad[i] - b->origin[i];
+		plane[1] = n->max[i][slot] + b->pad[i] - b->origin[i];
+		t[0][i] = _mm_set1_ps(plane[!b->sign[i]]);
+		t[1][i] = _mm_set1_ps(plane[b->sign[i]]);
+	}
+	mask = 0;
+	i = 0;
+	while (i < PACKET_SIZE)
+	{
+		mask |= lanes_enter(t, b, i) << i;
+		i += 4;
+	}
+	return (mask);
+}
+
+#else
+
+static int	packet_hits(t_bvh4_node *n, t_bvh4_packet *b, float tnear[4])
+{
+	float	t[2];
+	float	hi;
+	int		axis;
+	int		i;
+	int		mask;
+
+	mask = 0;
+	i = -1;
+	while (++i < 4)
+	{
+		tnear[i] = 0.0f;
+		hi = b->tmax;
+		axis = -1;
+		while (++axis < 3)
+		{
+			t[0] = n->min[axis][i] - b->pad[axis] - b->origin[axis];
+			t[1] = n->max[axis][i] + b->pad[axis] - b->origin[axis];
+			tnear[i] = fmaxf(tnear[i], fminf(t[!b->sign[axis]]
+						* b->inv_lo[axis],
+						t[!b->sign[axis]] * b->inv_hi[axis]));
+			hi = fminf(hi, fmaxf(t[b->sign[axis]] * b->inv_lo[axis],
+						t[b->sign[axis]] * b->inv_hi[axis]));
+		}
+		if (tnear[i] <= hi * BVH4_SLACK)
+			mask |= 1 << i;
+	}
+	return (mask);
+}
+
+static uint32_t	leaf_rays(t_bvh4_node *n, uint32_t slot, t_bvh4_packet *b)
+{
+	float		t[2][3];
+	float		r[2];
+	uint32_t	mask;
+	int			axis;
+	int			i;
+
+	axis = -1;
+	while (++axis < 3)
+	{
+		t[0][axis] = n->min[axis][slot] - b->pad[axis] - b->origin[axis];
+		t[1][axis] = n->max[axis][slot] + b->pad[axis] - b->origin[axis];
+	}
+	mask = 0;
+	i = -1;
+	while (++i < PACKET_SIZE)
+	{
+		r[0] = 0.0f;
+		r[1] = b->tfar[i];
+		axis = -1;
+		while (++axis < 3)
+		{
+			r[0] = fmaxf(t[!b->sign[axis]][axis] * b->inv[axis][i], r[0]);
+			r[1] = fminf(t[b->sign[axis]][axis] * b->inv[axis][i], r[1]);
+		}
+		if (r[0] <= r[1] * BVH4_SLACK)
+			mask |= 1u << i;
+	}
+	return (mask);
+}
+
+#endif
+
+/*
+** As push_children, with the packet's entry distances.
+*/
+static int	push_packet_children(t_bvh *bvh, uint32_t node, t_bvh4_packet *b,
+		t_packet_entry *stack)
+{
+	t_packet_entry	e;
+	float			tnear[4];
+	int				mask;
+	int				count;
+	int				i;
+	int				j;
+
+	mask = packet_hits(&bvh->wide[node], b, tnear);
+	count = 0;
+	i = -1;
+	while (++i < 4)
+	{
+		e = (t_packet_entry){bvh->wide[node].child[i],
+			bvh->wide[node].count[i], tnear[i], node, i};
+		if (!(mask & (1 << i)) || (e.child == 0 && e.count == 0))
+			continue ;
+		j = count++;
+		while (j > 0 && stack[j - 1].t < e.t)
+		{
+			stack[j] = stack[j - 1];
+			j--;
+		}
+		stack[j] = e;
+	}
+	return (count);
+}
+
+/*
+** Nearest-hit traversal of the active rays of a packet, front to back by
+** the packet's entry distances. Each leaf is tested against the rays that
+** enter its box, so every ray finds the same nearest hit as on its own.
+** Returns the mask of rays that found a closer hit, or -1 for a packet
+** whose rays diverge, which the caller traces ray by ray. p->active is
+** left as it was.
+*/
+int	bvh_intersect_packet(t_bvh *bvh, t_packet *p, t_packet_leaf_fn leaf,
+		void *ctx)
+{
+	t_packet_entry	stack[BVH_STACK_SIZE];
+	t_bvh4_packet	b;
+	t_packet_entry	e;
+	int				top;
+	uint32_t		mask;
+
+	b.active = p->active;
+	if (!b.active)
+		return (0);
+	if (!packet_bounds(&b, p))
+		return (-1);
+	packet_tfar(&b, p, b.active);
+	b.hit = 0;
+	top = 0;
+	stack[top++] = (t_packet_entry){0, 0, 0.0f, 0, 0};
+	while (top > 0 && bvh->wide_count > 0)
+	{
+		e = stack[--top];
+		if (e.t > b.tmax * BVH4_SLACK)
+			continue ;
+		if (e.count == 0)
+			top += push_packet_children(bvh, e.child, &b, stack + top);
+		else
+		{
+			p->active = leaf_rays(&bvh->wide[e.node], e.slot, &b);
+			mask = 0;
+			if (p->active)
+				mask = leaf(ctx, p, bvh->prims + e.child, e.count);
+			if (mask)
+				packet_tfar(&b, p, mask);
+			b.hit |= mask;
+		}
+	}
+	p->active = b.active;
+	return (b.hit);
+}
@@ -0,0 +1,108 @@
+#include "../includes/minirt.h"
+
+static void	*rebuild_worker(void *arg)
+{
+	t_bvh_rebuild	*rb;
+	int				ok;
+
+	rb = (t_bvh_rebuild *)arg;
+	ok = bvh_build(&rb->bvh, rb->boxes, rb->count, rb->threads);
+	pthread_mutex_lock(&rb->lock);
+	rb->ok = ok;
+	rb->done = 1;
+	pthread_mutex_unlock(&rb->lock);
+	return (NULL);
+}
+
+/*
+** Starts building a new scene hierarchy on a background thread from a
+** snapshot of the object bounds, so editing can go on meanwhile. Does
+** nothing while a rebuild is already running.
+*/
+int	bvh_rebuild_start(t_bvh_rebuild *rb, t_scene *scene, int threads)
+{
+	size_t	i;
+
+	if (rb->running)
+		return (1);
+	*rb = (t_bvh_rebuild){.threads = threads, .count = scene->bvh.prim_count};
+	rb->boxes = malloc(sizeof(t_aabb) * (rb->count + 1));
+	rb->ids = malloc(sizeof(uint32_t) * (rb->count + 1));
+	if (!rb->boxes || !rb->ids || pthread_mutex_init(&rb->lock, NULL) != 0)
+		return (free(rb->boxes), free(rb->ids), 0);
+	i = 0;
+	while (i < rb->count)
+	{
+		rb->ids[i] = scene->bvh.prims[i];
+		object_bounds(scene->objects[rb->ids[i]], &rb->boxes[i]);
+		i++;
+	}
+	if (pthread_create(&rb->thread, NULL, rebuild_worker, rb) != 0)
+	{
+		pthread_mutex_destroy(&rb->lock);
+		return (free(rb->boxes), free(rb->ids), 0);
+	}
+	rb->running = 1;
+	return (1);
+}
+
+static void	rebuild_join(t_bvh_rebuild *rb)
+{
+	pthread_join(rb->thread, NULL);
+	pthread_mutex_destroy(&rb->lock);
+	free(rb->boxes);
+	free(rb->ids);
+	rb->boxes = NULL;
+	rb->ids = NULL;
+	rb->running = 0;
+}
+
+/*
+** Swaps a finished rebuild in. Objects may have moved since the snapshot,
+** so the new tree is refit to their current bounds first, and the object
+** streams are laid out again in its order. Returns 1 when the scene
+** hierarchy changed, -1 when it could not be prepared for further refits.
+*/
+int	bvh_rebuild_poll(t_bvh_rebuild *rb, t_scene *scene, t_bvh_refit *refit)
+{
+	int		done;
+	size_t	i;
+
+	if (!rb->running)
+		return (0);
+	pthread_mutex_lock(&rb->lock);
+	done = rb->done;
+	pthread_mutex_unlock(&rb->lock);
+	if (!done)
+		return (0);
+	i = 0;
+	while (rb->ok && i < rb->count)
+	{
+		rb->bvh.prims[i] = rb->ids[rb->bvh.prims[i]];
+		i++;
+	}
+	rebuild_join(rb);
+	if (!rb->ok)
+		return (free_bvh(&rb->bvh), 0);
+	rb->bvh.unbounded = scene->bvh.unbounded;
+	rb->bvh.unbounded_count = scene->bvh.unbounded_count;
+	scene->bvh.unbounded = NULL;
+	free_bvh(&scene->bvh);
+	scene->bvh = rb->bvh;
+	rb->bvh = (t_bvh){0};
+	bvh_refit_all(scene);
+	if (!bvh_refit_init(refit, scene) || !build_prims(scene))
+		return (-1);
+	return (1);
+}
+
+/*
+** Waits for a running rebuild and drops its result.
+*/
+void	bvh_rebuild_stop(t_bvh_rebuild *rb)
+{
+	if (!rb->running)
+		return ;
+	rebuild_join(rb);
+	free_bvh(&rb->bvh);
+}
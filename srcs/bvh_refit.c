@@ -0,0 +1,165 @@
+#include "../includes/minirt.h"
+
+static double	node_cost(t_bvh_node *node)
+{
+	if (node->count > 0)
+		return (BVH_INTERSECT_COST * node->count * aabb_area(node->bounds));
+	return (BVH_TRAVERSAL_COST * aabb_area(node->bounds));
+}
+
+static t_aabb	leaf_bounds(t_scene *scene, t_bvh_node *leaf)
+{
+	t_aabb		box;
+	t_aabb		obj;
+	uint32_t	i;
+
+	box = aabb_empty();
+	i = 0;
+	while (i < leaf->count)
+	{
+		if (object_bounds(scene->objects[scene->bvh.prims[leaf->first + i]],
+				&obj))
+			box = aabb_union(box, obj);
+		i++;
+	}
+	return (box);
+}
+
+static void	*dup_array(void *src, size_t size)
+{
+	void	*dst;
+
+	dst = malloc(size + 1);
+	if (dst)
+		ft_memcpy(dst, src, size);
+	return (dst);
+}
+
+/*
+** Trees mapped from a cache entry are read only; refits work on a copy.
+*/
+static int	own_arrays(t_bvh *bvh)
+{
+	t_bvh_node	*nodes;
+	uint32_t	*prims;
+	uint32_t	*unbounded;
+
+	if (!bvh->mapped)
+		return (1);
+	nodes = dup_array(bvh->nodes, sizeof(t_bvh_node) * bvh->node_count);
+	prims = dup_array(bvh->prims, sizeof(uint32_t) * bvh->prim_count);
+	unbounded = dup_array(bvh->unbounded,
+			sizeof(uint32_t) * bvh->unbounded_count);
+	if (!nodes || !prims || !unbounded)
+		return (free(nodes), free(prims), free(unbounded), 0);
+	bvh->nodes = nodes;
+	bvh->prims = prims;
+	bvh->unbounded = unbounded;
+	bvh->mapped = 0;
+	return (1);
+}
+
+/*
+** Links every node to its parent and every object to its leaf, collapses
+** the wide tree again to learn which slot shows each node, and records
+** the SAH cost of the fresh tree, left unnormalized: objects leaving the
+** scene bounds grow the root, which must not hide the nodes they stretch.
+** Refits that push the cost past BVH_REFIT_LIMIT times that ask for a
+** rebuild.
+*/
+int	bvh_refit_init(t_bvh_refit *r, t_scene *scene)
+{
+	t_bvh		*bvh;
+	uint32_t	n;
+	uint32_t	i;
+
+	bvh = &scene->bvh;
+	bvh_refit_free(r);
+	r->parent = malloc(sizeof(uint32_t) * (bvh->node_count + 1));
+	r->slot = malloc(sizeof(uint32_t) * (bvh->node_count + 1));
+	r->leaf = malloc(sizeof(uint32_t) * (scene->obj_count + 1));
+	if (!r->parent || !r->slot || !r->leaf || !own_arrays(bvh)
+		|| !bvh_collapse_slots(bvh, r->slot))
+		return (bvh_refit_free(r), 0);
+	ft_memset(r->leaf, 0xff, sizeof(uint32_t) * scene->obj_count);
+	r->cost = 0.0;
+	n = 0;
+	while (n < bvh->node_count)
+	{
+		r->cost += node_cost(&bvh->nodes[n]);
+		i = 0;
+		while (i < bvh->nodes[n].count)
+			r->leaf[bvh->prims[bvh->nodes[n].first + i++]] = n;
+		if (bvh->nodes[n].count == 0)
+		{
+			r->parent[n + 1] = n;
+			r->parent[bvh->nodes[n].first] = n;
+		}
+		n++;
+	}
+	r->parent[0] = UINT32_MAX;
+	r->limit = BVH_REFIT_LIMIT * r->cost;
+	return (1);
+}
+
+/*
+** Recomputes the box of the leaf holding object `id` and of its ancestors,
+** stopping at the first one that does not change, and mirrors each change
+** into the wide tree. Returns 1 once the tree has degraded enough that it
+** should be rebuilt.
+*/
+int	bvh_refit(t_bvh_refit *r, t_scene *scene, uint32_t id)
+{
+	t_bvh		*bvh;
+	t_aabb		box;
+	uint32_t	n;
+
+	bvh = &scene->bvh;
+	n = r->leaf[id];
+	if (n == UINT32_MAX)
+		return (0);
+	box = leaf_bounds(scene, &bvh->nodes[n]);
+	while (ft_memcmp(&box, &bvh->nodes[n].bounds, sizeof(t_aabb)) != 0)
+	{
+		r->cost -= node_cost(&bvh->nodes[n]);
+		bvh->nodes[n].bounds = box;
+		r->cost += node_cost(&bvh->nodes[n]);
+		if (r->slot[n] != UINT32_MAX)
+			bvh4_update_slot(bvh, r->slot[n], &box);
+		n = r->parent[n];
+		if (n == UINT32_MAX)
+			break ;
+		box = aabb_union(bvh->nodes[n + 1].bounds,
+				bvh->nodes[bvh->nodes[n].first].bounds);
+	}
+	return (r->cost > r->limit);
+}
+
+/*
+** Refits every node of a tree built from stale boxes, children before
+** parents: in the depth-first layout both children follow their parent.
+*/
+void	bvh_refit_all(t_scene *scene)
+{
+	t_bvh_node	*node;
+	size_t		n;
+
+	n = scene->bvh.node_count;
+	while (n-- > 0)
+	{
+		node = &scene->bvh.nodes[n];
+		if (node->count > 0)
+			node->bounds = leaf_bounds(scene, node);
+		else
+			node->bounds = aabb_union(scene->bvh.nodes[n + 1].bounds,
+					scene->bvh.nodes[node->first].bounds);
+	}
+}
+
+void	bvh_refit_free(t_bvh_refit *r)
+{
+	free(r->parent);
+	free(r->slot);
+	free(r->leaf);
+	*r = (t_bvh_refit){0};
+}
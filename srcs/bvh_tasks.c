@@ -0,0 +1,81 @@
+#include "../includes/minirt.h"
+
+int	bvh_push_task(t_bvh_build *b, t_bvh_task t)
+{
+	t_bvh_task	*tmp;
+	size_t		cap;
+
+	if (b->task_count == b->task_cap)
+	{
+		cap = b->task_cap * 2 + 64;
+		tmp = realloc(b->tasks, sizeof(t_bvh_task) * cap);
+		if (!tmp)
+			return (0);
+		b->tasks = tmp;
+		b->task_cap = cap;
+	}
+	b->tasks[b->task_count++] = t;
+	return (1);
+}
+
+static int	compare_tasks(const void *a, const void *b)
+{
+	uint32_t	ca;
+	uint32_t	cb;
+
+	ca = ((const t_bvh_task *)a)->count;
+	cb = ((const t_bvh_task *)b)->count;
+	if (ca > cb)
+		return (-1);
+	return (ca < cb);
+}
+
+static void	*task_worker(void *param)
+{
+	t_bvh_build	*b;
+	size_t		i;
+
+	b = (t_bvh_build *)param;
+	while (1)
+	{
+		pthread_mutex_lock(&b->lock);
+		i = b->next_task++;
+		pthread_mutex_unlock(&b->lock);
+		if (i >= b->task_count)
+			break ;
+		bvh_build_node(b, b->tasks[i]);
+	}
+	return (NULL);
+}
+
+/*
+** Builds the queued subtrees, largest first so that no thread is left with
+** a big one at the end. Each task owns its primitive range and node slots;
+** the lock only guards the queue position.
+*/
+int	bvh_run_tasks(t_bvh_build *b)
+{
+	pthread_t	threads[MAX_THREADS];
+	int			started[MAX_THREADS];
+	int			n;
+	int			i;
+
+	if (b->task_count == 0)
+		return (1);
+	if (pthread_mutex_init(&b->lock, NULL) != 0)
+		return (0);
+	qsort(b->tasks, b->task_count, sizeof(t_bvh_task), compare_tasks);
+	n = b->threads;
+	if ((size_t)n > b->task_count)
+		n = b->task_count;
+	i = 0;
+	while (++i < n)
+		started[i] = (pthread_create(&threads[i], NULL, task_worker, b) == 0);
+	task_worker(b);
+	i = 0;
+	while (++i < n)
+		if (started[i])
+			pthread_join(threads[i], NULL);
+	pthread_mutex_destroy(&b->lock);
+	return (1);
+}
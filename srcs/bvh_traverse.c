@@ -0,0 +1,239 @@
+#include "../includes/minirt.h"
+
+static void	init_ray(t_bvh4_ray *r, t_ray *ray)
+{
+	int	i;
+
+	r->origin[0] = ray->origin.x;
+	r->origin[1] = ray->origin.y;
+	r->origin[2] = ray->origin.z;
+	r->inv_dir[0] = 1.0 / ray->direction.x;
+	r->inv_dir[1] = 1.0 / ray->direction.y;
+	r->inv_dir[2] = 1.0 / ray->direction.z;
+	i = 0;
+	while (i < 3)
+	{
+		r->pad[i] = fabsf(r->origin[i]) * 0x1p-21f + FLT_MIN;
+		i++;
+	}
+}
+
+#ifdef __SSE2__
+
+/*
+** Slab test against the four children at once. Stores the entry distances
+** and returns a bit mask of the children entered before `tmax`. BVH4_SLACK
+** absorbs the float rounding of the distances. The min/max operand order
+** drops the NaN of a zero distance times an infinite inverse direction.
+*/
+static int	node_hits(t_bvh4_node *n, t_bvh4_ray *r, float tmax,
+		float tnear[4])
+{
+	__m128	lo;
+	__m128	hi;
+	__m128	t0;
+	__m128	t1;
+	int		axis;
+
+	lo = _mm_setzero_ps();
+	hi = _mm_set1_ps(tmax);
+	axis = 0;
+	while (axis < 3)
+	{
+		t0 = _mm_sub_ps(_mm_loadu_ps(n->min[axis]), _mm_set1_ps(r->pad[axis]));
+		t1 = _mm_add_ps(_mm_loadu_ps(n->max[axis]), _mm_set1_ps(r->pad[axis]));
+		t0 = _mm_mul_ps(_mm_sub_ps(t0, _mm_set1_ps(r->origin[axis])),
+				_mm_set1_ps(r->inv_dir[axis]));
+		t1 = _mm_mul_ps(_mm_sub_ps(t1, _mm_set1_ps(r->origin[axis])),
+				_mm_set1_ps(r->inv_dir[axis]));
+		lo = _mm_max_ps(_mm_min_ps(t0, t1), lo);
+		hi = _mm_min_ps(_mm_max_ps(t0, t1), hi);
+		axis++;
+	}
+	_mm_storeu_ps(tnear, lo);
+	return (_mm_movemask_ps(_mm_cmple_ps(lo,
+				_mm_mul_ps(hi, _mm_set1_ps(BVH4_SLACK)))));
+}
+
+#else
+
+static int	node_hits(t_bvh4_node *n, t_bvh4_ray *r, float tmax,
+		float tnear[4])
+{
+	float	t0;
+	float	t1;
+	float	hi;
+	int		axis;
+	int		i;
+	int		mask;
+
+	mask = 0;
+	i = -1;
+	while (++i < 4)
+	{
+		tnear[i] = 0.0f;
+		hi = tmax;
+		axis = -1;
+		while (++axis < 3)
+		{
+			t0 = (n->min[axis][i] - r->pad[axis] - r->origin[axis])
+				* r->inv_dir[axis];
+			t1 = (n->max[axis][i] + r->pad[axis] - r->origin[axis])
+				* r->inv_dir[axis];
+			tnear[i] = fmaxf(tnear[i], fminf(t0, t1));
+			hi = fminf(hi, fmaxf(t0, t1));
+		}
+		if (tnear[i] <= hi * BVH4_SLACK)
+			mask |= 1 << i;
+	}
+	return (mask);
+}
+
+#endif
+
+/*
+** Pushes the children the ray enters onto `stack`, farthest first, so that
+** the nearest one is popped next. Returns how many were pushed.
+*/
+static int	push_children(t_bvh4_node *n, t_bvh4_ray *r, t_ray *ray,
+		t_bvh4_entry *stack)
+{
+	t_bvh4_entry	e;
+	float			tnear[4];
+	int				mask;
+	int				count;
+	int				i;
+	int				j;
+
+	mask = node_hits(n, r, ray->t, tnear);
+	count = 0;
+	i = -1;
+	while (++i < 4)
+	{
+		if (!(mask & (1 << i)) || (n->child[i] == 0 && n->count[i] == 0))
+			continue ;
+		e = (t_bvh4_entry){n->child[i], n->count[i], tnear[i]};
+		j = count++;
+		while (j > 0 && stack[j - 1].t < e.t)
+		{
+			stack[j] = stack[j - 1];
+			j--;
+		}
+		stack[j] = e;
+	}
+	return (count);
+}
+
+/*
+** Nearest-hit traversal, front to back. `leaf` tests the primitives of one
+** leaf, shrinking ray->t, and returns 1 when it found a closer hit. Entries
+** whose box starts past the current hit are dropped when popped.
+*/
+int	bvh_intersect(t_bvh *bvh, t_ray *ray, t_leaf_fn leaf, void *ctx)
+{
+	t_bvh4_entry	stack[BVH_STACK_SIZE];
+	t_bvh4_ray		r;
+	t_bvh4_entry	e;
+	int				top;
+	int				hit;
+
+	if (bvh->wide_count == 0)
+		return (0);
+	init_ray(&r, ray);
+	hit = 0;
+	top = 0;
+	stack[top++] = (t_bvh4_entry){0, 0, 0.0f};
+	while (top > 0)
+	{
+		e = stack[--top];
+		if (e.t > ray->t * BVH4_SLACK)
+			continue ;
+		if (e.count > 0)
+			hit |= leaf(ctx, ray, bvh->prims + e.child, e.count);
+		else
+			top += push_children(&bvh->wide[e.child], &r, ray, stack + top);
+	}
+	return (hit);
+}
+
+/*
+** Any-hit traversal: returns 1 as soon as `leaf` reports a blocker in
+** (EPSILON, ray->t). The order of the children does not matter here, but
+** the nearest-first push costs little and finds close blockers sooner.
+*/
+int	bvh_occluded(t_bvh *bvh, t_ray *ray, t_leaf_fn leaf, void *ctx)
+{
+	t_bvh4_entry	stack[BVH_STACK_SIZE];
+	t_bvh4_ray		r;
+	t_bvh4_entry	e;
+	int				top;
+
+	if (bvh->wide_count == 0)
+		return (0);
+	init_ray(&r, ray);
+	top = 0;
+	stack[top++] = (t_bvh4_entry){0, 0, 0.0f};
+	while (top > 0)
+	{
+		e = stack[--top];
+		if (e.count > 0)
+		{
+			if (leaf(ctx, ray, bvh->prims + e.child, e.count))
+				return (1);
+		}
+		else
+			top += push_children(&bvh->wide[e.child], &r, ray, stack + top);
+	}
+	return (0);
+}
+
+static int	intersect_leaf(void *ctx, t_ray *ray, uint32_t *prims,
+		uint32_t count)
+{
+	t_scene_hit	*hit;
+	int			index;
+
+	hit = (t_scene_hit *)ctx;
+	index = prims_intersect(hit->scene, ray, prims, count);
+	if (index < 0)
+		return (0);
+	hit->index = index;
+	return (1);
+}
+
+static int	occlude_leaf(void *ctx, t_ray *ray, uint32_t *prims,
+		uint32_t count)
+{
+	return (prims_occluded((t_scene *)ctx, ray, prims, count));
+}
+
+/*
+** Nearest-hit query. Shrinks ray->t to the closest intersection and returns
+** the index of the object hit, or -1. Unbounded objects are tested
+** directly, the others through the scene's grid or hierarchy.
+*/
+int	scene_intersect(t_scene *scene, t_ray *ray)
+{
+	t_scene_hit	hit;
+
+	hit = (t_scene_hit){scene, prims_intersect(scene, ray,
+			scene->bvh.unbounded, scene->bvh.unbounded_count)};
+	if (scene->accel == ACCEL_GRID)
+		grid_intersect(&scene->grid, ray, intersect_leaf, &hit);
+	else
+		bvh_intersect(&scene->bvh, ray, intersect_leaf, &hit);
+	return (hit.index);
+}
+
+/*
+** Any-hit query for shadow rays.
+*/
+int	scene_occluded(t_scene *scene, t_ray *ray)
+{
+	if (prims_occluded(scene, ray, scene->bvh.unbounded,
+			scene->bvh.unbounded_count))
+		return (1);
+	if (scene->accel == ACCEL_GRID)
+		return (grid_occluded(&scene->grid, ray, occlude_leaf, scene));
+	return (bvh_occluded(&scene->bvh, ray, occlude_leaf, scene));
+}
@@ -0,0 +1,97 @@
+#include "../includes/minirt.h"
+
+static double	next_random(uint64_t *state)
+{
+	*state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return ((*state >> 11) * 0x1p-53);
+}
+
+/*
+** N-rooks sampling: every sample falls in its own column and its own row
+** of an n by n grid over the pixel, at a random spot in its cell. The
+** pattern is the same for every pixel and every frame, so renders stay
+** repeatable and packets stay coherent.
+*/
+static void	sample_jitter(t_view *view)
+{
+	uint64_t	seed;
+	int			rows[MAX_SAMPLES];
+	int			swap;
+	int			i;
+	int			j;
+
+	view->jitter[0][0] = 0.0;
+	view->jitter[0][1] = 0.0;
+	if (view->samples < 2)
+		return ;
+	i = -1;
+	while (++i < view->samples)
+		rows[i] = i;
+	seed = 1;
+	while (--i > 0)
+	{
+		j = next_random(&seed) * (i + 1);
+		swap = rows[i];
+		rows[i] = rows[j];
+		rows[j] = swap;
+	}
+	while (i < view->samples)
+	{
+		view->jitter[i][0] = (i + next_random(&seed)) / view->samples - 0.5;
+		view->jitter[i][1] = (rows[i] + next_random(&seed)) / view->samples
+			- 0.5;
+		i++;
+	}
+}
+
+/*
+** Sets up the camera of a frame. The image plane lies at distance 1 and
+** spans the horizontal field of view.
+*/
+void	camera_view(t_view *view, t_scene *scene, int samples)
+{
+	view->origin = scene->camera.pos;
+	view->forward = vec_normalize(scene->camera.dir);
+	view->right = vec_normalize(vec_cross((t_vector){0, 1, 0},
+				view->forward));
+	view->up = vec_cross(view->forward, view->right);
+	view->height = 2.0 * tan(scene->camera.fov * M_PI / 360.0);
+	view->width = view->height
+		* ((double)scene->canvas.w / (double)scene->canvas.h);
+	view->last_x = scene->canvas.w - 1;
+	view->last_y = scene->canvas.h - 1;
+	view->samples = samples;
+	sample_jitter(view);
+}
+
+/*
+** Image plane offsets of the columns and rows of `tile` for one sample.
+*/
+void	camera_tile(t_view *view, t_tile *tile, int sample)
+{
+	double	u;
+	double	v;
+	size_t	i;
+
+	i = 0;
+	while (i < tile->w)
+	{
+		u = (tile->x0 + i + view->jitter[sample][0]) / view->last_x - 0.5;
+		tile->col[i++] = vec_mul(view->right, u * view->width);
+	}
+	i = 0;
+	while (i < tile->h)
+	{
+		v = 0.5 - (tile->y0 + i + view->jitter[sample][1]) / view->last_y;
+		tile->row[i++] = vec_mul(view->up, v * view->height);
+	}
+}
+
+/*
+** Direction of the ray through pixel (x, y) of the tile.
+*/
+t_vector	camera_dir(t_view *view, t_tile *tile, size_t x, size_t y)
+{
+	return (vec_normalize(vec_add(view->forward,
+				vec_add(tile->col[x], tile->row[y]))));
+}
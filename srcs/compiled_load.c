@@ -0,0 +1,145 @@
+#include "../includes/minirt.h"
+
+/*
+** Returns the start of an in-bounds, aligned section, or NULL.
+*/
+void	*rtb_section_ptr(t_mapped_file *file, t_rtb_section sec, size_t elem)
+{
+	if (sec.offset % RTB_ALIGN != 0 || sec.offset > file->size
+		|| sec.count > (file->size - sec.offset) / elem)
+		return (NULL);
+	return (file->data + sec.offset);
+}
+
+static int	valid_header(t_mapped_file *file)
+{
+	t_rtb_header	*h;
+
+	if (file->size < sizeof(t_rtb_header))
+		return (0);
+	h = (t_rtb_header *)file->data;
+	return (ft_memcmp(h->magic, RTB_MAGIC, sizeof(h->magic)) == 0
+		&& h->version == RTB_VERSION && h->byte_order == 0x01020304
+		&& h->object_size == sizeof(t_object)
+		&& h->light_size == sizeof(t_light)
+		&& h->node_size == sizeof(t_bvh_node)
+		&& h->vector_size == sizeof(t_vector)
+		&& h->vertex_size == sizeof(t_vertex)
+		&& (h->accel == ACCEL_BVH || h->accel == ACCEL_GRID));
+}
+
+/*
+** Mesh structs are the only allocations: their arrays and binary
+** hierarchies point into the mapping.
+*/
+static int	load_meshes(t_scene *scene, t_rtb_header *h)
+{
+	t_rtb_mesh	*rec;
+	t_mesh		*m;
+
+	rec = rtb_section_ptr(&scene->compiled, h->meshes, sizeof(t_rtb_mesh));
+	scene->meshes = ft_calloc(h->meshes.count + 1, sizeof(t_mesh *));
+	if (!rec || !scene->meshes)
+		return (0);
+	scene->mesh_cap = h->meshes.count;
+	while (scene->mesh_count < h->meshes.count)
+	{
+		m = ft_calloc(1, sizeof(t_mesh));
+		if (!m)
+			return (0);
+		scene->meshes[scene->mesh_count] = m;
+		m->id = scene->mesh_count;
+		m->vertices = rtb_section_ptr(&scene->compiled, rec->vertices,
+				sizeof(t_vertex));
+		m->indices = rtb_section_ptr(&scene->compiled, rec->indices, 4);
+		m->bvh.nodes = rtb_section_ptr(&scene->compiled, rec->nodes,
+				sizeof(t_bvh_node));
+		m->bvh.prims = rtb_section_ptr(&scene->compiled, rec->prims, 4);
+		m->vertex_count = rec->vertices.count;
+		m->tri_count = rec->indices.count / 3;
+		m->bvh.node_count = rec->nodes.count;
+		m->bvh.prim_count = rec->prims.count;
+		m->bvh.mapped = 1;
+		scene->mesh_count++;
+		if (!m->vertices || !m->indices || !m->bvh.nodes || !m->bvh.prims
+			|| rec++->indices.count % 3 != 0)
+			return (0);
+	}
+	return (1);
+}
+
+/*
+** Restores the pointers of the objects listed in the fix-up section; all
+** other objects are used as mapped.
+*/
+static int	apply_fixups(t_scene *scene, t_rtb_header *h, size_t obj_count)
+{
+	t_rtb_fixup	*fix;
+	char		*strings;
+	size_t		i;
+
+	fix = rtb_section_ptr(&scene->compiled, h->fixups, sizeof(t_rtb_fixup));
+	strings = rtb_section_ptr(&scene->compiled, h->strings, 1);
+	if (!fix || !strings)
+		return (0);
+	i = 0;
+	while (i < h->fixups.count)
+	{
+		if (fix[i].object >= obj_count || (fix[i].mesh != UINT32_MAX
+				&& fix[i].mesh >= scene->mesh_count)
+			|| (fix[i].texture != UINT64_MAX && (fix[i].texture
+					>= h->strings.count || !ft_memchr(strings + fix[i].texture,
+						'\0', h->strings.count - fix[i].texture))))
+			return (0);
+		if (fix[i].mesh != UINT32_MAX)
+			scene->objects[fix[i].object].mesh.data
+				= scene->meshes[fix[i].mesh];
+		if (fix[i].texture != UINT64_MAX)
+			scene->objects[fix[i].object].texture
+				= load_texture(strings + fix[i].texture);
+		i++;
+	}
+	return (1);
+}
+
+/*
+** Maps a scene written by compile_scene. Everything but the mesh structs
+** and textures is used in place, and the hierarchies come prebuilt; only
+** their 4-wide traversal form is derived here. The mapping is private and
+** writable for the fix-ups; it stays alive until cleanup.
+*/
+int	load_compiled_scene(t_scene *scene, char *path)
+{
+	t_rtb_header	*h;
+	t_mapped_file	*f;
+
+	f = &scene->compiled;
+	if (!map_file(path, f, 1))
+		return (ft_putstr_fd("Error: Could not open file\n", 2), 0);
+	if (!valid_header(f))
+		return (ft_putstr_fd("Error: Not a scene compiled by this build\n",
+				2), 0);
+	h = (t_rtb_header *)f->data;
+	scene->camera = h->camera;
+	scene->ambient = h->ambient;
+	scene->checkerboard = h->checkerboard;
+	scene->accel = h->accel;
+	scene->lights = rtb_section_ptr(f, h->lights, sizeof(t_light));
+	scene->objects = rtb_section_ptr(f, h->objects, sizeof(t_object));
+	scene->bvh.nodes = rtb_section_ptr(f, h->nodes, sizeof(t_bvh_node));
+	scene->bvh.prims = rtb_section_ptr(f, h->prims, 4);
+	scene->bvh.unbounded = rtb_section_ptr(f, h->unbounded, 4);
+	scene->bvh.node_count = h->nodes.count;
+	scene->bvh.prim_count = h->prims.count;
+	scene->bvh.unbounded_count = h->unbounded.count;
+	scene->bvh.mapped = 1;
+	if (!scene->lights || !scene->objects || !scene->bvh.nodes
+		|| !scene->bvh.prims || !scene->bvh.unbounded
+		|| !load_meshes(scene, h) || !apply_fixups(scene, h, h->objects.count))
+		return (ft_putstr_fd("Error: Corrupt compiled scene\n", 2), 0);
+	scene->light_count = h->lights.count;
+	scene->obj_count = h->objects.count;
+	if (!collapse_hierarchies(scene))
+		return (ft_putstr_fd("Error: Memory allocation failed\n", 2), 0);
+	return (1);
+}
@@ -0,0 +1,208 @@
+#include "../includes/minirt.h"
+
+/*
+** .rtb files hold a t_rtb_header followed by RTB_ALIGN-aligned sections:
+** lights, objects, pointer fix-ups, mesh records, the scene BVH, then the
+** vertices, indices and BVH of every mesh, and finally texture paths.
+** Everything is stored in its in-memory layout so the loader uses it
+** straight from the mapping.
+*/
+
+t_rtb_section	rtb_reserve(uint64_t *offset, size_t count, size_t elem)
+{
+	t_rtb_section	sec;
+
+	sec = (t_rtb_section){*offset, count};
+	*offset += count * elem;
+	*offset = (*offset + RTB_ALIGN - 1) / RTB_ALIGN * RTB_ALIGN;
+	return (sec);
+}
+
+/*
+** Mesh objects and textured objects are the only ones holding pointers.
+** Returns their count and the size of the texture path strings.
+*/
+static size_t	fill_fixups(t_scene *scene, t_rtb_fixup *fixups,
+		uint64_t *strings)
+{
+	size_t	n;
+	size_t	i;
+
+	n = 0;
+	*strings = 0;
+	i = 0;
+	while (i < scene->obj_count)
+	{
+		if (scene->objects[i].type == MESH || scene->objects[i].texture)
+		{
+			fixups[n] = (t_rtb_fixup){i, UINT32_MAX, UINT64_MAX};
+			if (scene->objects[i].type == MESH)
+				fixups[n].mesh = scene->objects[i].mesh.data->id;
+			if (scene->objects[i].texture)
+			{
+				fixups[n].texture = *strings;
+				*strings += ft_strlen(scene->objects[i].texture->path) + 1;
+			}
+			n++;
+		}
+		i++;
+	}
+	return (n);
+}
+
+static void	layout(t_scene *scene, t_rtb_header *h, t_rtb_mesh *meshes,
+		t_rtb_fixup *fixups)
+{
+	uint64_t	off;
+	uint64_t	strings;
+	t_mesh		*m;
+	size_t		i;
+
+	ft_bzero(h, sizeof(t_rtb_header));
+	ft_memcpy(h->magic, RTB_MAGIC, sizeof(h->magic));
+	h->version = RTB_VERSION;
+	h->byte_order = 0x01020304;
+	h->object_size = sizeof(t_object);
+	h->light_size = sizeof(t_light);
+	h->node_size = sizeof(t_bvh_node);
+	h->vector_size = sizeof(t_vector);
+	h->vertex_size = sizeof(t_vertex);
+	h->camera = scene->camera;
+	h->ambient = scene->ambient;
+	h->checkerboard = scene->checkerboard;
+	h->accel = scene->accel;
+	off = 0;
+	rtb_reserve(&off, 1, sizeof(t_rtb_header));
+	h->lights = rtb_reserve(&off, scene->light_count, sizeof(t_light));
+	h->objects = rtb_reserve(&off, scene->obj_count, sizeof(t_object));
+	h->fixups = rtb_reserve(&off, fill_fixups(scene, fixups, &strings),
+			sizeof(t_rtb_fixup));
+	h->meshes = rtb_reserve(&off, scene->mesh_count, sizeof(t_rtb_mesh));
+	h->nodes = rtb_reserve(&off, scene->bvh.node_count, sizeof(t_bvh_node));
+	h->prims = rtb_reserve(&off, scene->bvh.prim_count, sizeof(uint32_t));
+	h->unbounded = rtb_reserve(&off, scene->bvh.unbounded_count, sizeof(uint32_t));
+	i = 0;
+	while (i < scene->mesh_count)
+	{
+		m = scene->meshes[i];
+		meshes[i].vertices = rtb_reserve(&off, m->vertex_count, sizeof(t_vertex));
+		meshes[i].indices = rtb_reserve(&off, m->tri_count * 3, sizeof(uint32_t));
+		meshes[i].nodes = rtb_reserve(&off, m->bvh.node_count, sizeof(t_bvh_node));
+		meshes[i++].prims = rtb_reserve(&off, m->bvh.prim_count, sizeof(uint32_t));
+	}
+	h->strings = rtb_reserve(&off, strings, 1);
+}
+
+void	rtb_put(t_rtb_out *out, uint64_t offset, const void *data, size_t size)
+{
+	static const unsigned char	zero[RTB_ALIGN];
+	size_t						n;
+
+	while (out->pos < offset)
+	{
+		n = offset - out->pos;
+		if (n > RTB_ALIGN)
+			n = RTB_ALIGN;
+		writer_put(out->w, zero, n);
+		out->pos += n;
+	}
+	writer_put(out->w, data, size);
+	out->pos += size;
+}
+
+/*
+** Objects are written with their pointers cleared; the loader restores
+** them from the fix-up list.
+*/
+static void	put_objects(t_rtb_out *out, t_scene *scene, t_rtb_header *h)
+{
+	t_object	obj;
+	size_t		i;
+
+	i = 0;
+	while (i < scene->obj_count)
+	{
+		obj = scene->objects[i];
+		obj.texture = NULL;
+		if (obj.type == MESH)
+			obj.mesh.data = NULL;
+		rtb_put(out, h->objects.offset, &obj, sizeof(t_object));
+		i++;
+	}
+}
+
+static void	put_scene(t_rtb_out *out, t_scene *scene, t_rtb_header *h,
+		t_rtb_mesh *meshes, t_rtb_fixup *fixups)
+{
+	t_mesh	*m;
+	size_t	i;
+
+	rtb_put(out, 0, h, sizeof(t_rtb_header));
+	rtb_put(out, h->lights.offset, scene->lights,
+		h->lights.count * sizeof(t_light));
+	put_objects(out, scene, h);
+	rtb_put(out, h->fixups.offset, fixups, h->fixups.count * sizeof(t_rtb_fixup));
+	rtb_put(out, h->meshes.offset, meshes, h->meshes.count * sizeof(t_rtb_mesh));
+	rtb_put(out, h->nodes.offset, scene->bvh.nodes,
+		h->nodes.count * sizeof(t_bvh_node));
+	rtb_put(out, h->prims.offset, scene->bvh.prims, h->prims.count * 4);
+	rtb_put(out, h->unbounded.offset, scene->bvh.unbounded,
+		h->unbounded.count * 4);
+	i = 0;
+	while (i < scene->mesh_count)
+	{
+		m = scene->meshes[i];
+		rtb_put(out, meshes[i].vertices.offset, m->vertices,
+			m->vertex_count * sizeof(t_vertex));
+		rtb_put(out, meshes[i].indices.offset, m->indices, m->tri_count * 12);
+		rtb_put(out, meshes[i].nodes.offset, m->bvh.nodes,
+			m->bvh.node_count * sizeof(t_bvh_node));
+		rtb_put(out, meshes[i].prims.offset, m->bvh.prims, m->bvh.prim_count * 4);
+		i++;
+	}
+	i = 0;
+	while (i < scene->obj_count)
+	{
+		if (scene->objects[i].texture)
+			rtb_put(out, h->strings.offset, scene->objects[i].texture->path,
+				ft_strlen(scene->objects[i].texture->path) + 1);
+		i++;
+	}
+	rtb_put(out, h->strings.offset + h->strings.count, NULL, 0);
+}
+
+/*
+** Writes a parsed and built scene, hierarchies included, as .rtb.
+*/
+int	compile_scene(t_scene *scene, char *path)
+{
+	t_rtb_header	h;
+	t_rtb_mesh		*meshes;
+	t_rtb_fixup		*fixups;
+	t_rtb_out		out;
+	int				ok;
+
+	meshes = malloc(sizeof(t_rtb_mesh) * (scene->mesh_count + 1));
+	fixups = malloc(sizeof(t_rtb_fixup) * (scene->obj_count + 1));
+	out = (t_rtb_out){malloc(sizeof(t_writer)), 0};
+	ok = (meshes && fixups && out.w);
+	if (ok)
+	{
+		layout(scene, &h, meshes, fixups);
+		out.w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		out.w->ok = (out.w->fd >= 0);
+		out.w->len = 0;
+		out.w->crc = 0;
+		put_scene(&out, scene, &h, meshes, fixups);
+		writer_flush(out.w);
+		ok = out.w->ok;
+		if (out.w->fd >= 0 && close(out.w->fd) != 0)
+			ok = 0;
+	}
+	free(meshes);
+	free(fixups);
+	free(out.w);
+	if (!ok)
+		return (ft_putstr_fd("Error: Could not write compiled scene\n", 2), 0);
+	return (1);
+}
@@ -0,0 +1,189 @@
+#include "../includes/minirt.h"
+
+/*
+** MLX42 images store each pixel as R, G, B, A bytes.
+*/
+static void	blit_to_image(mlx_image_t *img, uint32_t *pixels, size_t count)
+{
+	size_t	i;
+
+	i = 0;
+	while (i < count)
+	{
+		img->pixels[i * 4] = pixels[i] >> 24;
+		img->pixels[i * 4 + 1] = pixels[i] >> 16;
+		img->pixels[i * 4 + 2] = pixels[i] >> 8;
+		img->pixels[i * 4 + 3] = pixels[i];
+		i++;
+	}
+}
+
+static void	translate_object(t_object *obj, t_vector d)
+{
+	if (obj->type == SPHERE)
+		obj->sphere.center = vec_add(obj->sphere.center, d);
+	else if (obj->type == PLANE)
+		obj->plane.point = vec_add(obj->plane.point, d);
+	else if (obj->type == CYLINDER)
+		obj->cylinder.center = vec_add(obj->cylinder.center, d);
+	else if (obj->type == CONE)
+		obj->cone.vertex = vec_add(obj->cone.vertex, d);
+	else if (obj->type == HYPERBOLOID)
+		obj->hyperboloid.center = vec_add(obj->hyperboloid.center, d);
+	else if (obj->type == TRIANGLE)
+	{
+		obj->triangle.v1 = vec_add(obj->triangle.v1, d);
+		obj->triangle.v2 = vec_add(obj->triangle.v2, d);
+		obj->triangle.v3 = vec_add(obj->triangle.v3, d);
+	}
+	else if (obj->type == MESH)
+	{
+		obj->mesh.xform.offset = vec_add(obj->mesh.xform.offset, d);
+		obj->mesh.xform.identity = 0;
+		instance_bounds(&obj->mesh);
+	}
+}
+
+/*
+** Moves the selected light or object. A moved object is refit into the
+** hierarchy, which starts a background rebuild once it has degraded too
+** far; grids are cheap enough to rebuild on the spot.
+*/
+static int	move_selected(t_editor *ed, t_vector d)
+{
+	t_scene	*scene;
+
+	scene = ed->scene;
+	ed->dirty = 1;
+	if (ed->lights)
+	{
+		scene->lights[ed->selected].pos = vec_add(
+				scene->lights[ed->selected].pos, d);
+		return (1);
+	}
+	translate_object(&scene->objects[ed->selected], d);
+	finalize_object(&scene->objects[ed->selected]);
+	prims_update(scene, ed->selected);
+	if (scene->accel == ACCEL_GRID)
+		return (build_grid(scene));
+	if (bvh_refit(&ed->refit, scene, ed->selected))
+		return (bvh_rebuild_start(&ed->rebuild, scene, ed->threads));
+	return (1);
+}
+
+static void	select_next(t_editor *ed, int lights)
+{
+	size_t	count;
+
+	count = ed->scene->obj_count;
+	if (lights)
+		count = ed->scene->light_count;
+	if (count == 0)
+		return ;
+	if (lights == ed->lights)
+		ed->selected = (ed->selected + 1) % count;
+	else
+		ed->selected = 0;
+	ed->lights = lights;
+	if (lights)
+		ft_putstr_fd("Selected light ", 1);
+	else
+		ft_putstr_fd("Selected object ", 1);
+	ft_putnbr_fd(ed->selected, 1);
+	ft_putchar_fd('\n', 1);
+}
+
+/*
+** Tab cycles through the objects and L through the lights; W/S, A/D and
+** Q/E move the selection along z, x and y.
+*/
+void	edit_key_hook(mlx_key_data_t data, void *param)
+{
+	t_editor	*ed;
+	t_vector	d;
+	int			ok;
+
+	ed = (t_editor *)param;
+	key_hook(data, ed->mlx);
+	if (data.action == MLX_RELEASE)
+		return ;
+	if (data.key == MLX_KEY_TAB || data.key == MLX_KEY_L)
+	{
+		select_next(ed, data.key == MLX_KEY_L);
+		return ;
+	}
+	d = (t_vector){(data.key == MLX_KEY_D) - (data.key == MLX_KEY_A),
+		(data.key == MLX_KEY_E) - (data.key == MLX_KEY_Q),
+		(data.key == MLX_KEY_W) - (data.key == MLX_KEY_S)};
+	if ((d.x == 0 && d.y == 0 && d.z == 0)
+		|| (ed->lights && ed->scene->light_count == 0)
+		|| (!ed->lights && ed->scene->obj_count == 0))
+		return ;
+	ok = move_selected(ed, vec_mul(d, ed->step));
+	if (!ok)
+	{
+		ft_putstr_fd("Error: Could not update the scene\n", 2);
+		mlx_close_window(ed->mlx);
+	}
+}
+
+/*
+** Swaps in finished rebuilds and renders at most one frame per loop, however
+** many edits came in since the last.
+*/
+void	edit_loop_hook(void *param)
+{
+	t_editor	*ed;
+
+	ed = (t_editor *)param;
+	if (bvh_rebuild_poll(&ed->rebuild, ed->scene, &ed->refit) < 0)
+	{
+		ft_putstr_fd("Error: Could not update the scene\n", 2);
+		mlx_close_window(ed->mlx);
+		return ;
+	}
+	if (!ed->dirty)
+		return ;
+	ed->dirty = 0;
+	if (render_frame(ed->scene, ed->pixels, ed->threads, ed->samples))
+		blit_to_image(ed->img, ed->pixels,
+			ed->scene->canvas.w * ed->scene->canvas.h);
+}
+
+/*
+** Renders the first frame into the window and prepares the hierarchy for
+** refits. One step moves the selection by EDIT_STEP of the scene size.
+*/
+int	editor_start(t_editor *ed, mlx_t *mlx, t_scene *scene, t_options *opts)
+{
+	t_aabb	box;
+
+	*ed = (t_editor){.mlx = mlx, .scene = scene, .threads = opts->threads,
+		.samples = opts->samples, .step = 1.0, .dirty = 1};
+	ed->img = mlx_new_image(mlx, scene->canvas.w, scene->canvas.h);
+	ed->pixels = malloc(sizeof(uint32_t) * scene->canvas.w * scene->canvas.h);
+	if (!ed->img || !ed->pixels || mlx_image_to_window(mlx, ed->img, 0, 0) < 0)
+		return (ft_putstr_fd("Error: Could not create image\n", 2), 0);
+	box = aabb_empty();
+	if (scene->accel == ACCEL_GRID && scene->grid.cell_count > 0)
+		box = scene->grid.bounds;
+	else if (scene->accel != ACCEL_GRID)
+	{
+		if (!bvh_refit_init(&ed->refit, scene))
+			return (ft_putstr_fd("Error: Memory allocation failed\n", 2), 0);
+		if (scene->bvh.node_count > 0)
+			box = scene->bvh.nodes[0].bounds;
+	}
+	if (box.min.x <= box.max.x)
+		ed->step = EDIT_STEP * vec_length(vec_sub(box.max, box.min));
+	edit_loop_hook(ed);
+	return (1);
+}
+
+void	editor_stop(t_editor *ed)
+{
+	bvh_rebuild_stop(&ed->rebuild);
+	bvh_refit_free(&ed->refit);
+	free(ed->pixels);
+	ed->pixels = NULL;
+}
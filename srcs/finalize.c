@@ -0,0 +1,93 @@
+#include "../includes/minirt.h"
+
+/*
+** Frame of a quadric with its anchor at the origin and `axis` along z.
+** The other two axes only matter for hyperboloids, whose semi-axes a and
+** b are taken along them; a z axis gives back the world axes.
+*/
+static t_xform	axis_frame(t_vector origin, t_vector axis)
+{
+	t_xform		frame;
+	t_vector	x;
+
+	if (fabs(axis.y) > 0.9)
+		x = vec_normalize(vec_cross(axis, (t_vector){1, 0, 0}));
+	else
+		x = vec_normalize(vec_cross((t_vector){0, 1, 0}, axis));
+	frame.inv[0] = x;
+	frame.inv[1] = vec_cross(axis, x);
+	frame.inv[2] = axis;
+	frame.offset = origin;
+	frame.scale = 1;
+	frame.identity = 0;
+	return (frame);
+}
+
+static void	finalize_cylinder(t_cylinder *cy)
+{
+	cy->top = vec_add(cy->center, vec_mul(cy->axis, cy->height));
+	cy->quadric = (t_quadric){axis_frame(cy->center, cy->axis),
+		{1, 1, 0, -cy->radius * cy->radius}, {0, cy->height},
+		{0, cy->height}, INFINITY};
+}
+
+/*
+** A cone opening past a right angle has a negative base radius and, as
+** the cap test used to reject every hit on it, no cap.
+*/
+static void	finalize_cone(t_cone *cn)
+{
+	double	t;
+
+	t = tan(cn->angle);
+	cn->cos2 = cos(cn->angle) * cos(cn->angle);
+	cn->slope2 = 1 + t * t;
+	cn->base = vec_add(cn->vertex, vec_mul(cn->axis, cn->height));
+	cn->base_radius = cn->height * t;
+	cn->quadric = (t_quadric){axis_frame(cn->vertex, cn->axis),
+		{cn->cos2, cn->cos2, cn->cos2 - 1, 0}, {0, cn->height},
+		{INFINITY, cn->height}, INFINITY};
+	if (cn->base_radius < 0)
+		cn->quadric.cap[1] = INFINITY;
+}
+
+static void	finalize_hyperboloid(t_hyperboloid *hy)
+{
+	hy->inv2 = (t_vector){1.0 / (hy->a * hy->a), 1.0 / (hy->b * hy->b),
+		1.0 / (hy->c * hy->c)};
+	hy->quadric = (t_quadric){axis_frame(hy->center, hy->axis),
+		{hy->inv2.x, hy->inv2.y, -hy->inv2.z, -1}, {-INFINITY, INFINITY},
+		{INFINITY, INFINITY}, hy->height * hy->height};
+}
+
+/*
+** Derives the constants the kernels and normals would otherwise recompute
+** for every ray or hit from the parsed parameters. Runs once the scene is
+** read and again for every object the editor moves.
+*/
+void	finalize_object(t_object *obj)
+{
+	if (obj->type == CYLINDER)
+		finalize_cylinder(&obj->cylinder);
+	else if (obj->type == CONE)
+		finalize_cone(&obj->cone);
+	else if (obj->type == HYPERBOLOID)
+		finalize_hyperboloid(&obj->hyperboloid);
+	else if (obj->type == TRIANGLE)
+	{
+		obj->triangle.edge1 = vec_sub(obj->triangle.v2, obj->triangle.v1);
+		obj->triangle.edge2 = vec_sub(obj->triangle.v3, obj->triangle.v1);
+	}
+}
+
+/*
+** Compiled scenes store their objects finalized and skip this.
+*/
+void	finalize_scene(t_scene *scene)
+{
+	size_t	i;
+
+	i = 0;
+	while (i < scene->obj_count)
+		finalize_object(&scene->objects[i++]);
+}
@@ -0,0 +1,222 @@
+#include "../includes/minirt.h"
+
+static int	clamp_cell(double v, int res)
+{
+	if (!(v > 0.0))
+		return (0);
+	if (v >= res)
+		return (res - 1);
+	return ((int)v);
+}
+
+/*
+** Sizes the cells so that there are about GRID_DENSITY cells per object,
+** as close to cubes as the bounds allow. Flat bounds get a sliver of
+** thickness so every axis has a non-zero cell size.
+*/
+static void	grid_resolution(t_grid *g, size_t count)
+{
+	double	ext[3];
+	double	k;
+	int		a;
+
+	g->bounds.max = vec_add(g->bounds.max, (t_vector){EPSILON, EPSILON,
+			EPSILON});
+	g->bounds.min = vec_sub(g->bounds.min, (t_vector){EPSILON, EPSILON,
+			EPSILON});
+	a = -1;
+	while (++a < 3)
+		ext[a] = vec_axis(g->bounds.max, a) - vec_axis(g->bounds.min, a);
+	k = cbrt(GRID_DENSITY * count / (ext[0] * ext[1] * ext[2]));
+	a = -1;
+	while (++a < 3)
+		g->res[a] = clamp_cell(ext[a] * k, GRID_MAX_RES) + 1;
+	while ((size_t)g->res[0] * g->res[1] * g->res[2] > GRID_MAX_CELLS)
+	{
+		a = (g->res[1] > g->res[0]);
+		if (g->res[2] > g->res[a])
+			a = 2;
+		g->res[a] = (g->res[a] + 1) / 2;
+	}
+	a = -1;
+	while (++a < 3)
+	{
+		g->size[a] = ext[a] / g->res[a];
+		g->inv[a] = g->res[a] / ext[a];
+	}
+	g->cell_count = (size_t)g->res[0] * g->res[1] * g->res[2];
+}
+
+static int	cell_of(t_grid *g, t_vector p, int a)
+{
+	return (clamp_cell((vec_axis(p, a) - vec_axis(g->bounds.min, a))
+			* g->inv[a], g->res[a]));
+}
+
+/*
+** Counts `id` in every cell its box overlaps or, once `fill` holds the
+** cell offsets, stores it there.
+*/
+static void	add_box(t_grid *g, t_aabb *box, uint32_t id, uint32_t *fill)
+{
+	int		lo[3];
+	int		hi[3];
+	int		c[3];
+	size_t	cell;
+
+	c[0] = -1;
+	while (++c[0] < 3)
+	{
+		lo[c[0]] = cell_of(g, box->min, c[0]);
+		hi[c[0]] = cell_of(g, box->max, c[0]);
+	}
+	c[2] = lo[2] - 1;
+	while (++c[2] <= hi[2])
+	{
+		c[1] = lo[1] - 1;
+		while (++c[1] <= hi[1])
+		{
+			c[0] = lo[0] - 1;
+			while (++c[0] <= hi[0])
+			{
+				cell = ((size_t)c[2] * g->res[1] + c[1]) * g->res[0] + c[0];
+				if (fill)
+					g->prims[fill[cell]++] = id;
+				else
+					g->cells[cell + 1]++;
+			}
+		}
+	}
+}
+
+static int	fill_grid(t_grid *g, t_aabb *boxes, uint32_t *ids, size_t count)
+{
+	uint32_t	*fill;
+	size_t		i;
+
+	g->cells = ft_calloc(g->cell_count + 1, sizeof(uint32_t));
+	if (!g->cells)
+		return (0);
+	i = 0;
+	while (i < count)
+		add_box(g, &boxes[i++], 0, NULL);
+	i = 0;
+	while (i++ < g->cell_count)
+		g->cells[i] += g->cells[i - 1];
+	g->prims = malloc(sizeof(uint32_t) * (g->cells[g->cell_count] + 1));
+	fill = malloc(sizeof(uint32_t) * (g->cell_count + 1));
+	if (!g->prims || !fill)
+		return (free(fill), 0);
+	ft_memcpy(fill, g->cells, sizeof(uint32_t) * g->cell_count);
+	i = 0;
+	while (i < count)
+	{
+		add_box(g, &boxes[i], ids[i], fill);
+		i++;
+	}
+	free(fill);
+	return (1);
+}
+
+/*
+** Builds the grid over the bounded objects listed in scene->bvh.prims,
+** which the scene keeps in grid mode instead of a tree. Cheap enough to
+** redo on every load, so it is never stored in a .rtb file or the cache.
+*/
+int	build_grid(t_scene *scene)
+{
+	t_grid		*g;
+	t_aabb		*boxes;
+	size_t		i;
+	int			ok;
+
+	g = &scene->grid;
+	free_grid(g);
+	boxes = malloc(sizeof(t_aabb) * (scene->bvh.prim_count + 1));
+	if (!boxes)
+		return (0);
+	g->bounds = aabb_empty();
+	i = 0;
+	while (i < scene->bvh.prim_count)
+	{
+		object_bounds(scene->objects[scene->bvh.prims[i]], &boxes[i]);
+		g->bounds = aabb_union(g->bounds, boxes[i++]);
+	}
+	ok = 1;
+	if (scene->bvh.prim_count > 0)
+	{
+		grid_resolution(g, scene->bvh.prim_count);
+		ok = fill_grid(g, boxes, scene->bvh.prims, scene->bvh.prim_count);
+	}
+	free(boxes);
+	return (ok);
+}
+
+static size_t	centroid_cell(t_grid *g, t_aabb *box)
+{
+	t_vector	c;
+
+	c = aabb_centroid(*box);
+	return (((size_t)cell_of(g, c, 2) * g->res[1] + cell_of(g, c, 1))
+		* g->res[0] + cell_of(g, c, 0));
+}
+
+static double	aabb_volume(t_aabb box)
+{
+	t_vector	d;
+
+	d = vec_sub(box.max, box.min);
+	return (d.x * d.y * d.z);
+}
+
+/*
+** A grid pays off over a tree for many objects of about the same size
+** packed densely and evenly, so that rays stop after a few cells: no box
+** may have over GRID_AUTO_SPREAD times the mean surface area, the boxes
+** must add up to GRID_AUTO_COVER of the scene volume, and the centroids
+** must fall in at least GRID_AUTO_FILL of the cells they could fill.
+*/
+int	grid_preferred(t_aabb *boxes, size_t count)
+{
+	t_grid		g;
+	char		*used;
+	double		stat[3];
+	size_t		filled;
+	size_t		i;
+
+	if (count < GRID_AUTO_MIN)
+		return (0);
+	g.bounds = aabb_empty();
+	ft_bzero(stat, sizeof(stat));
+	i = 0;
+	while (i < count)
+	{
+		g.bounds = aabb_union(g.bounds, boxes[i]);
+		stat[0] += aabb_area(boxes[i]) / count;
+		stat[1] = fmax(stat[1], aabb_area(boxes[i]));
+		stat[2] += aabb_volume(boxes[i++]);
+	}
+	if (stat[1] > GRID_AUTO_SPREAD * stat[0]
+		|| stat[2] < GRID_AUTO_COVER * aabb_volume(g.bounds))
+		return (0);
+	grid_resolution(&g, count);
+	used = ft_calloc(g.cell_count, 1);
+	if (!used)
+		return (0);
+	filled = 0;
+	i = 0;
+	while (i < count)
+	{
+		filled += !used[centroid_cell(&g, &boxes[i])];
+		used[centroid_cell(&g, &boxes[i++])] = 1;
+	}
+	free(used);
+	return (filled >= GRID_AUTO_FILL * fmin(g.cell_count, count));
+}
+
+void	free_grid(t_grid *g)
+{
+	free(g->cells);
+	free(g->prims);
+	*g = (t_grid){0};
+}
@@ -0,0 +1,191 @@
+#include "../includes/minirt.h"
+
+static void	axes(t_vector v, double out[3])
+{
+	out[0] = v.x;
+	out[1] = v.y;
+	out[2] = v.z;
+}
+
+/*
+** Clips the ray, given as origin `o` and direction `d`, to the grid bounds
+** and returns the distance at which it enters them, or -1 when it misses
+** them before ray->t.
+*/
+static double	enter_distance(t_grid *g, t_ray *ray, double o[3], double d[3])
+{
+	double	lo[3];
+	double	hi[3];
+	double	t[2];
+	double	tmp;
+	int		a;
+
+	axes(g->bounds.min, lo);
+	axes(g->bounds.max, hi);
+	t[0] = 0.0;
+	t[1] = ray->t;
+	a = -1;
+	while (++a < 3)
+	{
+		lo[a] = (lo[a] - o[a]) / d[a];
+		hi[a] = (hi[a] - o[a]) / d[a];
+		if (lo[a] > hi[a])
+		{
+			tmp = lo[a];
+			lo[a] = hi[a];
+			hi[a] = tmp;
+		}
+		if (lo[a] > t[0])
+			t[0] = lo[a];
+		if (hi[a] < t[1])
+			t[1] = hi[a];
+	}
+	if (!(t[0] <= t[1]))
+		return (-1.0);
+	return (t[0]);
+}
+
+/*
+** Starts the walk in the cell holding the entry point; per axis `next` is
+** the distance to the first wall crossed and `delta` the distance between
+** walls. Axes the ray is parallel to are never stepped along.
+*/
+static int	grid_enter(t_grid *g, t_ray *ray, t_grid_walk *w)
+{
+	double	o[3];
+	double	d[3];
+	double	lo[3];
+	double	t;
+	int		a;
+
+	axes(ray->origin, o);
+	axes(ray->direction, d);
+	axes(g->bounds.min, lo);
+	t = enter_distance(g, ray, o, d);
+	if (t < 0.0)
+		return (0);
+	a = -1;
+	while (++a < 3)
+	{
+		w->cell[a] = (int)((o[a] + d[a] * t - lo[a]) * g->inv[a]);
+		if (w->cell[a] < 0)
+			w->cell[a] = 0;
+		if (w->cell[a] >= g->res[a])
+			w->cell[a] = g->res[a] - 1;
+		w->step[a] = (d[a] > 0.0) - (d[a] < 0.0);
+		w->skip[a] = w->step[a];
+		if (a > 0)
+			w->skip[a] *= g->res[0];
+		if (a > 1)
+			w->skip[a] *= g->res[1];
+		w->next[a] = INFINITY;
+		w->delta[a] = INFINITY;
+		if (w->step[a] == 0)
+			continue ;
+		w->next[a] = (lo[a] + (w->cell[a] + (d[a] > 0.0)) * g->size[a] - o[a])
+			/ d[a];
+		w->delta[a] = g->size[a] / fabs(d[a]);
+	}
+	w->index = ((size_t)w->cell[2] * g->res[1] + w->cell[1]) * g->res[0]
+		+ w->cell[0];
+	return (1);
+}
+
+/*
+** Hands the objects of one cell to the leaf callback, skipping those in
+** the mailbox. Returns the callback results or-ed together; an any-hit
+** walk stops at the first 1.
+*/
+static int	visit_cell(t_grid *g, t_grid_visit *v, t_ray *ray, size_t cell)
+{
+	uint32_t	i;
+	uint32_t	id;
+	int			n;
+	int			k;
+	int			hit;
+
+	hit = 0;
+	n = 0;
+	i = g->cells[cell];
+	while (i < g->cells[cell + 1] && !(hit && v->any))
+	{
+		id = g->prims[i++];
+		k = 0;
+		while (k < GRID_MAILBOX && v->recent[k] != id)
+			k++;
+		if (k < GRID_MAILBOX)
+			continue ;
+		v->recent[v->next] = id;
+		v->next = (v->next + 1) % GRID_MAILBOX;
+		v->batch[n++] = id;
+		if (n == GRID_BATCH)
+			hit |= v->leaf(v->ctx, ray, v->batch, n);
+		if (n == GRID_BATCH)
+			n = 0;
+	}
+	if (n > 0 && !(hit && v->any))
+		hit |= v->leaf(v->ctx, ray, v->batch, n);
+	return (hit);
+}
+
+/*
+** Amanatides-Woo walk through the cells the ray crosses, in order. A hit
+** inside the current cell ends it, since no later cell can hold a closer
+** one; objects reaching into later cells may still report hits beyond the
+** cell, which only shrinks ray->t until the walk gets there.
+*/
+static int	walk(t_grid *g, t_ray *ray, t_grid_visit *v)
+{
+	t_grid_walk	w;
+	int			hit;
+	int			a;
+
+	if (g->cell_count == 0 || !grid_enter(g, ray, &w))
+		return (0);
+	ft_memset(v->recent, 0xff, sizeof(v->recent));
+	v->next = 0;
+	hit = 0;
+	while (1)
+	{
+		if (g->cells[w.index] < g->cells[w.index + 1])
+			hit |= visit_cell(g, v, ray, w.index);
+		if (hit && v->any)
+			return (1);
+		a = (w.next[1] < w.next[0]);
+		if (w.next[2] < w.next[a])
+			a = 2;
+		if (ray->t <= w.next[a])
+			return (hit);
+		w.cell[a] += w.step[a];
+		if (w.cell[a] < 0 || w.cell[a] >= g->res[a])
+			return (hit);
+		w.index += w.skip[a];
+		w.next[a] += w.delta[a];
+	}
+}
+
+/*
+** Nearest-hit query with the same contract as bvh_intersect.
+*/
+int	grid_intersect(t_grid *g, t_ray *ray, t_leaf_fn leaf, void *ctx)
+{
+	t_grid_visit	v;
+
+	v.leaf = leaf;
+	v.ctx = ctx;
+	v.any = 0;
+	return (walk(g, ray, &v));
+}
+
+/*
+** Any-hit query with the same contract as bvh_occluded.
+*/
+int	grid_occluded(t_grid *g, t_ray *ray, t_leaf_fn leaf, void *ctx)
+{
+	t_grid_visit	v;
+
+	v.leaf = leaf;
+	v.ctx = ctx;
+	v.any = 1;
+	return (walk(g, ray, &v));
+}
@@ -0,0 +1,107 @@
+#include "../includes/minirt.h"
+
+static t_vector	frame_point(t_xform *frame, t_vector p)
+{
+	p = vec_sub(p, frame->offset);
+	return ((t_vector){vec_dot(frame->inv[0], p), vec_dot(frame->inv[1], p),
+		vec_dot(frame->inv[2], p)});
+}
+
+static void	hit_local(t_hit *hit)
+{
+	t_object	*obj;
+
+	obj = hit->obj;
+	if (obj->type == SPHERE)
+		hit->local = vec_normalize(vec_sub(hit->point, obj->sphere.center));
+	else if (obj->type == PLANE)
+		hit->local = vec_sub(hit->point, obj->plane.point);
+	else if (obj->type == CYLINDER)
+	{
+		hit->local = vec_sub(hit->point, obj->cylinder.center);
+		hit->height = vec_dot(hit->local, obj->cylinder.axis);
+		hit->radial = vec_sub(hit->local,
+				vec_mul(obj->cylinder.axis, hit->height));
+	}
+	else if (obj->type == CONE)
+	{
+		hit->local = vec_sub(hit->point, obj->cone.vertex);
+		hit->height = vec_dot(hit->local, obj->cone.axis);
+		hit->radial = vec_sub(hit->local,
+				vec_mul(obj->cone.axis, hit->height));
+	}
+	else if (obj->type == HYPERBOLOID)
+		hit->local = frame_point(&obj->hyperboloid.quadric.frame,
+				hit->point);
+}
+
+/*
+** Caps are told apart by the part the kernel reported, not by where the
+** point lies.
+*/
+static t_vector	hit_normal(t_hit *hit)
+{
+	t_object	*obj;
+
+	obj = hit->obj;
+	if (obj->type == SPHERE)
+		return (hit->local);
+	if (obj->type == PLANE)
+		return (obj->plane.normal);
+	if (obj->type == CYLINDER && hit->prim == PART_NEAR_CAP)
+		return (vec_mul(obj->cylinder.axis, -1));
+	if (obj->type == CYLINDER && hit->prim == PART_FAR_CAP)
+		return (obj->cylinder.axis);
+	if (obj->type == CYLINDER)
+		return (vec_normalize(hit->radial));
+	if (obj->type == CONE && hit->prim == PART_FAR_CAP)
+		return (obj->cone.axis);
+	if (obj->type == CONE)
+		return (vec_normalize(vec_sub(hit->local, vec_mul(vec_mul(
+							obj->cone.axis, hit->height), obj->cone.slope2))));
+	if (obj->type == HYPERBOLOID)
+		return (instance_normal(&obj->hyperboloid.quadric.frame,
+				hyperboloid_normal(hit->local, &obj->hyperboloid)));
+	if (obj->type == TRIANGLE)
+		return (triangle_normal(obj->triangle));
+	if (obj->type == MESH)
+		return (mesh_normal(&obj->mesh, hit->prim));
+	return ((t_vector){0, 0, 0});
+}
+
+/*
+** Fills the hit record of a ray that hit object `index`: the point, its
+** local coordinates, then the normal and texture coordinates from them,
+** each computed once.
+*/
+void	hit_record(t_hit *hit, t_scene *scene, t_ray *ray, int index)
+{
+	hit->obj = &scene->objects[index];
+	hit->point = ray_at(*ray, ray->t);
+	hit->prim = ray->prim;
+	hit_local(hit);
+	hit->normal = hit_normal(hit);
+	hit->u = 0;
+	hit->v = 0;
+	if (hit->obj->texture)
+		calculate_uv(hit);
+	if (hit->obj->texture && hit->obj->texture->has_bump_map)
+		hit->normal = bump_map_normal(hit->obj->texture, hit->normal,
+				hit->u, hit->v);
+}
+
+/*
+** Origin of a ray leaving the surface at `point` on the side of `normal`.
+** Hits carry the rounding error of the precision meshes are intersected
+** in, which grows with the size of the coordinates, so the offset is
+** RAY_OFFSET_ULPS of that precision at the point's magnitude, and EPSILON
+** near the origin.
+*/
+t_vector	offset_origin(t_vector point, t_vector normal)
+{
+	double	scale;
+
+	scale = fmax(fabs(point.x), fmax(fabs(point.y), fabs(point.z)));
+	scale = fmax(EPSILON, scale * RAY_OFFSET_ULPS * REAL_EPSILON);
+	return (vec_add(point, vec_mul(normal, scale)));
+}
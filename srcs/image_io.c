@@ -0,0 +1,275 @@
+#include "../includes/minirt.h"
+
+void	writer_flush(t_writer *w)
+{
+	size_t	done;
+	ssize_t	n;
+
+	done = 0;
+	while (w->ok && done < w->len)
+	{
+		n = write(w->fd, w->buf + done, w->len - done);
+		if (n <= 0)
+			w->ok = 0;
+		else
+			done += n;
+	}
+	w->len = 0;
+}
+
+static uint32_t	crc_update(uint32_t crc, const unsigned char *data, size_t len)
+{
+	static uint32_t	table[256];
+	uint32_t		c;
+	size_t			i;
+	int				k;
+
+	if (table[1] == 0)
+	{
+		i = 0;
+		while (i < 256)
+		{
+			c = i;
+			k = 0;
+			while (k++ < 8)
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			table[i++] = c;
+		}
+	}
+	i = 0;
+	while (i < len)
+		crc = table[(crc ^ data[i++]) & 0xFF] ^ (crc >> 8);
+	return (crc);
+}
+
+void	writer_put(t_writer *w, const void *data, size_t len)
+{
+	const unsigned char	*bytes;
+	size_t				chunk;
+
+	bytes = data;
+	w->crc = crc_update(w->crc, bytes, len);
+	while (len > 0)
+	{
+		if (w->len == sizeof(w->buf))
+			writer_flush(w);
+		chunk = sizeof(w->buf) - w->len;
+		if (chunk > len)
+			chunk = len;
+		ft_memcpy(w->buf + w->len, bytes, chunk);
+		w->len += chunk;
+		bytes += chunk;
+		len -= chunk;
+	}
+}
+
+static void	writer_put_u32(t_writer *w, uint32_t v)
+{
+	unsigned char	be[4];
+
+	be[0] = v >> 24;
+	be[1] = v >> 16;
+	be[2] = v >> 8;
+	be[3] = v;
+	writer_put(w, be, 4);
+}
+
+static int	put_decimal(t_writer *w, size_t n, char *suffix)
+{
+	char	*num;
+
+	num = ft_itoa(n);
+	if (!num)
+		return (0);
+	writer_put(w, num, ft_strlen(num));
+	writer_put(w, suffix, ft_strlen(suffix));
+	free(num);
+	return (1);
+}
+
+static void	pack_rgb_row(unsigned char *row, uint32_t *pixels, size_t width)
+{
+	size_t	x;
+
+	x = 0;
+	while (x < width)
+	{
+		row[3 * x] = pixels[x] >> 24;
+		row[3 * x + 1] = pixels[x] >> 16;
+		row[3 * x + 2] = pixels[x] >> 8;
+		x++;
+	}
+}
+
+static int	write_ppm(t_writer *w, uint32_t *pixels, size_t width, size_t height)
+{
+	unsigned char	*row;
+	size_t			y;
+
+	row = malloc(3 * width + 1);
+	if (!row)
+		return (0);
+	writer_put(w, "P6\n", 3);
+	if (!put_decimal(w, width, " ") || !put_decimal(w, height, "\n255\n"))
+		return (free(row), 0);
+	y = 0;
+	while (y < height)
+	{
+		pack_rgb_row(row, pixels + y * width, width);
+		writer_put(w, row, 3 * width);
+		y++;
+	}
+	free(row);
+	return (1);
+}
+
+static uint32_t	adler_update(uint32_t adler, const unsigned char *data,
+		size_t len)
+{
+	uint32_t	a;
+	uint32_t	b;
+	size_t		i;
+
+	a = adler & 0xFFFF;
+	b = adler >> 16;
+	i = 0;
+	while (i < len)
+	{
+		a += data[i];
+		b += a;
+		if (++i % 5552 == 0)
+		{
+			a %= 65521;
+			b %= 65521;
+		}
+	}
+	return (((b % 65521) << 16) | (a % 65521));
+}
+
+/*
+** Feeds raw bytes into a zlib stream made of stored (uncompressed) deflate
+** blocks, opening a new block header whenever the current one is full.
+*/
+static void	zlib_put(t_writer *w, t_zlib_stored *z, const unsigned char *data,
+		size_t len)
+{
+	unsigned char	header[5];
+	size_t			n;
+
+	z->adler = adler_update(z->adler, data, len);
+	while (len > 0)
+	{
+		if (z->block_left == 0)
+		{
+			z->block_left = z->remaining;
+			if (z->block_left > 65535)
+				z->block_left = 65535;
+			header[0] = (z->block_left == z->remaining);
+			header[1] = z->block_left & 0xFF;
+			header[2] = z->block_left >> 8;
+			header[3] = ~header[1];
+			header[4] = ~header[2];
+			writer_put(w, header, 5);
+		}
+		n = z->block_left;
+		if (n > len)
+			n = len;
+		writer_put(w, data, n);
+		z->block_left -= n;
+		z->remaining -= n;
+		data += n;
+		len -= n;
+	}
+}
+
+static void	write_chunk_header(t_writer *w, uint32_t length, char *type)
+{
+	writer_put_u32(w, length);
+	w->crc = 0xFFFFFFFFu;
+	writer_put(w, type, 4);
+}
+
+/*
+** 8-bit RGB, one filter-type-0 scanline per row, deflated as stored
+** blocks: rendering dominates batch jobs, not the size of the output.
+*/
+static int	write_png(t_writer *w, uint32_t *pixels, size_t width, size_t height)
+{
+	t_zlib_stored	z;
+	unsigned char	*row;
+	size_t			y;
+
+	row = malloc(1 + 3 * width);
+	if (!row)
+		return (0);
+	writer_put(w, "\x89PNG\r\n\x1a\n", 8);
+	write_chunk_header(w, 13, "IHDR");
+	writer_put_u32(w, width);
+	writer_put_u32(w, height);
+	writer_put(w, "\x08\x02\x00\x00\x00", 5);
+	writer_put_u32(w, w->crc ^ 0xFFFFFFFFu);
+	z = (t_zlib_stored){(1 + 3 * width) * height, 0, 1};
+	write_chunk_header(w, 2 + z.remaining + 5 * ((z.remaining + 65534) / 65535)
+		+ 4, "IDAT");
+	writer_put(w, "\x78\x01", 2);
+	row[0] = 0;
+	y = 0;
+	while (y < height)
+	{
+		pack_rgb_row(row + 1, pixels + y * width, width);
+		zlib_put(w, &z, row, 1 + 3 * width);
+		y++;
+	}
+	free(row);
+	writer_put_u32(w, z.adler);
+	writer_put_u32(w, w->crc ^ 0xFFFFFFFFu);
+	write_chunk_header(w, 0, "IEND");
+	writer_put_u32(w, w->crc ^ 0xFFFFFFFFu);
+	return (1);
+}
+
+int	image_format(char *path)
+{
+	char	*ext;
+
+	ext = ft_strrchr(path, '.');
+	if (ext && (!ft_strcmp(ext, ".png") || !ft_strcmp(ext, ".PNG")))
+		return (IMAGE_PNG);
+	if (ext && (!ft_strcmp(ext, ".ppm") || !ft_strcmp(ext, ".PPM")))
+		return (IMAGE_PPM);
+	return (IMAGE_NONE);
+}
+
+/*
+** Writes the framebuffer as binary PPM or PNG, picked from the extension
+** of `path`.
+*/
+int	write_image(char *path, uint32_t *pixels, size_t width, size_t height)
+{
+	t_writer	*w;
+	int			ok;
+
+	w = malloc(sizeof(t_writer));
+	if (!w)
+		return (ft_putstr_fd("Error: Memory allocation failed\n", 2), 0);
+	w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	w->len = 0;
+	w->crc = 0;
+	w->ok = (w->fd >= 0);
+	ok = 0;
+	if (w->ok && image_format(path) == IMAGE_PNG)
+		ok = write_png(w, pixels, width, height);
+	else if (w->ok)
+		ok = write_ppm(w, pixels, width, height);
+	writer_flush(w);
+	ok = ok && w->ok;
+	if (w->fd >= 0 && close(w->fd) != 0)
+		ok = 0;
+	free(w);
+	if (!ok)
+	{
+		ft_putstr_fd("Error: Could not write image: ", 2);
+		ft_putendl_fd(path, 2);
+	}
+	return (ok);
+}
@@ -0,0 +1,132 @@
+#include "../includes/minirt.h"
+
+static t_vector	rotate(t_vector v, t_vector c, t_vector s)
+{
+	v = (t_vector){v.x, v.y * c.x - v.z * s.x, v.y * s.x + v.z * c.x};
+	v = (t_vector){v.x * c.y + v.z * s.y, v.y, -v.x * s.y + v.z * c.y};
+	return ((t_vector){v.x * c.z - v.y * s.z, v.x * s.z + v.y * c.z, v.z});
+}
+
+/*
+** The `mesh` directive transform: uniform scale, then rotation about X, Y
+** and Z (degrees), then translation. The inverse of scale times rotation R
+** is R transposed over the scale, whose rows are the rotated axes.
+*/
+t_xform	instance_xform(t_vector position, double scale, t_vector rotation)
+{
+	t_xform		x;
+	t_vector	c;
+	t_vector	s;
+
+	rotation = vec_mul(rotation, M_PI / 180.0);
+	c = (t_vector){cos(rotation.x), cos(rotation.y), cos(rotation.z)};
+	s = (t_vector){sin(rotation.x), sin(rotation.y), sin(rotation.z)};
+	x.inv[0] = vec_div(rotate((t_vector){1, 0, 0}, c, s), scale);
+	x.inv[1] = vec_div(rotate((t_vector){0, 1, 0}, c, s), scale);
+	x.inv[2] = vec_div(rotate((t_vector){0, 0, 1}, c, s), scale);
+	x.offset = position;
+	x.scale = scale;
+	x.identity = 0;
+	return (x);
+}
+
+/*
+** Instance space to world space: scale times rotation is the transpose of
+** the inverse times the scale squared.
+*/
+static t_vector	to_world(t_xform *x, t_vector v)
+{
+	return (vec_add(vec_mul(vec_add(vec_add(vec_mul(x->inv[0], v.x),
+						vec_mul(x->inv[1], v.y)), vec_mul(x->inv[2], v.z)),
+				x->scale * x->scale), x->offset));
+}
+
+/*
+** The ray in instance space. The direction is not renormalized, so hit
+** distances are the same in both spaces.
+*/
+t_ray	instance_ray(t_xform *x, t_ray *ray)
+{
+	t_ray		local;
+	t_vector	o;
+
+	o = vec_sub(ray->origin, x->offset);
+	local.origin = (t_vector){vec_dot(x->inv[0], o), vec_dot(x->inv[1], o),
+		vec_dot(x->inv[2], o)};
+	local.direction = (t_vector){vec_dot(x->inv[0], ray->direction),
+		vec_dot(x->inv[1], ray->direction), vec_dot(x->inv[2], ray->direction)};
+	local.t = ray->t;
+	local.prim = ray->prim;
+	return (local);
+}
+
+/*
+** Normals go to world space through the inverse transpose.
+*/
+t_vector	instance_normal(t_xform *x, t_vector n)
+{
+	if (x->identity)
+		return (n);
+	return (vec_normalize(vec_add(vec_add(vec_mul(x->inv[0], n.x),
+					vec_mul(x->inv[1], n.y)), vec_mul(x->inv[2], n.z))));
+}
+
+/*
+** World bounds of a mesh object: the corners of its hierarchy root, moved
+** to world space.
+*/
+void	instance_bounds(t_mesh_ref *ref)
+{
+	t_aabb	box;
+	int		i;
+
+	if (ref->data->bvh.node_count == 0)
+		return ;
+	box = ref->data->bvh.nodes[0].bounds;
+	if (ref->xform.identity)
+	{
+		ref->bounds = box;
+		return ;
+	}
+	ref->bounds = aabb_empty();
+	i = 0;
+	while (i < 8)
+	{
+		ref->bounds = aabb_grow(ref->bounds, to_world(&ref->xform, (t_vector){
+					(i & 1) ? box.max.x : box.min.x,
+					(i & 2) ? box.max.y : box.min.y,
+					(i & 4) ? box.max.z : box.min.z}));
+		i++;
+	}
+}
+
+/*
+** A mesh used by a single object gains nothing from being shared, so its
+** transform is applied to the vertices once and rays skip it. Runs before
+** the mesh hierarchies are built.
+*/
+void	bake_instances(t_scene *scene)
+{
+	t_mesh_ref	*ref;
+	size_t		i;
+	size_t		v;
+
+	i = 0;
+	while (i < scene->obj_count)
+	{
+		ref = &scene->objects[i].mesh;
+		if (scene->objects[i++].type != MESH || ref->xform.identity
+			|| ref->data->users != 1)
+			continue ;
+		v = 0;
+		while (v < ref->data->vertex_count)
+		{
+			ref->data->vertices[v] = vec_to_vertex(to_world(&ref->xform,
+						vertex_to_vec(ref->data->vertices[v])));
+			v++;
+		}
+		ref->xform = instance_xform((t_vector){0, 0, 0}, 1.0,
+				(t_vector){0, 0, 0});
+		ref->xform.identity = 1;
+	}
+}
@@ -1,32 +1,22 @@
 # include "../includes/minirt.h"
 
-void	render(mlx_t *mlx, t_scene *scene)
+/*
+** Batch mode: renders into a plain framebuffer and writes it out without
+** ever touching MLX or GLFW.
+*/
+int	render_to_file(t_scene *scene, t_options *opts)
 {
-	size_t		i;
-	size_t		j;
-	mlx_image_t	*img;
-	t_ray		ray;
+	uint32_t	*pixels;
+	int			ok;
 
-	img = mlx_new_image(mlx, scene->canvas.w, scene->canvas.h);
-	if (!img)
-	{
-		ft_putstr_fd("Error: Could not create image\n", 2);
-		return;
-	}
-	i = 0;
-	scene->viewport = viewport_dim(scene->canvas, scene->camera);
-	while (i < scene->canvas.w)
-	{
-		j = 0;
-		while (j < scene->canvas.h)
-		{
-			ray = (t_ray){scene->camera.pos, ray_dir(scene, i, j), INFINITY};
-			mlx_put_pixel(img, i, j, ray_get_color(scene, &ray));
-			j++;
-		}
-		i++;
-	}
-	mlx_image_to_window(mlx, img, 0, 0);
+	pixels = malloc(sizeof(uint32_t) * scene->canvas.w * scene->canvas.h);
+	if (!pixels)
+		return (ft_putstr_fd("Error: Memory allocation failed\n", 2), 0);
+	ok = render_frame(scene, pixels, opts->threads, opts->samples)
+		&& write_image(opts->output_path, pixels, scene->canvas.w,
+			scene->canvas.h);
+	free(pixels);
+	return (ok);
 }
 
 void cleanup_and_exit(t_scene *scene, mlx_t *mlx, int status)
@@ -46,14 +36,24 @@ void cleanup_and_exit(t_scene *scene, mlx_t *mlx, int status)
                     free(scene->objects[i].texture->data);
                 if (scene->objects[i].texture->bump_map)
                     free(scene->objects[i].texture->bump_map);
+                free(scene->objects[i].texture->path);
                 free(scene->objects[i].texture);
             }
         }
-        free(scene->objects);
     }
     
-    if (scene->lights)
+    // Compiled scenes keep their arrays in the mapping
+    if (!scene->compiled.data)
+    {
+        free(scene->objects);
         free(scene->lights);
+    }
+    free_bvh(&scene->bvh);
+    free_grid(&scene->grid);
+    free_prims(&scene->prims);
+    free_meshes(scene);
+    unmap_file(&scene->compiled);
+    unmap_file(&scene->bvh_cache);
     
     exit(status);
 }
@@ -70,37 +70,43 @@ void init_scene(t_scene *scene)
     scene->checkerboard = 0;
 }
 
+/*
+** Compiled scenes come with their hierarchies built; text scenes are read
+** into freshly allocated arrays and built here, or taken from the cache.
+*/
+static int	load_scene(t_scene *scene, t_options *opts)
+{
+	if (is_compiled_path(opts->scene_path))
+		return (load_compiled_scene(scene, opts->scene_path)
+			&& build_prims(scene));
+	scene->objects = malloc(sizeof(t_object) * MAX_OBJECTS);
+	scene->lights = malloc(sizeof(t_light) * MAX_LIGHTS);
+	if (!scene->objects || !scene->lights)
+		return (ft_putstr_fd("Error: Memory allocation failed\n", 2), 0);
+	if (!read_map(scene, opts->scene_path))
+		return (0);
+	finalize_scene(scene);
+	return (build_hierarchies(scene, opts) && build_prims(scene));
+}
+
 int	main(int argc, char **argv)
 {
-	int			fd;
 	mlx_t		*mlx;
-	t_object	*objs;
-	t_light		*lights;
 	t_scene		scene;
+	t_options	opts;
+	t_editor	editor;
 
-	if (argc != 2)
-		return (ft_putstr_fd("Error: Invalid number of arguments\n", 2), 1);
-	fd = open(argv[1], O_RDONLY);
-	if (fd == -1)
-		return (ft_putstr_fd("Error: Could not open file\n", 2), 1);
-	
-	objs = malloc(sizeof(t_object) * MAX_OBJECTS);
-	lights = malloc(sizeof(t_light) * MAX_LIGHTS);
-	if (!objs || !lights)
-	{
-		if (objs)
-			free(objs);
-		if (lights)
-			free(lights);
-		return (ft_putstr_fd("Error: Memory allocation failed\n", 2), 1);
-	}
-	
-	scene = (t_scene){.objects = objs, .lights = lights,
-		.canvas = (t_canvas){1200, 800}, .obj_count = 0, .light_count = 0};
+	if (!parse_options(&opts, argc, argv))
+		return (1);
+	scene = (t_scene){.canvas = (t_canvas){1200, 800}};
 	init_scene(&scene);
 	
-	if (!read_map(&scene, fd))
+	if (!load_scene(&scene, &opts))
 		cleanup_and_exit(&scene, NULL, 1);
+	if (opts.compile_path)
+		cleanup_and_exit(&scene, NULL, !compile_scene(&scene, opts.compile_path));
+	if (opts.output_path)
+		cleanup_and_exit(&scene, NULL, !render_to_file(&scene, &opts));
 	
 	mlx = mlx_init(scene.canvas.w, scene.canvas.h, "MiniRT", 1);
 	if (!mlx)
@@ -109,12 +115,17 @@ int	main(int argc, char **argv)
 		cleanup_and_exit(&scene, NULL, 1);
 	}
 	
-	render(mlx, &scene);
-	
-	mlx_key_hook(mlx, key_hook, mlx);
+	if (!editor_start(&editor, mlx, &scene, &opts))
+	{
+		editor_stop(&editor);
+		cleanup_and_exit(&scene, mlx, 1);
+	}
+	mlx_key_hook(mlx, edit_key_hook, &editor);
+	mlx_loop_hook(mlx, edit_loop_hook, &editor);
 	
 	mlx_loop(mlx);
 	
+	editor_stop(&editor);
 	cleanup_and_exit(&scene, mlx, 0);
 	return (0);
-}
\ No newline at end of file
+}
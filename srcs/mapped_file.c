@@ -0,0 +1,41 @@
+#include "../includes/minirt.h"
+
+/*
+** Maps a whole file. The mapping is private, so a `writable` mapping lets
+** parsers cut tokens in place without the changes ever reaching the file.
+** An empty file maps to {NULL, 0}.
+*/
+int	map_file(char *path, t_mapped_file *file, int writable)
+{
+	struct stat	st;
+	int			fd;
+	int			prot;
+
+	*file = (t_mapped_file){NULL, 0};
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return (0);
+	if (fstat(fd, &st) != 0 || st.st_size < 0)
+		return (close(fd), 0);
+	if (st.st_size == 0)
+		return (close(fd), 1);
+	prot = PROT_READ;
+	if (writable)
+		prot |= PROT_WRITE;
+	file->data = mmap(NULL, st.st_size, prot, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (file->data == MAP_FAILED)
+	{
+		file->data = NULL;
+		return (0);
+	}
+	file->size = st.st_size;
+	return (1);
+}
+
+void	unmap_file(t_mapped_file *file)
+{
+	if (file->data)
+		munmap(file->data, file->size);
+	*file = (t_mapped_file){NULL, 0};
+}
@@ -0,0 +1,296 @@
+#include "../includes/minirt.h"
+
+/*
+** Vertices are welded on exact coordinates, as stored, while a mesh is
+** being built, through an open-addressing table of vertex index + 1 (0 is
+** empty).
+*/
+static uint32_t	vertex_hash(t_vertex w)
+{
+	t_vector	v;
+
+	uint64_t	bits[3];
+	uint64_t	h;
+
+	v = vertex_to_vec(w);
+	v.x += 0.0;
+	v.y += 0.0;
+	v.z += 0.0;
+	ft_memcpy(&bits[0], &v.x, sizeof(uint64_t));
+	ft_memcpy(&bits[1], &v.y, sizeof(uint64_t));
+	ft_memcpy(&bits[2], &v.z, sizeof(uint64_t));
+	h = bits[0] * 0x9E3779B97F4A7C15ull;
+	h = (h ^ (h >> 29) ^ bits[1]) * 0xBF58476D1CE4E5B9ull;
+	h = (h ^ (h >> 32) ^ bits[2]) * 0x94D049BB133111EBull;
+	return ((uint32_t)(h ^ (h >> 31)));
+}
+
+static int	grow_lookup(t_mesh *mesh)
+{
+	size_t		cap;
+	size_t		slot;
+	uint32_t	i;
+
+	cap = 1024;
+	while (cap < mesh->vertex_count * 4)
+		cap *= 2;
+	free(mesh->lookup);
+	mesh->lookup = ft_calloc(cap, sizeof(uint32_t));
+	mesh->lookup_cap = cap;
+	if (!mesh->lookup)
+		return (0);
+	i = 0;
+	while (i < mesh->vertex_count)
+	{
+		slot = vertex_hash(mesh->vertices[i]) & (cap - 1);
+		while (mesh->lookup[slot])
+			slot = (slot + 1) & (cap - 1);
+		mesh->lookup[slot] = ++i;
+	}
+	return (1);
+}
+
+static int	grow(void **buf, size_t *cap, size_t need, size_t elem)
+{
+	void	*tmp;
+	size_t	new_cap;
+
+	if (need <= *cap)
+		return (1);
+	new_cap = *cap * 2;
+	if (new_cap < need)
+		new_cap = need + 64;
+	tmp = realloc(*buf, new_cap * elem);
+	if (!tmp)
+		return (0);
+	*buf = tmp;
+	*cap = new_cap;
+	return (1);
+}
+
+int	mesh_push_vertex(t_mesh *mesh, t_vector v)
+{
+	if (!grow((void **)&mesh->vertices, &mesh->vertex_cap,
+			mesh->vertex_count + 1, sizeof(t_vertex)))
+		return (0);
+	mesh->vertices[mesh->vertex_count++] = vec_to_vertex(v);
+	return (1);
+}
+
+int	mesh_push_triangle(t_mesh *mesh, uint32_t a, uint32_t b, uint32_t c)
+{
+	if (!grow((void **)&mesh->indices, &mesh->tri_cap,
+			(mesh->tri_count + 1) * 3, sizeof(uint32_t)))
+		return (0);
+	mesh->indices[mesh->tri_count * 3] = a;
+	mesh->indices[mesh->tri_count * 3 + 1] = b;
+	mesh->indices[mesh->tri_count * 3 + 2] = c;
+	mesh->tri_count++;
+	return (1);
+}
+
+static int	weld_vertex(t_mesh *mesh, t_vector v, uint32_t *index)
+{
+	size_t		slot;
+	t_vertex	*w;
+	t_vertex	r;
+
+	if ((mesh->vertex_count + 1) * 2 > mesh->lookup_cap && !grow_lookup(mesh))
+		return (0);
+	r = vec_to_vertex(v);
+	slot = vertex_hash(r) & (mesh->lookup_cap - 1);
+	while (mesh->lookup[slot])
+	{
+		w = &mesh->vertices[mesh->lookup[slot] - 1];
+		if (w->x == r.x && w->y == r.y && w->z == r.z)
+			return (*index = mesh->lookup[slot] - 1, 1);
+		slot = (slot + 1) & (mesh->lookup_cap - 1);
+	}
+	if (!mesh_push_vertex(mesh, v))
+		return (0);
+	*index = mesh->vertex_count - 1;
+	mesh->lookup[slot] = *index + 1;
+	return (1);
+}
+
+/*
+** Adds a MESH object placing `mesh` with an identity transform.
+*/
+t_mesh_ref	*mesh_instance(t_scene *scene, t_mesh *mesh, t_color color)
+{
+	t_object	*obj;
+
+	if (scene->obj_count >= MAX_OBJECTS)
+		return (NULL);
+	obj = &scene->objects[scene->obj_count++];
+	obj->type = MESH;
+	obj->color = color;
+	obj->texture = NULL;
+	obj->mesh = (t_mesh_ref){mesh, aabb_empty(), instance_xform(
+			(t_vector){0, 0, 0}, 1.0, (t_vector){0, 0, 0})};
+	obj->mesh.xform.identity = 1;
+	mesh->users++;
+	return (&obj->mesh);
+}
+
+/*
+** Adds a MESH object with an empty mesh. Meshes built from `tr` lines stay
+** open while the following lines keep the same color; imported meshes are
+** created closed.
+*/
+t_mesh	*mesh_new(t_scene *scene, t_color color, int open)
+{
+	t_mesh	*mesh;
+
+	if (scene->obj_count >= MAX_OBJECTS
+		|| !grow((void **)&scene->meshes, &scene->mesh_cap,
+			scene->mesh_count + 1, sizeof(t_mesh *)))
+		return (NULL);
+	mesh = ft_calloc(1, sizeof(t_mesh));
+	if (!mesh)
+		return (NULL);
+	mesh->open = open;
+	mesh->id = scene->mesh_count;
+	scene->meshes[scene->mesh_count++] = mesh;
+	mesh_instance(scene, mesh, color);
+	return (mesh);
+}
+
+/*
+** The mesh an earlier `mesh` line loaded from `path`, to be shared.
+*/
+t_mesh	*mesh_find(t_scene *scene, char *path)
+{
+	size_t	i;
+
+	i = 0;
+	while (i < scene->mesh_count)
+	{
+		if (scene->meshes[i]->path
+			&& ft_strcmp(scene->meshes[i]->path, path) == 0)
+			return (scene->meshes[i]);
+		i++;
+	}
+	return (NULL);
+}
+
+/*
+** Appends an untextured triangle to the mesh being built from the previous
+** `tr` lines when it has the same color, or starts a new one.
+*/
+int	mesh_add_triangle(t_scene *scene, t_vector v[3], t_color color)
+{
+	t_object	*last;
+	t_mesh		*mesh;
+	uint32_t	tri[3];
+
+	mesh = NULL;
+	last = NULL;
+	if (scene->obj_count > 0)
+		last = &scene->objects[scene->obj_count - 1];
+	if (last && last->type == MESH && last->mesh.data->open
+		&& last->color.r == color.r && last->color.g == color.g
+		&& last->color.b == color.b)
+		mesh = last->mesh.data;
+	if (!mesh)
+		mesh = mesh_new(scene, color, 1);
+	if (!mesh || !weld_vertex(mesh, v[0], &tri[0])
+		|| !weld_vertex(mesh, v[1], &tri[1])
+		|| !weld_vertex(mesh, v[2], &tri[2]))
+		return (0);
+	return (mesh_push_triangle(mesh, tri[0], tri[1], tri[2]));
+}
+
+static int	finish_mesh(t_mesh *mesh, int threads, int sbvh)
+{
+	t_aabb		*boxes;
+	uint32_t	*tri;
+	size_t		i;
+
+	free(mesh->lookup);
+	mesh->lookup = NULL;
+	mesh->lookup_cap = 0;
+	mesh->open = 0;
+	mesh->vertices = realloc(mesh->vertices,
+			sizeof(t_vertex) * (mesh->vertex_count + 1));
+	mesh->indices = realloc(mesh->indices,
+			sizeof(uint32_t) * (mesh->tri_count * 3 + 1));
+	mesh->vertex_cap = mesh->vertex_count;
+	mesh->tri_cap = mesh->tri_count * 3;
+	if (mesh->bvh.mapped)
+		return (1);
+	if (sbvh)
+		return (sbvh_build(&mesh->bvh, mesh));
+	boxes = malloc(sizeof(t_aabb) * (mesh->tri_count + 1));
+	if (!boxes)
+		return (0);
+	i = 0;
+	while (i < mesh->tri_count)
+	{
+		tri = &mesh->indices[i * 3];
+		boxes[i] = (t_aabb){vertex_to_vec(mesh->vertices[tri[0]]),
+			vertex_to_vec(mesh->vertices[tri[0]])};
+		boxes[i] = aabb_grow(boxes[i], vertex_to_vec(mesh->vertices[tri[1]]));
+		boxes[i] = aabb_grow(boxes[i], vertex_to_vec(mesh->vertices[tri[2]]));
+		i++;
+	}
+	i = bvh_build(&mesh->bvh, boxes, mesh->tri_count, threads);
+	free(boxes);
+	return (i);
+}
+
+/*
+** Closes every mesh, drops the welding tables and builds the per-mesh
+** hierarchy over its triangles, unless it came from the BVH cache; with
+** `sbvh` set those are spatial-split hierarchies (see sbvh_build). Meshes
+** with a single user are moved to world space first. Runs once, after the
+** whole scene is read, and before build_bvh, which needs the mesh bounds.
+*/
+int	build_meshes(t_scene *scene, int threads, int sbvh)
+{
+	size_t	i;
+
+	bake_instances(scene);
+	i = 0;
+	while (i < scene->mesh_count)
+	{
+		if (!finish_mesh(scene->meshes[i], threads, sbvh))
+			return (ft_putstr_fd("Error: Could not build mesh\n", 2), 0);
+		i++;
+	}
+	i = 0;
+	while (i < scene->obj_count)
+	{
+		if (scene->objects[i].type == MESH)
+			instance_bounds(&scene->objects[i].mesh);
+		i++;
+	}
+	return (1);
+}
+
+/*
+** Meshes loaded from a compiled scene only own their struct and wide
+** tree; their arrays live in the mapping.
+*/
+void	free_meshes(t_scene *scene)
+{
+	size_t	i;
+
+	i = 0;
+	while (i < scene->mesh_count)
+	{
+		if (!scene->compiled.data)
+		{
+			free(scene->meshes[i]->vertices);
+			free(scene->meshes[i]->indices);
+			free(scene->meshes[i]->lookup);
+			free(scene->meshes[i]->path);
+		}
+		free_bvh(&scene->meshes[i]->bvh);
+		free(scene->meshes[i]);
+		i++;
+	}
+	free(scene->meshes);
+	scene->meshes = NULL;
+	scene->mesh_count = 0;
+}
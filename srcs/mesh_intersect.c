@@ -0,0 +1,197 @@
+#include "../includes/minirt.h"
+
+static int	intersect_leaf(void *ctx, t_ray *ray, uint32_t *prims,
+		uint32_t count)
+{
+	t_tri_run	run;
+	uint32_t	i;
+	int			hit;
+
+	hit = 0;
+	while (count > 0)
+	{
+		run.tris = prims;
+		run.count = count;
+		if (run.count > PRIM_CHUNK)
+			run.count = PRIM_CHUNK;
+		triangle_distances((t_mesh_query *)ctx, ray, &run);
+		i = 0;
+		while (i < run.count)
+		{
+			if (run.t[i] > EPSILON && run.t[i] < ray->t)
+			{
+				ray->t = run.t[i];
+				ray->prim = prims[i];
+				hit = 1;
+			}
+			i++;
+		}
+		prims += run.count;
+		count -= run.count;
+	}
+	return (hit);
+}
+
+static int	occlude_leaf(void *ctx, t_ray *ray, uint32_t *prims,
+		uint32_t count)
+{
+	t_tri_run	run;
+	uint32_t	i;
+
+	while (count > 0)
+	{
+		run.tris = prims;
+		run.count = count;
+		if (run.count > PRIM_CHUNK)
+			run.count = PRIM_CHUNK;
+		triangle_distances((t_mesh_query *)ctx, ray, &run);
+		i = 0;
+		while (i < run.count)
+		{
+			if (run.t[i] > EPSILON && run.t[i] < ray->t)
+				return (1);
+			i++;
+		}
+		prims += run.count;
+		count -= run.count;
+	}
+	return (0);
+}
+
+static uint32_t	packet_leaf(void *ctx, t_packet *p, uint32_t *prims,
+		uint32_t count)
+{
+	uint32_t	mask;
+	uint32_t	i;
+
+	mask = 0;
+	i = 0;
+	while (i < p->count)
+	{
+		if ((p->active & (1u << i))
+			&& intersect_leaf(ctx, &p->rays[i], prims, count))
+			mask |= 1u << i;
+		i++;
+	}
+	return (mask);
+}
+
+/*
+** The determinant scales with the cube of the instance scale when rays are
+** moved to instance space, so the edge-on limit follows it.
+*/
+static t_mesh_query	mesh_query(t_mesh_ref *ref)
+{
+	if (ref->xform.identity)
+		return ((t_mesh_query){ref->data, EPSILON, simd_avx2()});
+	return ((t_mesh_query){ref->data, EPSILON / (ref->xform.scale
+			* ref->xform.scale * ref->xform.scale), simd_avx2()});
+}
+
+/*
+** Nearest hit against the mesh's own hierarchy, in instance space unless
+** the mesh is already in world space; the triangle hit is left in
+** ray->prim for shading.
+*/
+int	intersect_mesh(t_ray *ray, t_mesh_ref *ref)
+{
+	t_mesh_query	q;
+	t_ray			local;
+
+	q = mesh_query(ref);
+	if (ref->xform.identity)
+		return (bvh_intersect(&ref->data->bvh, ray, intersect_leaf, &q));
+	local = instance_ray(&ref->xform, ray);
+	if (!bvh_intersect(&ref->data->bvh, &local, intersect_leaf, &q))
+		return (0);
+	ray->t = local.t;
+	ray->prim = local.prim;
+	return (1);
+}
+
+/*
+** Packet traversal of an instance, in instance space. Hit distances are the
+** same in both spaces, so only they and the triangles hit are copied back.
+*/
+static int	instance_packet(t_mesh_ref *ref, t_packet *p, t_mesh_query *q)
+{
+	t_packet	local;
+	int			mask;
+	uint32_t	i;
+
+	local.count = p->count;
+	local.active = p->active;
+	i = 0;
+	while (i < p->count)
+	{
+		if (p->active & (1u << i))
+			local.rays[i] = instance_ray(&ref->xform, &p->rays[i]);
+		i++;
+	}
+	mask = bvh_intersect_packet(&ref->data->bvh, &local, packet_leaf, q);
+	i = 0;
+	while (mask > 0 && i < p->count)
+	{
+		if (mask & (1 << i))
+		{
+			p->rays[i].t = local.rays[i].t;
+			p->rays[i].prim = local.rays[i].prim;
+		}
+		i++;
+	}
+	return (mask);
+}
+
+/*
+** intersect_mesh for the active rays of a packet, returning the mask of
+** rays that hit. Packets that diverge, in instance space too, are traced
+** ray by ray.
+*/
+uint32_t	intersect_mesh_packet(t_mesh_ref *ref, t_packet *p)
+{
+	t_mesh_query	q;
+	int				mask;
+	uint32_t		i;
+
+	q = mesh_query(ref);
+	if (ref->xform.identity)
+		mask = bvh_intersect_packet(&ref->data->bvh, p, packet_leaf, &q);
+	else
+		mask = instance_packet(ref, p, &q);
+	if (mask >= 0)
+		return (mask);
+	mask = 0;
+	i = 0;
+	while (i < p->count)
+	{
+		if ((p->active & (1u << i)) && intersect_mesh(&p->rays[i], ref))
+			mask |= 1 << i;
+		i++;
+	}
+	return (mask);
+}
+
+int	occlude_mesh(t_ray *ray, t_mesh_ref *ref)
+{
+	t_mesh_query	q;
+	t_ray			local;
+
+	q = mesh_query(ref);
+	if (ref->xform.identity)
+		return (bvh_occluded(&ref->data->bvh, ray, occlude_leaf, &q));
+	local = instance_ray(&ref->xform, ray);
+	return (bvh_occluded(&ref->data->bvh, &local, occlude_leaf, &q));
+}
+
+t_vector	mesh_normal(t_mesh_ref *ref, uint32_t tri)
+{
+	t_mesh		*mesh;
+	t_vector	v[3];
+
+	mesh = ref->data;
+	v[0] = vertex_to_vec(mesh->vertices[mesh->indices[tri * 3]]);
+	v[1] = vertex_to_vec(mesh->vertices[mesh->indices[tri * 3 + 1]]);
+	v[2] = vertex_to_vec(mesh->vertices[mesh->indices[tri * 3 + 2]]);
+	return (instance_normal(&ref->xform, vec_normalize(vec_cross(
+					vec_sub(v[1], v[0]), vec_sub(v[2], v[0])))));
+}
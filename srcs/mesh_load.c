@@ -0,0 +1,164 @@
+#include "../includes/minirt.h"
+
+/*
+** Mesh files are read straight from a read-only mapping. Tokens are
+** scanned in place between `s` and `end`; nothing is allocated per line
+** or per token, only the vertex and index buffers grow.
+*/
+
+static const char	*skip_blanks(const char *s, const char *end)
+{
+	while (s < end && (*s == ' ' || *s == '\t' || *s == '\r'))
+		s++;
+	return (s);
+}
+
+static const char	*next_line(const char *s, const char *end)
+{
+	while (s < end && *s != '\n')
+		s++;
+	return (s + (s < end));
+}
+
+static int	obj_vertex(t_mesh *mesh, const char *s, const char *end)
+{
+	t_vector	v;
+
+	s = scan_double(skip_blanks(s, end), end, &v.x);
+	if (s)
+		s = scan_double(skip_blanks(s, end), end, &v.y);
+	if (s)
+		s = scan_double(skip_blanks(s, end), end, &v.z);
+	return (s && mesh_push_vertex(mesh, v));
+}
+
+/*
+** One face corner: `v`, `v/vt`, `v//vn` or `v/vt/vn`. Negative indices
+** count back from the last vertex read so far.
+*/
+static const char	*obj_corner(t_mesh *mesh, const char *s, const char *end,
+		uint32_t *index)
+{
+	double	n;
+
+	s = scan_double(s, end, &n);
+	if (!s || n != (long)n || n == 0)
+		return (NULL);
+	if (n < 0)
+		n += mesh->vertex_count;
+	else
+		n -= 1;
+	if (n < 0 || n > UINT32_MAX)
+		return (NULL);
+	*index = (uint32_t)n;
+	while (s < end && *s != ' ' && *s != '\t' && *s != '\r' && *s != '\n')
+		s++;
+	return (s);
+}
+
+/*
+** Polygons are triangulated as a fan around their first corner.
+*/
+static int	obj_face(t_mesh *mesh, const char *s, const char *end)
+{
+	uint32_t	first;
+	uint32_t	prev;
+	uint32_t	cur;
+	int			n;
+
+	first = 0;
+	prev = 0;
+	n = 0;
+	s = skip_blanks(s, end);
+	while (s < end && *s != '\n' && *s != '#')
+	{
+		s = obj_corner(mesh, s, end, &cur);
+		if (!s)
+			return (0);
+		if (n == 0)
+			first = cur;
+		else if (n >= 2 && !mesh_push_triangle(mesh, first, prev, cur))
+			return (0);
+		prev = cur;
+		n++;
+		s = skip_blanks(s, end);
+	}
+	return (n >= 3);
+}
+
+static int	load_obj(t_mesh *mesh, const char *s, const char *end)
+{
+	int	ok;
+
+	while (s < end)
+	{
+		s = skip_blanks(s, end);
+		ok = 1;
+		if (end - s > 2 && s[0] == 'v' && (s[1] == ' ' || s[1] == '\t'))
+			ok = obj_vertex(mesh, s + 2, end);
+		else if (end - s > 2 && s[0] == 'f' && (s[1] == ' ' || s[1] == '\t'))
+			ok = obj_face(mesh, s + 2, end);
+		if (!ok)
+			return (0);
+		s = next_line(s, end);
+	}
+	return (1);
+}
+
+static int	valid_indices(t_mesh *mesh)
+{
+	size_t	i;
+
+	i = 0;
+	while (i < mesh->tri_count * 3)
+	{
+		if (mesh->indices[i] >= mesh->vertex_count)
+			return (0);
+		i++;
+	}
+	return (mesh->tri_count > 0);
+}
+
+static int	has_extension(char *path, char *ext)
+{
+	char	*dot;
+	size_t	i;
+
+	dot = ft_strrchr(path, '.');
+	if (!dot || ft_strlen(dot) != ft_strlen(ext))
+		return (0);
+	i = 0;
+	while (dot[i] && ft_tolower(dot[i]) == ext[i])
+		i++;
+	return (dot[i] == '\0');
+}
+
+/*
+** Loads a Wavefront OBJ or binary PLY file into `mesh`, picked from the
+** file extension.
+*/
+int	load_mesh_file(t_mesh *mesh, char *path)
+{
+	t_mapped_file	file;
+	int				ok;
+
+	if (!has_extension(path, ".obj") && !has_extension(path, ".ply"))
+		return (ft_putstr_fd("Error: Meshes must be .obj or .ply files\n", 2), 0);
+	if (!map_file(path, &file, 0))
+	{
+		ft_putstr_fd("Error: Could not open mesh file: ", 2);
+		return (ft_putendl_fd(path, 2), 0);
+	}
+	if (has_extension(path, ".obj"))
+		ok = load_obj(mesh, file.data, file.data + file.size);
+	else
+		ok = load_ply(mesh, (const unsigned char *)file.data,
+				(const unsigned char *)file.data + file.size);
+	unmap_file(&file);
+	if (!ok || !valid_indices(mesh))
+	{
+		ft_putstr_fd("Error: Invalid mesh file: ", 2);
+		return (ft_putendl_fd(path, 2), 0);
+	}
+	return (1);
+}
@@ -0,0 +1,314 @@
+#include "../includes/minirt.h"
+
+/*
+** Binary PLY (little or big endian). Only the vertex x/y/z properties and
+** the face index list are kept; every other property and element is
+** skipped by size.
+*/
+
+static const char	*ply_word(const char **s, const char *end, size_t *len)
+{
+	const char	*word;
+
+	while (*s < end && (**s == ' ' || **s == '\t' || **s == '\r'))
+		(*s)++;
+	word = *s;
+	while (*s < end && **s != ' ' && **s != '\t' && **s != '\r' && **s != '\n')
+		(*s)++;
+	*len = *s - word;
+	return (word);
+}
+
+static int	word_is(const char *word, size_t len, char *name)
+{
+	return (len == ft_strlen(name) && ft_strncmp(word, name, len) == 0);
+}
+
+static t_ply_type	ply_type(const char *w, size_t len)
+{
+	if (word_is(w, len, "char") || word_is(w, len, "int8"))
+		return (PLY_INT8);
+	if (word_is(w, len, "uchar") || word_is(w, len, "uint8"))
+		return (PLY_UINT8);
+	if (word_is(w, len, "short") || word_is(w, len, "int16"))
+		return (PLY_INT16);
+	if (word_is(w, len, "ushort") || word_is(w, len, "uint16"))
+		return (PLY_UINT16);
+	if (word_is(w, len, "int") || word_is(w, len, "int32"))
+		return (PLY_INT32);
+	if (word_is(w, len, "uint") || word_is(w, len, "uint32"))
+		return (PLY_UINT32);
+	if (word_is(w, len, "float") || word_is(w, len, "float32"))
+		return (PLY_FLOAT32);
+	if (word_is(w, len, "double") || word_is(w, len, "float64"))
+		return (PLY_FLOAT64);
+	return (PLY_NONE);
+}
+
+static size_t	ply_size(t_ply_type type)
+{
+	if (type == PLY_INT8 || type == PLY_UINT8)
+		return (1);
+	if (type == PLY_INT16 || type == PLY_UINT16)
+		return (2);
+	if (type == PLY_FLOAT64)
+		return (8);
+	return (4);
+}
+
+static int	ply_property(t_ply *ply, const char *s, const char *end)
+{
+	t_ply_element	*elem;
+	t_ply_prop		*prop;
+	const char		*w;
+	size_t			len;
+
+	if (ply->elem_count == 0
+		|| ply->elems[ply->elem_count - 1].prop_count >= PLY_MAX_PROPS)
+		return (0);
+	elem = &ply->elems[ply->elem_count - 1];
+	prop = &elem->props[elem->prop_count++];
+	*prop = (t_ply_prop){PLY_NONE, PLY_NONE, PLY_SKIP};
+	w = ply_word(&s, end, &len);
+	if (word_is(w, len, "list"))
+	{
+		w = ply_word(&s, end, &len);
+		prop->count_type = ply_type(w, len);
+		if (prop->count_type == PLY_NONE || prop->count_type >= PLY_FLOAT32)
+			return (0);
+		w = ply_word(&s, end, &len);
+	}
+	prop->type = ply_type(w, len);
+	w = ply_word(&s, end, &len);
+	if (elem->is_vertex && prop->count_type == PLY_NONE && len == 1
+		&& *w >= 'x' && *w <= 'z')
+		prop->role = PLY_X + (*w - 'x');
+	else if (elem->is_face && prop->count_type != PLY_NONE
+		&& (word_is(w, len, "vertex_indices")
+			|| word_is(w, len, "vertex_index")))
+		prop->role = PLY_INDICES;
+	return (prop->type != PLY_NONE);
+}
+
+static int	ply_element(t_ply *ply, const char *s, const char *end)
+{
+	t_ply_element	*elem;
+	const char		*w;
+	size_t			len;
+	size_t			i;
+
+	if (ply->elem_count >= PLY_MAX_ELEMENTS)
+		return (0);
+	elem = &ply->elems[ply->elem_count++];
+	ft_bzero(elem, sizeof(t_ply_element));
+	w = ply_word(&s, end, &len);
+	elem->is_vertex = word_is(w, len, "vertex");
+	elem->is_face = word_is(w, len, "face");
+	w = ply_word(&s, end, &len);
+	i = 0;
+	while (i < len && ft_isdigit(w[i]))
+		elem->count = elem->count * 10 + (w[i++] - '0');
+	return (len > 0 && i == len);
+}
+
+static int	ply_format(t_ply *ply, const char *s, const char *end)
+{
+	const char	*w;
+	size_t		len;
+	uint16_t	probe;
+	int			host_big;
+
+	probe = 1;
+	host_big = (*(unsigned char *)&probe == 0);
+	w = ply_word(&s, end, &len);
+	if (word_is(w, len, "binary_little_endian"))
+		ply->swap = host_big;
+	else if (word_is(w, len, "binary_big_endian"))
+		ply->swap = !host_big;
+	else
+		return (ft_putstr_fd("Error: Only binary PLY files are supported\n",
+				2), 0);
+	return (1);
+}
+
+/*
+** Walks the header line by line up to `end_header` and leaves ply->cur on
+** the first byte of the body.
+*/
+static int	ply_header(t_ply *ply, const char *s, const char *end)
+{
+	const char	*w;
+	size_t		len;
+	int			ok;
+	int			format;
+
+	w = ply_word(&s, end, &len);
+	if (!word_is(w, len, "ply"))
+		return (0);
+	format = 0;
+	while (s < end)
+	{
+		while (s < end && *s != '\n')
+			s++;
+		s += (s < end);
+		w = ply_word(&s, end, &len);
+		ok = 1;
+		if (word_is(w, len, "format"))
+			ok = ply_format(ply, s, end) && ++format;
+		else if (word_is(w, len, "element"))
+			ok = ply_element(ply, s, end);
+		else if (word_is(w, len, "property"))
+			ok = ply_property(ply, s, end);
+		else if (word_is(w, len, "end_header"))
+		{
+			while (s < end && *s != '\n')
+				s++;
+			ply->cur = (const unsigned char *)s + (s < end);
+			return (format);
+		}
+		if (!ok)
+			return (0);
+	}
+	return (0);
+}
+
+/*
+** Reads one scalar of `type` from the body, byte-swapping when the file
+** and the host disagree on endianness.
+*/
+static int	ply_read(t_ply *ply, t_ply_type type, double *out)
+{
+	union u_ply_value
+	{
+		unsigned char	b[8];
+		int8_t			i8;
+		uint8_t			u8;
+		int16_t			i16;
+		uint16_t		u16;
+		int32_t			i32;
+		uint32_t		u32;
+		float			f32;
+		double			f64;
+	}				val;
+	size_t			size;
+	size_t			i;
+
+	size = ply_size(type);
+	if ((size_t)(ply->end - ply->cur) < size)
+		return (0);
+	i = 0;
+	while (i < size)
+	{
+		if (ply->swap)
+			val.b[i] = ply->cur[size - 1 - i];
+		else
+			val.b[i] = ply->cur[i];
+		i++;
+	}
+	ply->cur += size;
+	if (type == PLY_INT8)
+		*out = val.i8;
+	else if (type == PLY_UINT8)
+		*out = val.u8;
+	else if (type == PLY_INT16)
+		*out = val.i16;
+	else if (type == PLY_UINT16)
+		*out = val.u16;
+	else if (type == PLY_INT32)
+		*out = val.i32;
+	else if (type == PLY_UINT32)
+		*out = val.u32;
+	else if (type == PLY_FLOAT32)
+		*out = val.f32;
+	else
+		*out = val.f64;
+	return (1);
+}
+
+static int	ply_face_list(t_ply *ply, t_mesh *mesh, t_ply_prop *prop,
+		double count)
+{
+	double		v;
+	uint32_t	first;
+	uint32_t	prev;
+	size_t		i;
+
+	first = 0;
+	prev = 0;
+	i = 0;
+	while (i < count)
+	{
+		if (!ply_read(ply, prop->type, &v) || v < 0 || v > UINT32_MAX)
+			return (0);
+		if (i == 0)
+			first = v;
+		else if (i >= 2 && !mesh_push_triangle(mesh, first, prev, v))
+			return (0);
+		prev = v;
+		i++;
+	}
+	return (count >= 3);
+}
+
+static int	ply_item(t_ply *ply, t_mesh *mesh, t_ply_element *elem)
+{
+	t_vector	p;
+	double		v;
+	double		count;
+	int			i;
+
+	p = (t_vector){0, 0, 0};
+	i = -1;
+	while (++i < elem->prop_count)
+	{
+		if (elem->props[i].count_type == PLY_NONE)
+		{
+			if (!ply_read(ply, elem->props[i].type, &v))
+				return (0);
+			if (elem->props[i].role == PLY_X)
+				p.x = v;
+			else if (elem->props[i].role == PLY_Y)
+				p.y = v;
+			else if (elem->props[i].role == PLY_Z)
+				p.z = v;
+			continue ;
+		}
+		if (!ply_read(ply, elem->props[i].count_type, &count) || count < 0
+			|| (size_t)(ply->end - ply->cur)
+			< count * ply_size(elem->props[i].type))
+			return (0);
+		if (elem->props[i].role == PLY_INDICES)
+		{
+			if (!ply_face_list(ply, mesh, &elem->props[i], count))
+				return (0);
+		}
+		else
+			ply->cur += (size_t)count * ply_size(elem->props[i].type);
+	}
+	return (!elem->is_vertex || mesh_push_vertex(mesh, p));
+}
+
+int	load_ply(t_mesh *mesh, const unsigned char *s, const unsigned char *end)
+{
+	t_ply	*ply;
+	size_t	i;
+	int		e;
+
+	ply = malloc(sizeof(t_ply));
+	if (!ply)
+		return (0);
+	ft_bzero(ply, sizeof(t_ply));
+	ply->end = end;
+	if (!ply_header(ply, (const char *)s, (const char *)end))
+		return (free(ply), 0);
+	e = -1;
+	while (++e < ply->elem_count)
+	{
+		i = 0;
+		while (i++ < ply->elems[e].count)
+			if (!ply_item(ply, mesh, &ply->elems[e]))
+				return (free(ply), 0);
+	}
+	free(ply);
+	return (1);
+}
@@ -0,0 +1,128 @@
+#include "../includes/minirt.h"
+
+static const char	*scan_digits(const char *s, const char *end, t_decimal *d,
+		int fraction)
+{
+	while (s < end && *s >= '0' && *s <= '9')
+	{
+		d->seen = 1;
+		if (d->digits < 19)
+		{
+			d->mantissa = d->mantissa * 10 + (*s - '0');
+			d->digits += (d->mantissa != 0);
+			d->exp10 -= fraction;
+		}
+		else
+		{
+			d->inexact |= (*s != '0');
+			d->exp10 += !fraction;
+		}
+		s++;
+	}
+	return (s);
+}
+
+/*
+** An exponent is only consumed when at least one digit follows the `e`,
+** as strtod does. Huge exponents are clamped; they only decide between
+** zero and infinity.
+*/
+static const char	*scan_exponent(const char *s, const char *end, t_decimal *d)
+{
+	const char	*p;
+	long		e;
+	int			neg;
+
+	if (s >= end || (*s != 'e' && *s != 'E'))
+		return (s);
+	p = s + 1;
+	neg = (p < end && *p == '-');
+	p += (p < end && (*p == '-' || *p == '+'));
+	if (p >= end || *p < '0' || *p > '9')
+		return (s);
+	e = 0;
+	while (p < end && *p >= '0' && *p <= '9')
+	{
+		if (e < 100000)
+			e = e * 10 + (*p - '0');
+		p++;
+	}
+	if (neg)
+		d->exp10 -= e;
+	else
+		d->exp10 += e;
+	return (p);
+}
+
+/*
+** Correctly rounded slow path for the rare numbers the fast path cannot
+** take (more than 15-16 significant digits or a large exponent).
+*/
+static int	slow_path(const char *s, const char *stop, double *out)
+{
+	char	buf[512];
+	size_t	len;
+
+	len = stop - s;
+	if (len >= sizeof(buf))
+		return (0);
+	ft_memcpy(buf, s, len);
+	buf[len] = '\0';
+	*out = strtod(buf, NULL);
+	return (1);
+}
+
+/*
+** Parses a decimal number at the start of [s, end) and returns the first
+** byte after it, or NULL when there is none. Accepts an optional sign, a
+** fraction and an exponent. The result is correctly rounded: when the
+** mantissa fits in 53 bits and |exp10| <= 22 both factors are exact
+** doubles and one IEEE multiply or divide rounds once (Clinger's fast
+** path); anything else goes through strtod.
+*/
+const char	*scan_double(const char *s, const char *end, double *out)
+{
+	static const double	pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+		1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18,
+		1e19, 1e20, 1e21, 1e22};
+	t_decimal			d;
+	const char			*p;
+	int					neg;
+
+	d = (t_decimal){0, 0, 0, 0, 0};
+	neg = (s < end && *s == '-');
+	s += (s < end && (*s == '-' || *s == '+'));
+	p = scan_digits(s, end, &d, 0);
+	if (p < end && *p == '.')
+		p = scan_digits(p + 1, end, &d, 1);
+	if (!d.seen)
+		return (NULL);
+	p = scan_exponent(p, end, &d);
+	if (d.mantissa == 0)
+		*out = 0.0;
+	else if (!d.inexact && d.mantissa <= (1ull << 53)
+		&& d.exp10 >= -22 && d.exp10 <= 22)
+	{
+		*out = (double)d.mantissa;
+		if (d.exp10 < 0)
+			*out /= pow10[-d.exp10];
+		else
+			*out *= pow10[d.exp10];
+	}
+	else if (!slow_path(s, p, out))
+		return (NULL);
+	if (neg)
+		*out = -*out;
+	return (p);
+}
+
+/*
+** Whole-token variant: fails unless all of `str` is one number.
+*/
+int	parse_double(const char *str, double *out)
+{
+	const char	*end;
+
+	end = str + ft_strlen(str);
+	return (scan_double(str, end, out) == end);
+}
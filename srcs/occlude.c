@@ -0,0 +1,83 @@
+#include "../includes/minirt.h"
+
+/*
+** Occlusion-only kernels for shadow rays. Each returns 1 as soon as any
+** intersection lies in (EPSILON, ray->t) and never writes ray->t.
+*/
+
+static int	in_range(t_ray *ray, double t)
+{
+	return (t > EPSILON && t < ray->t);
+}
+
+int	occlude_sphere(t_ray *ray, t_sphere sphere)
+{
+	t_vector	oc;
+	double		a;
+	double		b;
+	double		c;
+	double		discriminant;
+
+	oc = vec_sub(ray->origin, sphere.center);
+	a = vec_dot(ray->direction, ray->direction);
+	b = 2.0 * vec_dot(oc, ray->direction);
+	c = vec_dot(oc, oc) - sphere.radius * sphere.radius;
+	discriminant = b * b - 4 * a * c;
+	if (discriminant < 0)
+		return (0);
+	discriminant = sqrt(discriminant);
+	return (in_range(ray, (-b - discriminant) / (2.0 * a))
+		|| in_range(ray, (-b + discriminant) / (2.0 * a)));
+}
+
+int	occlude_plane(t_ray *ray, t_plane plane)
+{
+	double	denom;
+
+	denom = vec_dot(plane.normal, ray->direction);
+	if (fabs(denom) < EPSILON)
+		return (0);
+	return (in_range(ray,
+			vec_dot(vec_sub(plane.point, ray->origin), plane.normal) / denom));
+}
+
+int	occlude_triangle(t_ray *ray, t_triangle triangle)
+{
+	t_vector	h;
+	t_vector	s;
+	double		f;
+	double		u;
+	double		v;
+
+	h = vec_cross(ray->direction, triangle.edge2);
+	f = vec_dot(triangle.edge1, h);
+	if (f > -EPSILON && f < EPSILON)
+		return (0);
+	f = 1.0 / f;
+	s = vec_sub(ray->origin, triangle.v1);
+	u = f * vec_dot(s, h);
+	if (u < 0.0 || u > 1.0)
+		return (0);
+	h = vec_cross(s, triangle.edge1);
+	v = f * vec_dot(ray->direction, h);
+	if (v < 0.0 || u + v > 1.0)
+		return (0);
+	return (in_range(ray, f * vec_dot(triangle.edge2, h)));
+}
+
+int	occlude_object(t_ray *ray, t_object *obj)
+{
+	uint32_t	part;
+
+	if (obj->type == SPHERE)
+		return (occlude_sphere(ray, obj->sphere));
+	else if (obj->type == PLANE)
+		return (occlude_plane(ray, obj->plane));
+	else if (object_quadric(obj))
+		return (quadric_distance(object_quadric(obj), ray, &part) < ray->t);
+	else if (obj->type == TRIANGLE)
+		return (occlude_triangle(ray, obj->triangle));
+	else if (obj->type == MESH)
+		return (occlude_mesh(ray, &obj->mesh));
+	return (0);
+}
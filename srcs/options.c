@@ -0,0 +1,101 @@
+#include "../includes/minirt.h"
+
+static int	usage(void)
+{
+	ft_putstr_fd("Usage: ./minirt [-t|--threads N] [-s|--samples N] "
+		"[-o|--output file.png|.ppm] [--cache dir] [--sbvh] "
+		"scene.rt|scene.rtb\n"
+		"       ./minirt --compile scene.rt scene.rtb\n", 2);
+	return (0);
+}
+
+static int	default_threads(void)
+{
+	long	n;
+
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n < 1)
+		return (1);
+	if (n > MAX_THREADS)
+		return (MAX_THREADS);
+	return ((int)n);
+}
+
+static int	parse_count(int *out, char *value, int max)
+{
+	int	i;
+
+	if (!value || !value[0])
+		return (0);
+	i = 0;
+	while (ft_isdigit(value[i]))
+		i++;
+	if (value[i] || i > 4)
+		return (0);
+	*out = ft_atoi(value);
+	return (*out >= 1 && *out <= max);
+}
+
+int	is_compiled_path(char *path)
+{
+	char	*ext;
+
+	ext = ft_strrchr(path, '.');
+	return (ext && !ft_strcmp(ext, ".rtb"));
+}
+
+/*
+** Accepts the options in any order around the single scene path.
+*/
+int	parse_options(t_options *opts, int argc, char **argv)
+{
+	int	i;
+
+	*opts = (t_options){NULL, NULL, NULL, NULL, default_threads(), 0, 1};
+	i = 1;
+	while (i < argc)
+	{
+		if (!ft_strcmp(argv[i], "-t") || !ft_strcmp(argv[i], "--threads"))
+		{
+			if (!parse_count(&opts->threads, argv[++i], MAX_THREADS))
+				return (ft_putstr_fd("Error: Invalid thread count\n", 2), 0);
+		}
+		else if (!ft_strcmp(argv[i], "-s") || !ft_strcmp(argv[i], "--samples"))
+		{
+			if (!parse_count(&opts->samples, argv[++i], MAX_SAMPLES))
+				return (ft_putstr_fd("Error: Invalid sample count\n", 2), 0);
+		}
+		else if (!ft_strcmp(argv[i], "-o") || !ft_strcmp(argv[i], "--output"))
+		{
+			opts->output_path = argv[++i];
+			if (!opts->output_path || image_format(opts->output_path) == IMAGE_NONE)
+				return (ft_putstr_fd("Error: Output must be a .png or .ppm file\n",
+						2), 0);
+		}
+		else if (!ft_strcmp(argv[i], "--cache"))
+		{
+			opts->cache_dir = argv[++i];
+			if (!opts->cache_dir || !opts->cache_dir[0])
+				return (ft_putstr_fd("Error: Missing cache directory\n", 2), 0);
+		}
+		else if (!ft_strcmp(argv[i], "--sbvh"))
+			opts->sbvh = 1;
+		else if (!ft_strcmp(argv[i], "--compile") && !opts->scene_path
+			&& i + 2 < argc)
+		{
+			opts->scene_path = argv[++i];
+			opts->compile_path = argv[++i];
+			if (!is_compiled_path(opts->compile_path))
+				return (ft_putstr_fd("Error: Compiled scenes must be .rtb files\n",
+						2), 0);
+		}
+		else if (argv[i][0] == '-' || opts->scene_path)
+			return (usage());
+		else
+			opts->scene_path = argv[i];
+		i++;
+	}
+	if (!opts->scene_path)
+		return (usage());
+	return (1);
+}
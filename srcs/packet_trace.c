@@ -0,0 +1,101 @@
+#include "../includes/minirt.h"
+
+static uint32_t	trace_objects(t_scene *scene, t_packet *p, uint32_t *prims,
+		uint32_t count)
+{
+	uint32_t	mask;
+	uint32_t	i;
+	int			index;
+
+	mask = 0;
+	i = 0;
+	while (i < p->count)
+	{
+		index = -1;
+		if (p->active & (1u << i))
+			index = prims_intersect(scene, &p->rays[i], prims, count);
+		if (index >= 0)
+		{
+			p->hit[i] = index;
+			mask |= 1u << i;
+		}
+		i++;
+	}
+	return (mask);
+}
+
+static uint32_t	trace_mesh(t_scene *scene, t_packet *p, uint32_t id)
+{
+	uint32_t	mask;
+	uint32_t	i;
+
+	mask = intersect_mesh_packet(&scene->objects[id].mesh, p);
+	i = 0;
+	while (i < p->count)
+	{
+		if (mask & (1u << i))
+			p->hit[i] = id;
+		i++;
+	}
+	return (mask);
+}
+
+/*
+** Meshes are traced as packets, runs of other objects ray by ray.
+*/
+static uint32_t	packet_leaf(void *ctx, t_packet *p, uint32_t *prims,
+		uint32_t count)
+{
+	t_scene		*scene;
+	uint32_t	mask;
+	uint32_t	n;
+
+	scene = (t_scene *)ctx;
+	mask = 0;
+	while (count > 0)
+	{
+		n = 0;
+		while (n < count && scene->prims.type[prims[n]] != MESH)
+			n++;
+		if (n > 0)
+			mask |= trace_objects(scene, p, prims, n);
+		else
+			mask |= trace_mesh(scene, p, prims[n++]);
+		prims += n;
+		count -= n;
+	}
+	return (mask);
+}
+
+/*
+** scene_intersect for every ray of a packet, leaving the object each ray
+** hit in p->hit. Grid scenes and packets whose rays diverge are traced
+** ray by ray.
+*/
+void	scene_intersect_packet(t_scene *scene, t_packet *p)
+{
+	uint32_t	i;
+	int			index;
+
+	p->active = (1u << p->count) - 1;
+	if (scene->accel != ACCEL_GRID)
+	{
+		i = 0;
+		while (i < p->count)
+		{
+			p->hit[i] = prims_intersect(scene, &p->rays[i],
+					scene->bvh.unbounded, scene->bvh.unbounded_count);
+			i++;
+		}
+		if (bvh_intersect_packet(&scene->bvh, p, packet_leaf, scene) >= 0)
+			return ;
+	}
+	i = 0;
+	while (i < p->count)
+	{
+		index = scene_intersect(scene, &p->rays[i]);
+		if (index >= 0 || scene->accel == ACCEL_GRID)
+			p->hit[i] = index;
+		i++;
+	}
+}
@@ -17,11 +17,13 @@ int	parse_ambient(t_scene *scene, char **parts)
 	if (!parts[1] || !parts[2])
 		return (0);
 	
-	scene->ambient.ratio = ft_atof(parts[1]);
+	if (!parse_double(parts[1], &scene->ambient.ratio))
+		return (0);
 	if (scene->ambient.ratio < 0 || scene->ambient.ratio > 1)
 		return (0);
 	
-	scene->ambient.color = parse_color(parts[2]);
+	if (!parse_color(parts[2], &scene->ambient.color))
+		return (0);
 	return (1);
 }
 
@@ -30,15 +32,17 @@ int	parse_camera(t_scene *scene, char **parts)
 	if (!parts[1] || !parts[2] || !parts[3])
 		return (0);
 	
-	scene->camera.pos = parse_vector(parts[1]);
-	scene->camera.dir = parse_vector(parts[2]);
+	if (!parse_vector(parts[1], &scene->camera.pos)
+		|| !parse_vector(parts[2], &scene->camera.dir))
+		return (0);
 	
 	scene->camera.dir = vec_normalize(scene->camera.dir);
 	
 	if (scene->camera.dir.x == 0 && scene->camera.dir.y == 0 && scene->camera.dir.z == 0)
 		return (0);
 	
-	scene->camera.fov = ft_atof(parts[3]);
+	if (!parse_double(parts[3], &scene->camera.fov))
+		return (0);
 	if (scene->camera.fov <= 0 || scene->camera.fov >= 180)
 		return (0);
 	
@@ -51,19 +55,22 @@ int parse_light(t_scene *scene, char **parts)
     if (!parts[1] || !parts[2] || !parts[3] || scene->light_count >= 3)
         return (0);
     
-    scene->lights[scene->light_count].pos = parse_vector(parts[1]);
-    scene->lights[scene->light_count].brightness = ft_atof(parts[2]);
+    if (!parse_vector(parts[1], &scene->lights[scene->light_count].pos)
+        || !parse_double(parts[2], &scene->lights[scene->light_count].brightness))
+        return (0);
     
     if (scene->lights[scene->light_count].brightness < 0 || 
         scene->lights[scene->light_count].brightness > 1)
         return (0);
     
-    scene->lights[scene->light_count].color = parse_color(parts[3]);
+    if (!parse_color(parts[3], &scene->lights[scene->light_count].color))
+        return (0);
     
     scene->lights[scene->light_count].specular_exp = 32.0;
     
-    if (parts[4])
-        scene->lights[scene->light_count].specular_exp = ft_atof(parts[4]);
+    if (parts[4]
+        && !parse_double(parts[4], &scene->lights[scene->light_count].specular_exp))
+        return (0);
     
     scene->light_count++;
     return (1);
@@ -75,15 +82,17 @@ int	parse_sphere(t_scene *scene, char **parts)
 		return (0);
 	
 	scene->objects[scene->obj_count].type = SPHERE;
-	scene->objects[scene->obj_count].sphere.center = parse_vector(parts[1]);
-	scene->objects[scene->obj_count].sphere.diameter = ft_atof(parts[2]);
+	if (!parse_vector(parts[1], &scene->objects[scene->obj_count].sphere.center)
+		|| !parse_double(parts[2], &scene->objects[scene->obj_count].sphere.diameter))
+		return (0);
 	
 	if (scene->objects[scene->obj_count].sphere.diameter <= 0)
 		return (0);
 	
 	scene->objects[scene->obj_count].sphere.radius = 
 		scene->objects[scene->obj_count].sphere.diameter / 2.0;
-	scene->objects[scene->obj_count].color = parse_color(parts[3]);
+	if (!parse_color(parts[3], &scene->objects[scene->obj_count].color))
+		return (0);
 
 	if (parts[4])
 	{
@@ -107,8 +116,9 @@ int	parse_plane(t_scene *scene, char **parts)
 		return (0);
 	
 	scene->objects[scene->obj_count].type = PLANE;
-	scene->objects[scene->obj_count].plane.point = parse_vector(parts[1]);
-	scene->objects[scene->obj_count].plane.normal = parse_vector(parts[2]);
+	if (!parse_vector(parts[1], &scene->objects[scene->obj_count].plane.point)
+		|| !parse_vector(parts[2], &scene->objects[scene->obj_count].plane.normal))
+		return (0);
 	
 	// Normalize the normal vector
 	scene->objects[scene->obj_count].plane.normal = 
@@ -120,7 +130,8 @@ int	parse_plane(t_scene *scene, char **parts)
 		scene->objects[scene->obj_count].plane.normal.z == 0)
 		return (0);
 	
-	scene->objects[scene->obj_count].color = parse_color(parts[3]);
+	if (!parse_color(parts[3], &scene->objects[scene->obj_count].color))
+		return (0);
 
 	// Optional texture support
 	if (parts[4])
@@ -145,8 +156,9 @@ int	parse_cylinder(t_scene *scene, char **parts)
 		return (0);
 	
 	scene->objects[scene->obj_count].type = CYLINDER;
-	scene->objects[scene->obj_count].cylinder.center = parse_vector(parts[1]);
-	scene->objects[scene->obj_count].cylinder.axis = parse_vector(parts[2]);
+	if (!parse_vector(parts[1], &scene->objects[scene->obj_count].cylinder.center)
+		|| !parse_vector(parts[2], &scene->objects[scene->obj_count].cylinder.axis))
+		return (0);
 	
 	scene->objects[scene->obj_count].cylinder.axis = 
 		vec_normalize(scene->objects[scene->obj_count].cylinder.axis);
@@ -156,18 +168,21 @@ int	parse_cylinder(t_scene *scene, char **parts)
 		scene->objects[scene->obj_count].cylinder.axis.z == 0)
 		return (0);
 	
-	scene->objects[scene->obj_count].cylinder.diameter = ft_atof(parts[3]);
+	if (!parse_double(parts[3], &scene->objects[scene->obj_count].cylinder.diameter))
+		return (0);
 	if (scene->objects[scene->obj_count].cylinder.diameter <= 0)
 		return (0);
 	
 	scene->objects[scene->obj_count].cylinder.radius = 
 		scene->objects[scene->obj_count].cylinder.diameter / 2.0;
 	
-	scene->objects[scene->obj_count].cylinder.height = ft_atof(parts[4]);
+	if (!parse_double(parts[4], &scene->objects[scene->obj_count].cylinder.height))
+		return (0);
 	if (scene->objects[scene->obj_count].cylinder.height <= 0)
 		return (0);
 	
-	scene->objects[scene->obj_count].color = parse_color(parts[5]);
+	if (!parse_color(parts[5], &scene->objects[scene->obj_count].color))
+		return (0);
 
 	if (parts[6])
 	{
@@ -190,8 +205,9 @@ int parse_cone(t_scene *scene, char **parts)
         return (0);
     
     scene->objects[scene->obj_count].type = CONE;
-    scene->objects[scene->obj_count].cone.vertex = parse_vector(parts[1]);
-    scene->objects[scene->obj_count].cone.axis = parse_vector(parts[2]);
+    if (!parse_vector(parts[1], &scene->objects[scene->obj_count].cone.vertex)
+        || !parse_vector(parts[2], &scene->objects[scene->obj_count].cone.axis))
+        return (0);
     
     scene->objects[scene->obj_count].cone.axis = 
         vec_normalize(scene->objects[scene->obj_count].cone.axis);
@@ -201,17 +217,19 @@ int parse_cone(t_scene *scene, char **parts)
         scene->objects[scene->obj_count].cone.axis.z == 0)
         return (0);
     
-    double angle_deg = ft_atof(parts[3]);
-    if (angle_deg <= 0 || angle_deg >= 180)
+    double angle_deg;
+    if (!parse_double(parts[3], &angle_deg) || angle_deg <= 0 || angle_deg >= 180)
         return (0);
     
     scene->objects[scene->obj_count].cone.angle = (angle_deg * M_PI) / 180.0;
     
-    scene->objects[scene->obj_count].cone.height = ft_atof(parts[4]);
+    if (!parse_double(parts[4], &scene->objects[scene->obj_count].cone.height))
+        return (0);
     if (scene->objects[scene->obj_count].cone.height <= 0)
         return (0);
     
-    scene->objects[scene->obj_count].color = parse_color(parts[5]);
+    if (!parse_color(parts[5], &scene->objects[scene->obj_count].color))
+        return (0);
 
     if (parts[6])
     {
@@ -236,18 +254,22 @@ int parse_hyperboloid(t_scene *scene, char **parts)
         return (0);
     
     scene->objects[scene->obj_count].type = HYPERBOLOID;
-    scene->objects[scene->obj_count].hyperboloid.center = parse_vector(parts[1]);
-    scene->objects[scene->obj_count].hyperboloid.axis = vec_normalize(parse_vector(parts[2]));
+    if (!parse_vector(parts[1], &scene->objects[scene->obj_count].hyperboloid.center)
+        || !parse_vector(parts[2], &scene->objects[scene->obj_count].hyperboloid.axis))
+        return (0);
+    scene->objects[scene->obj_count].hyperboloid.axis =
+        vec_normalize(scene->objects[scene->obj_count].hyperboloid.axis);
 
     if (scene->objects[scene->obj_count].hyperboloid.axis.x == 0 && 
         scene->objects[scene->obj_count].hyperboloid.axis.y == 0 && 
         scene->objects[scene->obj_count].hyperboloid.axis.z == 0)
         return (0);
 
-    scene->objects[scene->obj_count].hyperboloid.a = ft_atof(parts[3]);
-    scene->objects[scene->obj_count].hyperboloid.b = ft_atof(parts[4]);
-    scene->objects[scene->obj_count].hyperboloid.c = ft_atof(parts[5]);
-    scene->objects[scene->obj_count].hyperboloid.height = ft_atof(parts[6]);
+    if (!parse_double(parts[3], &scene->objects[scene->obj_count].hyperboloid.a)
+        || !parse_double(parts[4], &scene->objects[scene->obj_count].hyperboloid.b)
+        || !parse_double(parts[5], &scene->objects[scene->obj_count].hyperboloid.c)
+        || !parse_double(parts[6], &scene->objects[scene->obj_count].hyperboloid.height))
+        return (0);
 
     if (scene->objects[scene->obj_count].hyperboloid.a <= 0 ||
         scene->objects[scene->obj_count].hyperboloid.b <= 0 ||
@@ -255,7 +277,8 @@ int parse_hyperboloid(t_scene *scene, char **parts)
         scene->objects[scene->obj_count].hyperboloid.height <= 0)
         return (0);
 
-    scene->objects[scene->obj_count].color = parse_color(parts[7]);
+    if (!parse_color(parts[7], &scene->objects[scene->obj_count].color))
+        return (0);
 
     // Optional texture support
     if (parts[8])
@@ -274,99 +297,104 @@ int parse_hyperboloid(t_scene *scene, char **parts)
 }
 
 
+/*
+** Cuts `line` in place on spaces into at most `max` tokens followed by a
+** NULL. Runs of spaces are a single separator, as with ft_split.
+*/
+static int	split_line(char *line, char **parts, int max)
+{
+	int	n;
+
+	n = 0;
+	while (*line && n < max)
+	{
+		while (*line == ' ')
+			*line++ = '\0';
+		if (!*line)
+			break ;
+		parts[n++] = line;
+		while (*line && *line != ' ')
+			line++;
+		if (*line)
+			*line++ = '\0';
+	}
+	parts[n] = NULL;
+	return (n);
+}
+
 int parse_line(t_scene *scene, char *line)
 {
-    char    **parts;
-    int     result;
-    int     i;
+    char    *parts[PARSE_MAX_TOKENS + 1];
+    int     compact;
 
     if (!line || line[0] == '#' || line[0] == '\0')
         return (1);
     
-    if (strstr(line, " bum:") || strstr(line, " txm:"))
-    {
-        parts = malloc(sizeof(char *) * 10);
-        if (!parts)
-            return (0);
-        
-        for (i = 0; i < 10; i++)
-            parts[i] = NULL;
-        
-        parts[0] = strtok(line, " "); 
-        if (parts[0] == NULL)
-        {
-            free(parts);
-            return (0);
-        }
-        
-        for (i = 1; i < 9; i++)
-        {
-            parts[i] = strtok(NULL, " ");
-            if (parts[i] == NULL)
-                break;
-        }
-        
-        if (ft_strncmp(parts[0], "sp", 3) == 0)
-            result = parse_sphere_compact(scene, parts);
-        else
-            result = 0;
-    }
-    else
+    // The compact sphere syntax keeps at most 9 tokens
+    compact = (strstr(line, " bum:") || strstr(line, " txm:"));
+    if (compact && split_line(line, parts, 9) == 0)
+        return (0);
+    if (compact)
+        return (ft_strncmp(parts[0], "sp", 3) == 0
+            && parse_sphere_compact(scene, parts));
+    if (split_line(line, parts, PARSE_MAX_TOKENS) == 0)
+        return (0);
+    
+    if (ft_strncmp(parts[0], "A", 2) == 0)
+        return (parse_ambient(scene, parts));
+    else if (ft_strncmp(parts[0], "C", 2) == 0)
+        return (parse_camera(scene, parts));
+    else if (ft_strncmp(parts[0], "L", 2) == 0)
+        return (parse_light(scene, parts));
+    else if (ft_strncmp(parts[0], "sp", 3) == 0)
+        return (parse_sphere(scene, parts));
+    else if (ft_strncmp(parts[0], "pl", 3) == 0)
+        return (parse_plane(scene, parts));
+    else if (ft_strncmp(parts[0], "cy", 3) == 0)
+        return (parse_cylinder(scene, parts));
+    else if (ft_strncmp(parts[0], "cn", 3) == 0)
+        return (parse_cone(scene, parts));
+    else if (ft_strncmp(parts[0], "hy", 3) == 0)
+        return (parse_hyperboloid(scene, parts));
+    else if (ft_strncmp(parts[0], "tr", 3) == 0)
+        return (parse_triangle(scene, parts));
+    else if (ft_strncmp(parts[0], "mesh", 5) == 0)
+        return (parse_mesh(scene, parts));
+    else if (ft_strncmp(parts[0], "accel", 6) == 0)
+        return (parse_accel(scene, parts));
+    else if (ft_strncmp(parts[0], "cb", 3) == 0)
     {
-        parts = ft_split(line, ' ');
-        if (!parts || !parts[0])
-        {
-            if (parts)
-                free(parts);
-            return (0);
-        }
-        
-        if (ft_strncmp(parts[0], "A", 2) == 0)
-            result = parse_ambient(scene, parts);
-        else if (ft_strncmp(parts[0], "C", 2) == 0)
-            result = parse_camera(scene, parts);
-        else if (ft_strncmp(parts[0], "L", 2) == 0)
-            result = parse_light(scene, parts);
-        else if (ft_strncmp(parts[0], "sp", 3) == 0)
-            result = parse_sphere(scene, parts);
-        else if (ft_strncmp(parts[0], "pl", 3) == 0)
-            result = parse_plane(scene, parts);
-        else if (ft_strncmp(parts[0], "cy", 3) == 0)
-            result = parse_cylinder(scene, parts);
-        else if (ft_strncmp(parts[0], "cn", 3) == 0)
-            result = parse_cone(scene, parts);
-        else if (ft_strncmp(parts[0], "hy", 3) == 0)
-            result = parse_hyperboloid(scene, parts);
-		else if (ft_strncmp(parts[0], "tr", 3) == 0)
-			result = parse_triangle(scene, parts);
-		
-        else if (ft_strncmp(parts[0], "cb", 3) == 0)
-        {
-            scene->checkerboard = 1;
-            result = 1;
-        }
-        else
-            result = 0;
-        
-        int i = 0;
-        while (parts[i])
-            free(parts[i++]);
-        free(parts);
+        scene->checkerboard = 1;
+        return (1);
     }
-    
-    return (result);
+    return (0);
 }
 
 int parse_triangle(t_scene *scene, char **parts)
 {
+    t_vector v[3];
+    t_color  color;
+
     if (!parts[1] || !parts[2] || !parts[3] || !parts[4] || scene->obj_count >= MAX_OBJECTS)
         return (0);
     
+    // Untextured triangles are folded into an indexed mesh
+    if (!parts[5])
+    {
+        if (!parse_vector(parts[1], &v[0])
+            || !parse_vector(parts[2], &v[1])
+            || !parse_vector(parts[3], &v[2])
+            || !parse_color(parts[4], &color))
+            return (0);
+        return (mesh_add_triangle(scene, v, color));
+    }
+    
     scene->objects[scene->obj_count].type = TRIANGLE;
-    scene->objects[scene->obj_count].triangle.v1 = parse_vector(parts[1]);
-    scene->objects[scene->obj_count].triangle.v2 = parse_vector(parts[2]);
-    scene->objects[scene->obj_count].triangle.v3 = parse_vector(parts[3]);
-    scene->objects[scene->obj_count].color = parse_color(parts[4]);
+    if (!parse_vector(parts[1], &scene->objects[scene->obj_count].triangle.v1)
+        || !parse_vector(parts[2], &scene->objects[scene->obj_count].triangle.v2)
+        || !parse_vector(parts[3], &scene->objects[scene->obj_count].triangle.v3)
+        || !parse_color(parts[4], &scene->objects[scene->obj_count].color))
+        return (0);
 
     t_vector e1 = vec_sub(scene->objects[scene->obj_count].triangle.v2, 
                            scene->objects[scene->obj_count].triangle.v1);
@@ -387,31 +415,88 @@ int parse_triangle(t_scene *scene, char **parts)
     return (1);
 }
 
+// mesh <file.obj|file.ply> <color> [position] [scale] [rotation in degrees]
+// Lines naming the same file share one copy of the mesh.
+int parse_mesh(t_scene *scene, char **parts)
+{
+    t_mesh      *mesh;
+    t_mesh_ref  *ref;
+    t_vector    position;
+    t_vector    rotation;
+    t_color     color;
+    double      scale;
+
+    if (!parts[1] || !parts[2])
+        return (0);
+    position = (t_vector){0, 0, 0};
+    rotation = (t_vector){0, 0, 0};
+    scale = 1.0;
+    if (!parse_color(parts[2], &color)
+        || (parts[3] && !parse_vector(parts[3], &position))
+        || (parts[3] && parts[4] && !parse_double(parts[4], &scale))
+        || (parts[3] && parts[4] && parts[5] && !parse_vector(parts[5], &rotation))
+        || scale <= 0)
+        return (0);
+    mesh = mesh_find(scene, parts[1]);
+    if (!mesh)
+    {
+        mesh = mesh_new(scene, color, 0);
+        if (!mesh || !load_mesh_file(mesh, parts[1]))
+            return (0);
+        mesh->path = ft_strdup(parts[1]);
+        if (!mesh->path)
+            return (0);
+        ref = &scene->objects[scene->obj_count - 1].mesh;
+    }
+    else
+        ref = mesh_instance(scene, mesh, color);
+    if (!ref)
+        return (0);
+    ref->xform = instance_xform(position, scale, rotation);
+    return (1);
+}
+
+// accel <auto|bvh|grid>
+int parse_accel(t_scene *scene, char **parts)
+{
+    if (!parts[1] || parts[2])
+        return (0);
+    if (ft_strncmp(parts[1], "auto", 5) == 0)
+        scene->accel = ACCEL_AUTO;
+    else if (ft_strncmp(parts[1], "bvh", 4) == 0)
+        scene->accel = ACCEL_BVH;
+    else if (ft_strncmp(parts[1], "grid", 5) == 0)
+        scene->accel = ACCEL_GRID;
+    else
+        return (0);
+    return (1);
+}
+
 int parse_sphere_compact(t_scene *scene, char **parts)
 {
     char *texture_path = NULL;
-    char *bump_path = NULL;
     
     if (!parts[1] || !parts[2] || !parts[3] || scene->obj_count >= MAX_OBJECTS)
         return (0);
     
     scene->objects[scene->obj_count].type = SPHERE;
-    scene->objects[scene->obj_count].sphere.center = parse_vector(parts[1]);
-    scene->objects[scene->obj_count].sphere.diameter = ft_atof(parts[2]);
+    if (!parse_vector(parts[1], &scene->objects[scene->obj_count].sphere.center)
+        || !parse_double(parts[2], &scene->objects[scene->obj_count].sphere.diameter))
+        return (0);
     
     if (scene->objects[scene->obj_count].sphere.diameter <= 0)
         return (0);
     
     scene->objects[scene->obj_count].sphere.radius = 
         scene->objects[scene->obj_count].sphere.diameter / 2.0;
-    scene->objects[scene->obj_count].color = parse_color(parts[3]);
+    if (!parse_color(parts[3], &scene->objects[scene->obj_count].color))
+        return (0);
 
     for (int i = 4; parts[i] != NULL; i++)
     {
+        // bum: maps are found by load_texture as <texture>_bump.png
         if (ft_strncmp(parts[i], "txm:", 4) == 0)
             texture_path = parts[i] + 4;
-        else if (ft_strncmp(parts[i], "bum:", 4) == 0)
-            bump_path = parts[i] + 4;
     }
 
     if (texture_path)
@@ -427,36 +512,59 @@ int parse_sphere_compact(t_scene *scene, char **parts)
     return (1);
 }
 
-int	read_map(t_scene *scene, int fd)
+/*
+** A last line without a newline is copied out: the byte after it may lie
+** past the end of the mapping.
+*/
+static int	parse_last_line(t_scene *scene, char *line, size_t len)
 {
-	char	*line;
+	char	*copy;
+	int		ok;
+
+	copy = malloc(len + 1);
+	if (!copy)
+		return (0);
+	ft_memcpy(copy, line, len);
+	copy[len] = '\0';
+	ok = parse_line(scene, copy);
+	free(copy);
+	return (ok);
+}
 
-	while (1)
+/*
+** The scene is mapped privately and writable, so parse_line cuts lines and
+** tokens in place and nothing is allocated per line or per token.
+*/
+int	read_map(t_scene *scene, char *path)
+{
+	t_mapped_file	file;
+	char			*line;
+	char			*nl;
+	int				ok;
+
+	if (!map_file(path, &file, 1))
+		return (ft_putstr_fd("Error: Could not open file\n", 2), 0);
+	ok = 1;
+	line = file.data;
+	while (ok && line < file.data + file.size)
 	{
-		line = get_next_line(fd);
-		if (!line)
-			break;
-		
-		int len = ft_strlen(line);
-		if (len > 0 && line[len - 1] == '\n')
-			line[len - 1] = '\0';
-		
-		if (!parse_line(scene, line))
+		nl = ft_memchr(line, '\n', file.data + file.size - line);
+		if (!nl)
 		{
-			free(line);
-			close(fd);
-			ft_putstr_fd("Error: Invalid scene file format\n", 2);
-			return (0);
+			ok = parse_last_line(scene, line, file.data + file.size - line);
+			break ;
 		}
-		free(line);
+		*nl = '\0';
+		ok = parse_line(scene, line);
+		line = nl + 1;
 	}
-	close(fd);
-	
+	unmap_file(&file);
+	if (!ok)
+		return (ft_putstr_fd("Error: Invalid scene file format\n", 2), 0);
 	if (scene->obj_count == 0)
 	{
 		ft_putstr_fd("Error: No objects in scene\n", 2);
 		return (0);
 	}
 	return (1);
-
 }
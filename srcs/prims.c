@@ -0,0 +1,149 @@
+#include "../includes/minirt.h"
+
+static void	carve_quadrics(t_prims *p, double *d, size_t n[3])
+{
+	int	k;
+
+	k = -1;
+	while (++k < QUADRIC_FIELDS)
+		p->quadrics.f[k] = d + k * n[2];
+	p->quadrics.id = p->spheres.id + n[0] + n[1];
+}
+
+/*
+** Carves the sphere, plane and quadric streams out of one block of
+** doubles; n holds how many of each there are.
+*/
+static int	alloc_streams(t_prims *p, size_t objs, size_t n[3])
+{
+	double	*d;
+
+	p->type = malloc(objs + 1);
+	p->slot = malloc(sizeof(uint32_t) * (objs + 1));
+	p->data = malloc(sizeof(double)
+			* (4 * n[0] + 6 * n[1] + QUADRIC_FIELDS * n[2] + 1));
+	p->spheres.id = malloc(sizeof(uint32_t) * (n[0] + n[1] + n[2] + 1));
+	if (!p->type || !p->slot || !p->data || !p->spheres.id)
+		return (0);
+	d = p->data;
+	p->spheres.x = d;
+	p->spheres.y = d + n[0];
+	p->spheres.z = d + 2 * n[0];
+	p->spheres.r2 = d + 3 * n[0];
+	d += 4 * n[0];
+	p->planes.px = d;
+	p->planes.py = d + n[1];
+	p->planes.pz = d + 2 * n[1];
+	p->planes.nx = d + 3 * n[1];
+	p->planes.ny = d + 4 * n[1];
+	p->planes.nz = d + 5 * n[1];
+	p->planes.id = p->spheres.id + n[0];
+	carve_quadrics(p, d + 6 * n[1], n);
+	return (1);
+}
+
+/*
+** Copies the parameters of object `id` into its stream entry.
+*/
+void	prims_update(t_scene *scene, uint32_t id)
+{
+	t_prims		*p;
+	t_object	*obj;
+	uint32_t	s;
+
+	p = &scene->prims;
+	obj = &scene->objects[id];
+	s = 0;
+	if (obj->type == SPHERE || obj->type == PLANE || object_quadric(obj))
+		s = p->slot[id];
+	if (object_quadric(obj))
+		quadric_store(&p->quadrics, s, object_quadric(obj));
+	else if (obj->type == SPHERE)
+	{
+		p->spheres.x[s] = obj->sphere.center.x;
+		p->spheres.y[s] = obj->sphere.center.y;
+		p->spheres.z[s] = obj->sphere.center.z;
+		p->spheres.r2[s] = obj->sphere.radius * obj->sphere.radius;
+	}
+	else if (obj->type == PLANE)
+	{
+		p->planes.px[s] = obj->plane.point.x;
+		p->planes.py[s] = obj->plane.point.y;
+		p->planes.pz[s] = obj->plane.point.z;
+		p->planes.nx[s] = obj->plane.normal.x;
+		p->planes.ny[s] = obj->plane.normal.y;
+		p->planes.nz[s] = obj->plane.normal.z;
+	}
+}
+
+static void	add_prims(t_scene *scene, uint32_t *ids, size_t count)
+{
+	t_prims		*p;
+	uint32_t	id;
+	size_t		i;
+
+	p = &scene->prims;
+	i = 0;
+	while (i < count)
+	{
+		id = ids[i++];
+		p->type[id] = scene->objects[id].type;
+		if (p->type[id] == SPHERE)
+		{
+			p->slot[id] = p->spheres.count;
+			p->spheres.id[p->spheres.count++] = id;
+		}
+		else if (p->type[id] == PLANE)
+		{
+			p->slot[id] = p->planes.count;
+			p->planes.id[p->planes.count++] = id;
+		}
+		else if (object_quadric(&scene->objects[id]))
+		{
+			p->slot[id] = p->quadrics.count;
+			p->quadrics.id[p->quadrics.count++] = id;
+		}
+		prims_update(scene, id);
+	}
+}
+
+/*
+** Lays the streams out in the order the scene hierarchy or grid lists the
+** objects, then the unbounded ones. Runs once the hierarchies are built and
+** again whenever the scene hierarchy is replaced.
+*/
+int	build_prims(t_scene *scene)
+{
+	size_t	n[3];
+	size_t	i;
+
+	free_prims(&scene->prims);
+	n[0] = 0;
+	n[1] = 0;
+	n[2] = 0;
+	i = 0;
+	while (i < scene->obj_count)
+	{
+		n[0] += scene->objects[i].type == SPHERE;
+		n[1] += scene->objects[i].type == PLANE;
+		n[2] += object_quadric(&scene->objects[i++]) != NULL;
+	}
+	if (!alloc_streams(&scene->prims, scene->obj_count, n))
+	{
+		free_prims(&scene->prims);
+		return (ft_putstr_fd("Error: Memory allocation failed\n", 2), 0);
+	}
+	add_prims(scene, scene->bvh.prims, scene->bvh.prim_count);
+	add_prims(scene, scene->bvh.unbounded, scene->bvh.unbounded_count);
+	scene->prims.avx2 = simd_avx2();
+	return (1);
+}
+
+void	free_prims(t_prims *p)
+{
+	free(p->type);
+	free(p->slot);
+	free(p->data);
+	free(p->spheres.id);
+	*p = (t_prims){0};
+}
@@ -0,0 +1,148 @@
+#include "../includes/minirt.h"
+
+/*
+** Distance to each plane of the run past EPSILON, or INFINITY when the ray
+** runs parallel to it.
+*/
+static void	plane_roots(t_plane_soa *p, t_ray *ray, t_prim_run *run)
+{
+	t_vector	o;
+	t_vector	d;
+	double		denom;
+	double		t;
+	uint32_t	i;
+
+	o = ray->origin;
+	d = ray->direction;
+	i = 0;
+	while (i < run->count)
+	{
+		denom = p->nx[run->first + i] * d.x + p->ny[run->first + i] * d.y
+			+ p->nz[run->first + i] * d.z;
+		t = ((p->px[run->first + i] - o.x) * p->nx[run->first + i]
+				+ (p->py[run->first + i] - o.y) * p->ny[run->first + i]
+				+ (p->pz[run->first + i] - o.z) * p->nz[run->first + i])
+			/ denom;
+		run->t[i] = (fabs(denom) < EPSILON || !(t > EPSILON)) ? INFINITY : t;
+		i++;
+	}
+}
+
+/*
+** The stream objects of `type` live in. Cylinders, cones and hyperboloids
+** share one.
+*/
+static t_stream	prim_stream(uint8_t type)
+{
+	if (type == SPHERE)
+		return (STREAM_SPHERES);
+	if (type == PLANE)
+		return (STREAM_PLANES);
+	if (type == CYLINDER || type == CONE || type == HYPERBOLOID)
+		return (STREAM_QUADRICS);
+	return (STREAM_NONE);
+}
+
+/*
+** How many of `ids` from the first on are objects of one stream with
+** consecutive entries, up to PRIM_CHUNK. Other objects go one by one.
+*/
+static t_stream	prim_run(t_prims *p, uint32_t *ids, uint32_t count,
+		t_prim_run *run)
+{
+	t_stream	stream;
+
+	stream = prim_stream(p->type[ids[0]]);
+	run->first = 0;
+	run->count = 1;
+	if (stream == STREAM_NONE)
+		return (stream);
+	run->first = p->slot[ids[0]];
+	while (run->count < count && run->count < PRIM_CHUNK
+		&& prim_stream(p->type[ids[run->count]]) == stream
+		&& p->slot[ids[run->count]] == run->first + run->count)
+		run->count++;
+	return (stream);
+}
+
+static void	run_roots(t_prims *p, t_ray *ray, t_stream stream,
+		t_prim_run *run)
+{
+	if (stream == STREAM_SPHERES)
+		sphere_roots(&p->spheres, ray, run, p->avx2);
+	else if (stream == STREAM_PLANES)
+		plane_roots(&p->planes, ray, run);
+	else
+		quadric_roots(&p->quadrics, ray, run, p->avx2);
+}
+
+/*
+** Nearest-hit test of objects `ids`, streamed types a run at a time and
+** the others through intersect_object. Shrinks ray->t, leaves the part a
+** quadric was hit on in ray->prim, and returns the id of the nearest
+** object hit, or -1.
+*/
+int	prims_intersect(t_scene *scene, t_ray *ray, uint32_t *ids, uint32_t count)
+{
+	t_prim_run	run;
+	t_stream	stream;
+	uint32_t	i;
+	int			hit;
+
+	hit = -1;
+	while (count > 0)
+	{
+		stream = prim_run(&scene->prims, ids, count, &run);
+		if (stream == STREAM_NONE && intersect_object(ray,
+				&scene->objects[ids[0]]))
+			hit = ids[0];
+		else if (stream != STREAM_NONE)
+		{
+			run_roots(&scene->prims, ray, stream, &run);
+			i = -1;
+			while (++i < run.count)
+			{
+				if (!(run.t[i] < ray->t))
+					continue ;
+				ray->t = run.t[i];
+				if (stream == STREAM_QUADRICS)
+					ray->prim = run.part[i];
+				hit = ids[i];
+			}
+		}
+		ids += run.count;
+		count -= run.count;
+	}
+	return (hit);
+}
+
+/*
+** Any-hit test of objects `ids` for shadow rays.
+*/
+int	prims_occluded(t_scene *scene, t_ray *ray, uint32_t *ids, uint32_t count)
+{
+	t_prim_run	run;
+	t_stream	stream;
+	uint32_t	i;
+
+	while (count > 0)
+	{
+		stream = prim_run(&scene->prims, ids, count, &run);
+		if (stream == STREAM_NONE)
+		{
+			if (occlude_object(ray, &scene->objects[ids[0]]))
+				return (1);
+		}
+		else
+		{
+			run_roots(&scene->prims, ray, stream, &run);
+			i = 0;
+			while (i < run.count)
+				if (run.t[i++] < ray->t)
+					return (1);
+		}
+		ids += run.count;
+		count -= run.count;
+	}
+	return (0);
+}
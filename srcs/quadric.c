@@ -0,0 +1,145 @@
+#include "../includes/minirt.h"
+
+t_quadric	*object_quadric(t_object *obj)
+{
+	if (obj->type == CYLINDER)
+		return (&obj->cylinder.quadric);
+	if (obj->type == CONE)
+		return (&obj->cone.quadric);
+	if (obj->type == HYPERBOLOID)
+		return (&obj->hyperboloid.quadric);
+	return (NULL);
+}
+
+/*
+** The ray in the quadric's frame: od[0] the origin, od[1] the direction.
+** The frame is a rotation, so distances along the ray are unchanged.
+*/
+static void	quadric_frame(t_quadric *q, t_ray *ray, double od[2][3])
+{
+	t_vector	rel;
+	t_vector	*row;
+	int			k;
+
+	rel = vec_sub(ray->origin, q->frame.offset);
+	k = -1;
+	while (++k < 3)
+	{
+		row = &q->frame.inv[k];
+		od[0][k] = row->x * rel.x + row->y * rel.y + row->z * rel.z;
+		od[1][k] = row->x * ray->direction.x + row->y * ray->direction.y
+			+ row->z * ray->direction.z;
+	}
+}
+
+static double	quadric_form(double coef[4], double u[3], double v[3])
+{
+	return (coef[0] * u[0] * v[0] + coef[1] * u[1] * v[1]
+		+ coef[2] * u[2] * v[2]);
+}
+
+/*
+** Root t of the side if it lies past EPSILON, within the slab and within
+** the clip radius, INFINITY otherwise.
+*/
+static double	side_root(t_quadric *q, double od[2][3], double t)
+{
+	double	p[3];
+	int		k;
+
+	k = -1;
+	while (++k < 3)
+		p[k] = od[0][k] + t * od[1][k];
+	if (t > EPSILON && p[2] >= q->slab[0] && p[2] <= q->slab[1]
+		&& p[0] * p[0] + p[1] * p[1] + p[2] * p[2] <= q->clip2)
+		return (t);
+	return (INFINITY);
+}
+
+/*
+** Distance to the cap at height z if the ray crosses it past EPSILON and
+** inside the surface, INFINITY otherwise.
+*/
+static double	cap_root(t_quadric *q, double od[2][3], double z)
+{
+	double	p[3];
+	double	t;
+
+	if (fabs(od[1][2]) < EPSILON)
+		return (INFINITY);
+	t = (z - od[0][2]) / od[1][2];
+	p[0] = od[0][0] + t * od[1][0];
+	p[1] = od[0][1] + t * od[1][1];
+	p[2] = z;
+	if (t > EPSILON && quadric_form(q->coef, p, p) + q->coef[3] <= 0)
+		return (t);
+	return (INFINITY);
+}
+
+/*
+** The smallest of the two side roots and the two cap distances, first
+** one on ties.
+*/
+static double	nearest_root(double t[4], uint32_t *part)
+{
+	static const uint32_t	parts[4] = {PART_SIDE, PART_SIDE, PART_NEAR_CAP,
+		PART_FAR_CAP};
+	double					best;
+	int						i;
+
+	best = INFINITY;
+	i = -1;
+	while (++i < 4)
+	{
+		if (t[i] < best)
+		{
+			best = t[i];
+			*part = parts[i];
+		}
+	}
+	return (best);
+}
+
+/*
+** Nearest hit past EPSILON on the side or caps of `q`, or INFINITY, with
+** the part it lies on in `part`. The side roots come from the stable form
+** of the quadratic formula. quadric_roots runs the same operations on
+** whole runs of quadrics.
+*/
+double	quadric_distance(t_quadric *q, t_ray *ray, uint32_t *part)
+{
+	double	od[2][3];
+	double	abc[3];
+	double	t[4];
+	double	best;
+
+	quadric_frame(q, ray, od);
+	abc[0] = quadric_form(q->coef, od[1], od[1]);
+	abc[1] = quadric_form(q->coef, od[0], od[1]);
+	abc[2] = quadric_form(q->coef, od[0], od[0]) + q->coef[3];
+	best = abc[1] * abc[1] - abc[0] * abc[2];
+	if (best < 0)
+		return (INFINITY);
+	best = -(abc[1] + copysign(sqrt(best), abc[1]));
+	t[0] = best / abc[0];
+	t[1] = abc[2] / best;
+	best = t[0];
+	t[0] = side_root(q, od, (best < t[1]) ? best : t[1]);
+	t[1] = side_root(q, od, (best > t[1]) ? best : t[1]);
+	t[2] = cap_root(q, od, q->cap[0]);
+	t[3] = cap_root(q, od, q->cap[1]);
+	return (nearest_root(t, part));
+}
+
+int	intersect_quadric(t_ray *ray, t_quadric *q)
+{
+	double		t;
+	uint32_t	part;
+
+	t = quadric_distance(q, ray, &part);
+	if (!(t < ray->t))
+		return (0);
+	ray->t = t;
+	ray->prim = part;
+	return (1);
+}
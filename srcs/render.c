@@ -0,0 +1,242 @@
+#include "../includes/minirt.h"
+
+/*
+** Traces the primary rays of the PACKET_SIDE square at (x0, y0) of the
+** tile together, then shades them one by one into the tile's sums.
+*/
+static void	render_packet(t_renderer *r, t_tile *t, size_t x0, size_t y0)
+{
+	t_packet	p;
+	size_t		x;
+	size_t		y;
+	uint32_t	c;
+
+	p.count = 0;
+	y = y0 - 1;
+	while (++y < y0 + PACKET_SIDE && y < t->h)
+	{
+		x = x0 - 1;
+		while (++x < x0 + PACKET_SIDE && x < t->w)
+			p.rays[p.count++] = (t_ray){r->view.origin,
+				camera_dir(&r->view, t, x, y), INFINITY, 0};
+	}
+	scene_intersect_packet(r->scene, &p);
+	p.count = 0;
+	y = y0 - 1;
+	while (++y < y0 + PACKET_SIDE && y < t->h)
+	{
+		x = x0 - 1;
+		while (++x < x0 + PACKET_SIDE && x < t->w)
+		{
+			c = ray_get_color(r->scene, &p.rays[p.count], p.hit[p.count]);
+			t->sum[y * RENDER_TILE + x][0] += c >> 24;
+			t->sum[y * RENDER_TILE + x][1] += (c >> 16) & 0xFF;
+			t->sum[y * RENDER_TILE + x][2] += (c >> 8) & 0xFF;
+			p.count++;
+		}
+	}
+}
+
+/*
+** Writes the average of the samples of each pixel of the tile, rounded.
+*/
+static void	tile_pixels(t_renderer *r, t_tile *t)
+{
+	uint32_t	n;
+	uint32_t	*sum;
+	size_t		x;
+	size_t		y;
+
+	n = r->view.samples;
+	y = 0;
+	while (y < t->h)
+	{
+		x = 0;
+		while (x < t->w)
+		{
+			sum = t->sum[y * RENDER_TILE + x];
+			r->pixels[(t->y0 + y) * r->scene->canvas.w + t->x0 + x]
+				= ((sum[0] + n / 2) / n) << 24
+				| ((sum[1] + n / 2) / n) << 16
+				| ((sum[2] + n / 2) / n) << 8 | 255;
+			x++;
+		}
+		y++;
+	}
+}
+
+static void	render_tile(t_renderer *r, uint32_t tile)
+{
+	t_tile	t;
+	size_t	x;
+	size_t	y;
+	int		sample;
+
+	t.x0 = (tile % r->tiles_x) * RENDER_TILE;
+	t.y0 = (tile / r->tiles_x) * RENDER_TILE;
+	t.w = r->scene->canvas.w - t.x0;
+	if (t.w > RENDER_TILE)
+		t.w = RENDER_TILE;
+	t.h = r->scene->canvas.h - t.y0;
+	if (t.h > RENDER_TILE)
+		t.h = RENDER_TILE;
+	ft_bzero(t.sum, sizeof(t.sum));
+	sample = -1;
+	while (++sample < r->view.samples)
+	{
+		camera_tile(&r->view, &t, sample);
+		y = 0;
+		while (y < t.h)
+		{
+			x = 0;
+			while (x < t.w)
+			{
+				render_packet(r, &t, x, y);
+				x += PACKET_SIDE;
+			}
+			y += PACKET_SIDE;
+		}
+	}
+	tile_pixels(r, &t);
+}
+
+/*
+** The owner takes tiles from the bottom of its own deque, thieves take
+** them from the top, so a steal never competes with the owner for the same
+** end unless a single tile is left.
+*/
+static int	pop_tile(t_tile_deque *deque, uint32_t *tile, int steal)
+{
+	int	found;
+
+	pthread_mutex_lock(&deque->lock);
+	found = deque->top < deque->bottom;
+	if (found && steal)
+		*tile = deque->tiles[deque->top++];
+	else if (found)
+		*tile = deque->tiles[--deque->bottom];
+	pthread_mutex_unlock(&deque->lock);
+	return (found);
+}
+
+static int	steal_tile(t_renderer *r, int self, uint32_t *tile)
+{
+	int	i;
+
+	i = 1;
+	while (i < r->threads)
+	{
+		if (pop_tile(&r->deques[(self + i) % r->threads], tile, 1))
+			return (1);
+		i++;
+	}
+	return (0);
+}
+
+/*
+** No tile is ever pushed once rendering started, so a worker that finds
+** its own deque and every other deque empty is done.
+*/
+static void	*render_worker(void *param)
+{
+	t_worker	*worker;
+	uint32_t	tile;
+
+	worker = (t_worker *)param;
+	while (pop_tile(&worker->renderer->deques[worker->id], &tile, 0)
+		|| steal_tile(worker->renderer, worker->id, &tile))
+		render_tile(worker->renderer, tile);
+	return (NULL);
+}
+
+/*
+** Hands each thread a contiguous run of tiles so that neighbouring tiles
+** start out on the same core.
+*/
+static int	init_deques(t_renderer *r, uint32_t *tiles)
+{
+	size_t	count;
+	size_t	i;
+
+	count = r->tiles_x * r->tiles_y;
+	i = 0;
+	while (i < count)
+	{
+		tiles[i] = i;
+		i++;
+	}
+	i = 0;
+	while (i < (size_t)r->threads)
+	{
+		r->deques[i].tiles = tiles;
+		r->deques[i].top = count * i / r->threads;
+		r->deques[i].bottom = count * (i + 1) / r->threads;
+		if (pthread_mutex_init(&r->deques[i].lock, NULL) != 0)
+			break ;
+		i++;
+	}
+	if (i == (size_t)r->threads)
+		return (1);
+	while (i-- > 0)
+		pthread_mutex_destroy(&r->deques[i].lock);
+	return (0);
+}
+
+static void	run_workers(t_renderer *r, t_worker *workers)
+{
+	int	i;
+
+	i = 0;
+	while (i < r->threads)
+	{
+		workers[i] = (t_worker){r, i, 0, 0};
+		if (i > 0)
+			workers[i].started = (pthread_create(&workers[i].thread, NULL,
+						render_worker, &workers[i]) == 0);
+		i++;
+	}
+	render_worker(&workers[0]);
+	i = 0;
+	while (++i < r->threads)
+		if (workers[i].started)
+			pthread_join(workers[i].thread, NULL);
+	i = 0;
+	while (i < r->threads)
+		pthread_mutex_destroy(&r->deques[i++].lock);
+}
+
+/*
+** Renders the whole canvas into `pixels` (RGBA, row-major) on `threads`
+** threads, averaging `samples` jittered samples per pixel. The calling
+** thread is worker 0; if a worker cannot be spawned, its tiles are simply
+** stolen by the others.
+*/
+int	render_frame(t_scene *scene, uint32_t *pixels, int threads,
+		int samples)
+{
+	t_renderer	r;
+	t_worker	*workers;
+	uint32_t	*tiles;
+
+	r = (t_renderer){.scene = scene, .pixels = pixels, .threads = threads,
+		.tiles_x = (scene->canvas.w + RENDER_TILE - 1) / RENDER_TILE,
+		.tiles_y = (scene->canvas.h + RENDER_TILE - 1) / RENDER_TILE};
+	camera_view(&r.view, scene, samples);
+	if (r.threads < 1)
+		r.threads = 1;
+	r.deques = malloc(sizeof(t_tile_deque) * r.threads);
+	workers = malloc(sizeof(t_worker) * r.threads);
+	tiles = malloc(sizeof(uint32_t) * r.tiles_x * r.tiles_y);
+	if (!r.deques || !workers || !tiles || !init_deques(&r, tiles))
+	{
+		free(r.deques);
+		free(workers);
+		free(tiles);
+		return (ft_putstr_fd("Error: Could not start renderer\n", 2), 0);
+	}
+	run_workers(&r, workers);
+	free(r.deques);
+	free(workers);
+	free(tiles);
+	return (1);
+}
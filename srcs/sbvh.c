@@ -0,0 +1,262 @@
+#include "../includes/minirt.h"
+
+static int	alloc_sides(t_sbvh_refs *in, t_sbvh_refs side[2])
+{
+	side[0] = (t_sbvh_refs){malloc(sizeof(t_sbvh_ref) * in->count), 0,
+		in->depth + 1, 0};
+	side[1] = (t_sbvh_refs){malloc(sizeof(t_sbvh_ref) * in->count), 0,
+		in->depth + 1, 0};
+	if (side[0].refs && side[1].refs)
+		return (1);
+	free(side[0].refs);
+	free(side[1].refs);
+	return (0);
+}
+
+/*
+** Whatever budget the split did not use is shared between the children in
+** proportion to their references, so that it is not all spent near the
+** root.
+*/
+static void	share_budget(t_sbvh_refs *in, t_sbvh_refs side[2])
+{
+	size_t	left;
+	size_t	total;
+
+	total = side[0].count + side[1].count;
+	left = in->budget - (total - in->count);
+	side[0].budget = left * side[0].count / total;
+	side[1].budget = left * side[1].count / total;
+}
+
+/*
+** Cuts the references at the centroid median of the widest axis; used past
+** BVH_MEDIAN_DEPTH and when no plane separates them.
+*/
+static int	median_split(t_sbvh_refs *in, t_sbvh_split *split,
+		t_sbvh_refs side[2])
+{
+	t_bvh_key	*keys;
+	t_vector	d;
+	int			axis;
+	uint32_t	i;
+
+	keys = malloc(sizeof(t_bvh_key) * in->count);
+	if (!keys || !alloc_sides(in, side))
+		return (free(keys), 0);
+	d = vec_sub(split->r.cbounds.max, split->r.cbounds.min);
+	axis = (d.y > d.x);
+	if (d.z > vec_axis(d, axis))
+		axis = 2;
+	i = 0;
+	while (i < in->count)
+	{
+		keys[i].key = vec_axis(aabb_centroid(in->refs[i].box), axis);
+		keys[i].prim = i;
+		i++;
+	}
+	qsort(keys, in->count, sizeof(t_bvh_key), bvh_compare_keys);
+	i = 0;
+	while (i < in->count)
+	{
+		if (i < in->count / 2)
+			side[0].refs[side[0].count++] = in->refs[keys[i].prim];
+		else
+			side[1].refs[side[1].count++] = in->refs[keys[i].prim];
+		i++;
+	}
+	free(keys);
+	return (1);
+}
+
+/*
+** References entirely on one side of the plane go there; the others are
+** cut in two. Fails if rounding made the cut duplicate more than the budget
+** allows or left a side empty.
+*/
+static int	spatial_partition(t_sbvh *s, t_sbvh_refs *in, t_sbvh_split *split,
+		t_sbvh_refs side[2])
+{
+	t_sbvh_ref	piece[2];
+	t_sbvh_ref	*ref;
+	uint32_t	i;
+	int			sides;
+
+	if (!alloc_sides(in, side))
+		return (0);
+	i = 0;
+	while (i < in->count)
+	{
+		ref = &in->refs[i++];
+		if (vec_axis(ref->box.max, split->plane.axis) <= split->plane.pos)
+			side[0].refs[side[0].count++] = *ref;
+		else if (vec_axis(ref->box.min, split->plane.axis) >= split->plane.pos)
+			side[1].refs[side[1].count++] = *ref;
+		else
+		{
+			sides = sbvh_split_ref(s, ref, split->plane, piece);
+			if (sides & 1)
+				side[0].refs[side[0].count++] = piece[0];
+			if (sides & 2)
+				side[1].refs[side[1].count++] = piece[1];
+		}
+	}
+	if (side[0].count > 0 && side[1].count > 0
+		&& side[0].count + side[1].count - in->count <= in->budget)
+		return (1);
+	free(side[0].refs);
+	free(side[1].refs);
+	return (0);
+}
+
+static int	object_partition(t_sbvh_refs *in, t_sbvh_split *split,
+		t_sbvh_refs side[2])
+{
+	uint32_t	i;
+
+	if (!alloc_sides(in, side))
+		return (0);
+	i = 0;
+	while (i < in->count)
+	{
+		if (bvh_bin_of(&split->r, aabb_centroid(in->refs[i].box), split->axis)
+			< split->bin)
+			side[0].refs[side[0].count++] = in->refs[i];
+		else
+			side[1].refs[side[1].count++] = in->refs[i];
+		i++;
+	}
+	return (1);
+}
+
+static double	overlap_area(t_aabb a, t_aabb b)
+{
+	t_aabb	box;
+
+	box = aabb_intersection(a, b);
+	if (box.max.x < box.min.x || box.max.y < box.min.y
+		|| box.max.z < box.min.z)
+		return (0.0);
+	return (aabb_area(box));
+}
+
+/*
+** Picks the cheaper of the best object and, when the object children
+** overlap enough to be worth it, spatial split. Returns 0 to keep a leaf.
+** Past BVH_MEDIAN_DEPTH only median splits are made, as in bvh_build.
+*/
+static int	split_node(t_sbvh *s, t_sbvh_refs *in, t_aabb bounds,
+		t_sbvh_refs side[2])
+{
+	t_sbvh_split	split;
+	t_aabb			child[2];
+	int				k;
+
+	split.bin = 0;
+	sbvh_object_split(in, bounds, &split);
+	if (in->depth >= BVH_MEDIAN_DEPTH)
+		return (median_split(in, &split, side));
+	if (split.bin > 0)
+	{
+		child[0] = aabb_empty();
+		child[1] = aabb_empty();
+		k = -1;
+		while (++k < BVH_BINS)
+			if (split.r.bins.count[split.axis][k] > 0)
+				child[k >= split.bin] = aabb_union(child[k >= split.bin],
+						split.r.bins.bounds[split.axis][k]);
+	}
+	if (split.bin == 0 || overlap_area(child[0], child[1]) > s->min_overlap)
+		sbvh_spatial_split(s, in, &split);
+	if (in->count <= BVH_MAX_LEAF && split.cost >= BVH_INTERSECT_COST
+		* in->count)
+		return (0);
+	if (split.spatial && spatial_partition(s, in, &split, side))
+		return (1);
+	if (split.bin > 0)
+		return (object_partition(in, &split, side));
+	return (median_split(in, &split, side));
+}
+
+/*
+** Emits the node for `in` and, depth first, its subtree; the left child
+** takes the next slot. Frees the reference array.
+*/
+static int	build_node(t_sbvh *s, t_sbvh_refs in)
+{
+	t_sbvh_refs	side[2];
+	uint32_t	index;
+	t_aabb		bounds;
+	uint32_t	i;
+	int			split;
+
+	index = s->bvh->node_count++;
+	bounds = aabb_empty();
+	i = 0;
+	while (i < in.count)
+		bounds = aabb_union(bounds, in.refs[i++].box);
+	s->bvh->nodes[index] = (t_bvh_node){bounds, s->bvh->prim_count, in.count};
+	split = (in.count > 1 && split_node(s, &in, bounds, side));
+	i = 0;
+	while (!split && i < in.count)
+		s->bvh->prims[s->bvh->prim_count++] = in.refs[i++].prim;
+	free(in.refs);
+	if (!split)
+		return (1);
+	share_budget(&in, side);
+	if (!build_node(s, side[0]))
+		return (free(side[1].refs), 0);
+	s->bvh->nodes[index].first = s->bvh->node_count;
+	s->bvh->nodes[index].count = 0;
+	return (build_node(s, side[1]));
+}
+
+/*
+** Builds a spatial-split hierarchy over the triangles of `mesh`. Triangles
+** straddling a split plane are clipped into a reference on each side, so a
+** triangle can sit in several leaves; SBVH_BUDGET caps the extra references
+** as a fraction of the triangle count. Single threaded. bvh->prims holds
+** triangle indices directly.
+*/
+int	sbvh_build(t_bvh *bvh, t_mesh *mesh)
+{
+	t_sbvh		s;
+	t_sbvh_refs	root;
+	t_aabb		bounds;
+	uint32_t	*tri;
+	void		*tmp;
+
+	*bvh = (t_bvh){0};
+	if (mesh->tri_count == 0)
+		return (1);
+	s = (t_sbvh){bvh, mesh, 0};
+	root = (t_sbvh_refs){malloc(sizeof(t_sbvh_ref) * mesh->tri_count), 0, 0,
+		mesh->tri_count * SBVH_BUDGET};
+	bvh->nodes = malloc(sizeof(t_bvh_node) * 2 * (mesh->tri_count
+				+ root.budget));
+	bvh->prims = malloc(sizeof(uint32_t) * (mesh->tri_count + root.budget));
+	if (!root.refs || !bvh->nodes || !bvh->prims)
+		return (free(root.refs), 0);
+	bounds = aabb_empty();
+	while (root.count < mesh->tri_count)
+	{
+		tri = &mesh->indices[root.count * 3];
+		root.refs[root.count].box = aabb_grow(aabb_grow((t_aabb){
+					vertex_to_vec(mesh->vertices[tri[0]]),
+					vertex_to_vec(mesh->vertices[tri[0]])},
+					vertex_to_vec(mesh->vertices[tri[1]])),
+				vertex_to_vec(mesh->vertices[tri[2]]));
+		root.refs[root.count].prim = root.count;
+		bounds = aabb_union(bounds, root.refs[root.count++].box);
+	}
+	s.min_overlap = SBVH_ALPHA * aabb_area(bounds);
+	if (!build_node(&s, root))
+		return (0);
+	tmp = realloc(bvh->nodes, sizeof(t_bvh_node) * bvh->node_count);
+	if (tmp)
+		bvh->nodes = tmp;
+	tmp = realloc(bvh->prims, sizeof(uint32_t) * bvh->prim_count);
+	if (tmp)
+		bvh->prims = tmp;
+	return (bvh_collapse(bvh));
+}
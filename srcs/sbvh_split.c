@@ -0,0 +1,205 @@
+#include "../includes/minirt.h"
+
+static void	set_axis(t_vector *v, int axis, double value)
+{
+	if (axis == 0)
+		v->x = value;
+	else if (axis == 1)
+		v->y = value;
+	else
+		v->z = value;
+}
+
+static int	box_valid(t_aabb *box)
+{
+	return (box->min.x <= box->max.x && box->min.y <= box->max.y
+		&& box->min.z <= box->max.z);
+}
+
+/*
+** Cuts a reference at plane `pl`. Each side is bounded by the vertices
+** and edge crossings of the triangle on that side, clipped to the reference
+** box. Returns which sides the triangle reaches inside the box: bit 0 for
+** the left, bit 1 for the right; the other boxes come back inverted.
+*/
+int	sbvh_split_ref(t_sbvh *s, t_sbvh_ref *ref, t_sbvh_plane pl,
+		t_sbvh_ref out[2])
+{
+	uint32_t	*tri;
+	t_vector	v[4];
+	t_vector	x;
+	double		p[2];
+	int			i;
+
+	tri = &s->mesh->indices[ref->prim * 3];
+	v[0] = vertex_to_vec(s->mesh->vertices[tri[0]]);
+	v[1] = vertex_to_vec(s->mesh->vertices[tri[1]]);
+	v[2] = vertex_to_vec(s->mesh->vertices[tri[2]]);
+	v[3] = v[0];
+	out[0] = (t_sbvh_ref){aabb_empty(), ref->prim};
+	out[1] = out[0];
+	i = -1;
+	while (++i < 3)
+	{
+		p[0] = vec_axis(v[i], pl.axis);
+		p[1] = vec_axis(v[i + 1], pl.axis);
+		if (p[0] <= pl.pos)
+			out[0].box = aabb_grow(out[0].box, v[i]);
+		if (p[0] >= pl.pos)
+			out[1].box = aabb_grow(out[1].box, v[i]);
+		if ((p[0] < pl.pos && pl.pos < p[1])
+			|| (p[1] < pl.pos && pl.pos < p[0]))
+		{
+			x = vec_add(v[i], vec_mul(vec_sub(v[i + 1], v[i]),
+						(pl.pos - p[0]) / (p[1] - p[0])));
+			set_axis(&x, pl.axis, pl.pos);
+			out[0].box = aabb_grow(out[0].box, x);
+			out[1].box = aabb_grow(out[1].box, x);
+		}
+	}
+	out[0].box = aabb_intersection(out[0].box, ref->box);
+	out[1].box = aabb_intersection(out[1].box, ref->box);
+	return (box_valid(&out[0].box) | box_valid(&out[1].box) << 1);
+}
+
+/*
+** Binned SAH over the reference centroids, as in the object builder.
+** Leaves the bins in best->r for partitioning and returns the cost.
+*/
+double	sbvh_object_split(t_sbvh_refs *in, t_aabb bounds, t_sbvh_split *best)
+{
+	uint32_t	i;
+
+	best->r.bounds = bounds;
+	best->r.cbounds = aabb_empty();
+	i = 0;
+	while (i < in->count)
+		best->r.cbounds = aabb_grow(best->r.cbounds,
+				aabb_centroid(in->refs[i++].box));
+	bvh_bin_scale(&best->r);
+	ft_bzero(best->r.bins.count, sizeof(best->r.bins.count));
+	i = 0;
+	while (i < in->count)
+	{
+		bvh_bin_box(&best->r, aabb_centroid(in->refs[i].box),
+			&in->refs[i].box);
+		i++;
+	}
+	best->spatial = 0;
+	best->cost = bvh_best_bin(&best->r, &best->axis, &best->bin);
+	return (best->cost);
+}
+
+/*
+** Chops every reference at the bin planes it straddles and merges each
+** piece into its bin. A reference enters the bin of its first piece and
+** exits the bin of its last, which is all the sweep needs to count sides.
+*/
+static void	fill_bins(t_sbvh *s, t_sbvh_bins *bins)
+{
+	t_sbvh_ref	cur;
+	t_sbvh_ref	piece[2];
+	uint32_t	i;
+	int			k;
+	int			last;
+	int			sides;
+
+	i = 0;
+	while (i < bins->in->count)
+	{
+		cur = bins->in->refs[i++];
+		k = bvh_bin_index(vec_axis(cur.box.min, bins->axis), bins->min,
+				bins->scale);
+		last = bvh_bin_index(vec_axis(cur.box.max, bins->axis), bins->min,
+				bins->scale);
+		bins->enter[k]++;
+		bins->exit[last]++;
+		while (k < last)
+		{
+			sides = sbvh_split_ref(s, &cur, (t_sbvh_plane){bins->axis,
+					bins->min + (k + 1) / bins->scale}, piece);
+			if (sides & 1)
+				bins->bounds[k] = aabb_union(bins->bounds[k], piece[0].box);
+			cur = piece[1];
+			k++;
+		}
+		if (box_valid(&cur.box))
+			bins->bounds[k] = aabb_union(bins->bounds[k], cur.box);
+	}
+}
+
+/*
+** Sweeps the planes between spatial bins; left of a plane are the
+** references entering before it, right of it those exiting after it.
+** Planes that would duplicate more references than the node budget has
+** left are skipped.
+*/
+static void	sweep_spatial(t_sbvh_bins *bins, double parent_area,
+		t_sbvh_split *best)
+{
+	double		right_area[BVH_BINS];
+	uint32_t	right_count[BVH_BINS];
+	t_aabb		acc;
+	uint32_t	n;
+	int			k;
+	double		cost;
+
+	acc = aabb_empty();
+	n = 0;
+	k = BVH_BINS;
+	while (--k > 0)
+	{
+		acc = aabb_union(acc, bins->bounds[k]);
+		n += bins->exit[k];
+		right_area[k] = aabb_area(acc);
+		right_count[k] = n;
+	}
+	acc = aabb_empty();
+	n = 0;
+	while (++k < BVH_BINS)
+	{
+		acc = aabb_union(acc, bins->bounds[k - 1]);
+		n += bins->enter[k - 1];
+		if (n == 0 || right_count[k] == 0
+			|| n + right_count[k] - bins->in->count > bins->in->budget)
+			continue ;
+		cost = BVH_TRAVERSAL_COST + BVH_INTERSECT_COST * (aabb_area(acc) * n
+				+ right_area[k] * right_count[k]) / parent_area;
+		if (cost >= best->cost)
+			continue ;
+		best->cost = cost;
+		best->spatial = 1;
+		best->plane = (t_sbvh_plane){bins->axis, bins->min + k / bins->scale};
+	}
+}
+
+/*
+** Spatial binning over the node bounds on each axis. Replaces *best when
+** a plane beats its cost; best->r keeps the object bins either way.
+*/
+void	sbvh_spatial_split(t_sbvh *s, t_sbvh_refs *in, t_sbvh_split *best)
+{
+	t_sbvh_bins	bins;
+	double		extent;
+	int			k;
+
+	bins.in = in;
+	bins.axis = -1;
+	while (++bins.axis < 3)
+	{
+		bins.min = vec_axis(best->r.bounds.min, bins.axis);
+		extent = vec_axis(best->r.bounds.max, bins.axis) - bins.min;
+		if (!(extent > 0.0))
+			continue ;
+		bins.scale = BVH_BINS / extent;
+		k = -1;
+		while (++k < BVH_BINS)
+		{
+			bins.bounds[k] = aabb_empty();
+			bins.enter[k] = 0;
+			bins.exit[k] = 0;
+		}
+		fill_bins(s, &bins);
+		sweep_spatial(&bins, fmax(aabb_area(best->r.bounds), EPSILON), best);
+	}
+}
@@ -38,111 +38,13 @@ t_color	color_mul(t_color c1, t_color c2)
 	return (result);
 }
 
-t_vector	sphere_normal(t_vector point, t_sphere sphere)
-{
-	return (vec_normalize(vec_sub(point, sphere.center)));
-}
-
-t_vector	plane_normal(t_plane plane)
-{
-	return (plane.normal);
-}
-
-t_vector	cylinder_normal(t_vector point, t_cylinder cylinder)
-{
-	t_vector	cp;
-	t_vector	projection;
-	t_vector	normal;
-	double		proj_len;
-	t_vector	top_center;
-
-	cp = vec_sub(point, cylinder.center);
-	
-	top_center = vec_add(cylinder.center, vec_mul(cylinder.axis, cylinder.height));
-	
-	if (vec_length(vec_sub(point, cylinder.center)) <= cylinder.radius + EPSILON &&
-		fabs(vec_dot(vec_sub(point, cylinder.center), cylinder.axis)) < EPSILON)
-		return (vec_mul(cylinder.axis, -1));
-	
-	if (vec_length(vec_sub(point, top_center)) <= cylinder.radius + EPSILON &&
-		fabs(vec_dot(vec_sub(point, top_center), cylinder.axis)) < EPSILON)
-		return (cylinder.axis);
-	
-	proj_len = vec_dot(cp, cylinder.axis);
-	projection = vec_mul(cylinder.axis, proj_len);
-	normal = vec_sub(cp, projection);
-	
-	return (vec_normalize(normal));
-}
-
-
-t_vector cone_normal(t_vector point, t_cone cone)
-{
-    t_vector    cp;
-    t_vector    axis_proj;
-    t_vector    normal;
-    double      proj_len;
-    
-    t_vector base_center = vec_add(cone.vertex, vec_mul(cone.axis, cone.height));
-    double base_radius = cone.height * tan(cone.angle);
-    
-    if (fabs(vec_dot(vec_sub(point, base_center), cone.axis)) < EPSILON &&
-        vec_length(vec_sub(point, base_center)) <= base_radius + EPSILON)
-        return (cone.axis);
-    
-    cp = vec_sub(point, cone.vertex);
-    proj_len = vec_dot(cp, cone.axis);
-    axis_proj = vec_mul(cone.axis, proj_len);
-    
-    normal = vec_sub(cp, vec_mul(axis_proj, (1 + pow(tan(cone.angle), 2))));
-    
-    return vec_normalize(normal);
-}
-
-t_vector get_normal(t_object obj, t_vector hit_point)
-{
-    t_vector normal;
-    
-    if (obj.type == SPHERE)
-        normal = sphere_normal(hit_point, obj.sphere);
-    else if (obj.type == PLANE)
-        normal = plane_normal(obj.plane);
-    else if (obj.type == CYLINDER)
-        normal = cylinder_normal(hit_point, obj.cylinder);
-    else if (obj.type == CONE)
-        normal = cone_normal(hit_point, obj.cone);
-    else if (obj.type == HYPERBOLOID)
-        normal = hyperboloid_normal(hit_point, obj.hyperboloid);
-    else if (obj.type == TRIANGLE)
-        normal = triangle_normal(obj.triangle);
-    
-    else
-        return ((t_vector){0, 0, 0});
-    
-    // Apply bump mapping if available
-    if (obj.texture && obj.texture->has_bump_map)
-        normal = bump_map_normal(obj, normal, hit_point);
-    
-    return normal;
-}
-
-
 int	is_in_shadow(t_scene *scene, t_vector point, t_vector light_dir, double light_dist)
 {
 	t_ray		shadow_ray;
-	size_t		i;
 
 	shadow_ray = ray_create(point, light_dir);
 	shadow_ray.t = light_dist;
-
-	i = 0;
-	while (i < scene->obj_count)
-	{
-		if (intersect_object(&shadow_ray, scene->objects[i]))
-			return (1);  // Object is blocking the light
-		i++;
-	}
-	return (0);  // No objects blocking the light
+	return (scene_occluded(scene, &shadow_ray));
 }
 
 
@@ -164,6 +66,7 @@ t_color apply_checkerboard(t_color base_color, t_vector hit_point)
 
 t_color calculate_lighting(t_scene *scene, t_ray *ray, int obj_idx)
 {
+    t_hit       hit;
     t_vector    intersection_point;
     t_vector    normal;
     t_color     obj_color;
@@ -179,7 +82,8 @@ t_color calculate_lighting(t_scene *scene, t_ray *ray, int obj_idx)
     t_color     color;
     double      light_dist;
 
-    intersection_point = ray_at(*ray, ray->t);
+    hit_record(&hit, scene, ray, obj_idx);
+    intersection_point = hit.point;
     obj_color = scene->objects[obj_idx].color;
     
     if (scene->checkerboard)
@@ -190,7 +94,7 @@ t_color calculate_lighting(t_scene *scene, t_ray *ray, int obj_idx)
     
     color = ambient_color;
     
-    normal = get_normal(scene->objects[obj_idx], intersection_point);
+    normal = hit.normal;
     
     if (vec_dot(normal, ray->direction) > 0)
         normal = vec_mul(normal, -1);
@@ -198,11 +102,8 @@ t_color calculate_lighting(t_scene *scene, t_ray *ray, int obj_idx)
     view_dir = vec_mul(ray->direction, -1);
     
     if (scene->objects[obj_idx].texture)
-    {
-        double u, v;
-        calculate_uv(scene->objects[obj_idx], intersection_point, &u, &v);
-        obj_color = get_texture_color(scene->objects[obj_idx].texture, u, v);
-    }
+        obj_color = get_texture_color(scene->objects[obj_idx].texture,
+                hit.u, hit.v);
     else
     {
         obj_color = scene->objects[obj_idx].color;
@@ -217,7 +118,7 @@ t_color calculate_lighting(t_scene *scene, t_ray *ray, int obj_idx)
         light_dist = vec_length(light_dir);
         light_dir = vec_normalize(light_dir);
         
-        if (!is_in_shadow(scene, vec_add(intersection_point, vec_mul(normal, EPSILON)), 
+        if (!is_in_shadow(scene, offset_origin(intersection_point, normal),
                           light_dir, light_dist))
         {
             diffuse_factor = fmax(0.0, vec_dot(normal, light_dir)) * scene->lights[i].brightness;
@@ -243,21 +144,13 @@ t_color calculate_lighting(t_scene *scene, t_ray *ray, int obj_idx)
     return (color);
 }
 
-uint32_t	ray_get_color(t_scene *scene, t_ray *ray)
+/*
+** Shades a ray that scene_intersect (or a packet) traced to `hit_index`.
+*/
+uint32_t	ray_get_color(t_scene *scene, t_ray *ray, int hit_index)
 {
-	size_t	i;
-	int		hit_index;
 	t_color	color;
 
-	hit_index = -1;
-	i = 0;
-	while (i < scene->obj_count)
-	{
-		if (intersect_object(ray, scene->objects[i]))
-			hit_index = i;
-		i++;
-	}
-	
 	if (hit_index == -1)
 		return (0);  // Background color (black)
 	
@@ -0,0 +1,15 @@
+#include "../includes/minirt.h"
+
+/*
+** The SSE2 kernels are built in on x86-64, where SSE2 is always present;
+** the AVX2 ones are compiled alongside them and only run when the CPU
+** running the program has AVX2.
+*/
+int	simd_avx2(void)
+{
+#if defined(__SSE2__) && defined(__GNUC__)
+	return (__builtin_cpu_supports("avx2"));
+#else
+	return (0);
+#endif
+}
@@ -0,0 +1,380 @@
+#include "../includes/minirt.h"
+
+/*
+** Stream fields of a quadric: the frame rows from 0, its offset from 9,
+** then the coefficients from 12, the slab from 16, the caps from 18 and
+** the squared clip radius at 20.
+*/
+void	quadric_store(t_quadric_soa *s, uint32_t j, t_quadric *q)
+{
+	int	k;
+
+	k = -1;
+	while (++k < 3)
+	{
+		s->f[3 * k][j] = q->frame.inv[k].x;
+		s->f[3 * k + 1][j] = q->frame.inv[k].y;
+		s->f[3 * k + 2][j] = q->frame.inv[k].z;
+	}
+	s->f[9][j] = q->frame.offset.x;
+	s->f[10][j] = q->frame.offset.y;
+	s->f[11][j] = q->frame.offset.z;
+	k = -1;
+	while (++k < 4)
+		s->f[12 + k][j] = q->coef[k];
+	k = -1;
+	while (++k < 2)
+	{
+		s->f[16 + k][j] = q->slab[k];
+		s->f[18 + k][j] = q->cap[k];
+	}
+	s->f[20][j] = q->clip2;
+}
+
+static void	quadric_load(t_quadric_soa *s, uint32_t j, t_quadric *q)
+{
+	int	k;
+
+	k = -1;
+	while (++k < 3)
+		q->frame.inv[k] = (t_vector){s->f[3 * k][j], s->f[3 * k + 1][j],
+			s->f[3 * k + 2][j]};
+	q->frame.offset = (t_vector){s->f[9][j], s->f[10][j], s->f[11][j]};
+	k = -1;
+	while (++k < 4)
+		q->coef[k] = s->f[12 + k][j];
+	k = -1;
+	while (++k < 2)
+	{
+		q->slab[k] = s->f[16 + k][j];
+		q->cap[k] = s->f[18 + k][j];
+	}
+	q->clip2 = s->f[20][j];
+}
+
+#ifdef __SSE2__
+
+/*
+** mask ? b : a, lane by lane.
+*/
+static __m128d	select2(__m128d mask, __m128d a, __m128d b)
+{
+	return (_mm_or_pd(_mm_and_pd(mask, b), _mm_andnot_pd(mask, a)));
+}
+
+/*
+** The ray in the frames of entries j and j + 1, as quadric_frame.
+*/
+static void	frame2(t_quadric_soa *s, t_ray *ray, uint32_t j,
+		__m128d od[2][3])
+{
+	__m128d	rel[3];
+	__m128d	row[3];
+	int		k;
+
+	rel[0] = _mm_sub_pd(_mm_set1_pd(ray->origin.x), _mm_loadu_pd(s->f[9] + j));
+	rel[1] = _mm_sub_pd(_mm_set1_pd(ray->origin.y), _mm_loadu_pd(s->f[10] + j));
+	rel[2] = _mm_sub_pd(_mm_set1_pd(ray->origin.z), _mm_loadu_pd(s->f[11] + j));
+	k = -1;
+	while (++k < 3)
+	{
+		row[0] = _mm_loadu_pd(s->f[3 * k] + j);
+		row[1] = _mm_loadu_pd(s->f[3 * k + 1] + j);
+		row[2] = _mm_loadu_pd(s->f[3 * k + 2] + j);
+		od[0][k] = _mm_add_pd(_mm_add_pd(_mm_mul_pd(row[0], rel[0]),
+					_mm_mul_pd(row[1], rel[1])), _mm_mul_pd(row[2], rel[2]));
+		od[1][k] = _mm_add_pd(_mm_add_pd(
+					_mm_mul_pd(row[0], _mm_set1_pd(ray->direction.x)),
+					_mm_mul_pd(row[1], _mm_set1_pd(ray->direction.y))),
+				_mm_mul_pd(row[2], _mm_set1_pd(ray->direction.z)));
+	}
+}
+
+static __m128d	form2(t_quadric_soa *s, uint32_t j, __m128d u[3],
+		__m128d v[3])
+{
+	return (_mm_add_pd(_mm_add_pd(
+				_mm_mul_pd(_mm_mul_pd(_mm_loadu_pd(s->f[12] + j), u[0]), v[0]),
+				_mm_mul_pd(_mm_mul_pd(_mm_loadu_pd(s->f[13] + j), u[1]), v[1])),
+			_mm_mul_pd(_mm_mul_pd(_mm_loadu_pd(s->f[14] + j), u[2]), v[2])));
+}
+
+/*
+** side_root and cap_root for entries j and j + 1.
+*/
+static __m128d	side2(t_quadric_soa *s, __m128d od[2][3], __m128d t,
+		uint32_t j)
+{
+	__m128d	p[3];
+	__m128d	ok;
+	int		k;
+
+	k = -1;
+	while (++k < 3)
+		p[k] = _mm_add_pd(od[0][k], _mm_mul_pd(t, od[1][k]));
+	ok = _mm_and_pd(_mm_cmpgt_pd(t, _mm_set1_pd(EPSILON)),
+			_mm_and_pd(_mm_cmpge_pd(p[2], _mm_loadu_pd(s->f[16] + j)),
+				_mm_cmple_pd(p[2], _mm_loadu_pd(s->f[17] + j))));
+	ok = _mm_and_pd(ok, _mm_cmple_pd(_mm_add_pd(_mm_add_pd(
+						_mm_mul_pd(p[0], p[0]), _mm_mul_pd(p[1], p[1])),
+					_mm_mul_pd(p[2], p[2])), _mm_loadu_pd(s->f[20] + j)));
+	return (select2(ok, _mm_set1_pd(INFINITY), t));
+}
+
+static __m128d	cap2(t_quadric_soa *s, __m128d od[2][3], uint32_t j, int cap)
+{
+	__m128d	p[3];
+	__m128d	t;
+	__m128d	ok;
+
+	p[2] = _mm_loadu_pd(s->f[18 + cap] + j);
+	t = _mm_div_pd(_mm_sub_pd(p[2], od[0][2]), od[1][2]);
+	p[0] = _mm_add_pd(od[0][0], _mm_mul_pd(t, od[1][0]));
+	p[1] = _mm_add_pd(od[0][1], _mm_mul_pd(t, od[1][1]));
+	ok = _mm_and_pd(_mm_cmpnlt_pd(_mm_andnot_pd(_mm_set1_pd(-0.0), od[1][2]),
+				_mm_set1_pd(EPSILON)), _mm_cmpgt_pd(t, _mm_set1_pd(EPSILON)));
+	ok = _mm_and_pd(ok, _mm_cmple_pd(_mm_add_pd(form2(s, j, p, p),
+					_mm_loadu_pd(s->f[15] + j)), _mm_setzero_pd()));
+	return (select2(ok, _mm_set1_pd(INFINITY), t));
+}
+
+/*
+** nearest_root over the side roots in t and the caps, leaving the
+** distance in t[0] and the part in t[1].
+*/
+static void	nearest2(t_quadric_soa *s, __m128d od[2][3], __m128d t[2],
+		uint32_t j)
+{
+	__m128d	hit[4];
+	__m128d	mask;
+	int		k;
+
+	hit[0] = side2(s, od, _mm_min_pd(t[0], t[1]), j);
+	hit[1] = side2(s, od, _mm_max_pd(t[0], t[1]), j);
+	hit[2] = cap2(s, od, j, 0);
+	hit[3] = cap2(s, od, j, 1);
+	t[0] = _mm_set1_pd(INFINITY);
+	t[1] = _mm_set1_pd(PART_SIDE);
+	k = -1;
+	while (++k < 4)
+	{
+		mask = _mm_cmplt_pd(hit[k], t[0]);
+		t[0] = select2(mask, t[0], hit[k]);
+		if (k > 1)
+			t[1] = select2(mask, t[1], _mm_set1_pd(PART_SIDE + k - 1));
+	}
+}
+
+/*
+** quadric_distance for entries i and i + 1 of the run, with the same
+** operations in the same order.
+*/
+static void	quadric_roots2(t_quadric_soa *s, t_ray *ray, t_prim_run *run,
+		uint32_t i)
+{
+	__m128d	od[2][3];
+	__m128d	abc[3];
+	__m128d	t[2];
+	__m128d	mask;
+
+	i += run->first;
+	frame2(s, ray, i, od);
+	abc[0] = form2(s, i, od[1], od[1]);
+	abc[1] = form2(s, i, od[0], od[1]);
+	abc[2] = _mm_add_pd(form2(s, i, od[0], od[0]), _mm_loadu_pd(s->f[15] + i));
+	t[0] = _mm_sub_pd(_mm_mul_pd(abc[1], abc[1]), _mm_mul_pd(abc[0], abc[2]));
+	mask = _mm_cmpnlt_pd(t[0], _mm_setzero_pd());
+	_mm_storeu_pd(run->t + i - run->first, _mm_set1_pd(INFINITY));
+	if (!_mm_movemask_pd(mask))
+		return ;
+	t[0] = _mm_xor_pd(_mm_add_pd(abc[1], _mm_or_pd(_mm_sqrt_pd(t[0]),
+					_mm_and_pd(_mm_set1_pd(-0.0), abc[1]))), _mm_set1_pd(-0.0));
+	t[1] = _mm_div_pd(abc[2], t[0]);
+	t[0] = _mm_div_pd(t[0], abc[0]);
+	nearest2(s, od, t, i);
+	_mm_storeu_pd(run->t + i - run->first,
+		select2(mask, _mm_set1_pd(INFINITY), t[0]));
+	_mm_storel_epi64((__m128i *)(run->part + i - run->first),
+		_mm_cvtpd_epi32(t[1]));
+}
+
+__attribute__((target("avx2")))
+static void	frame4(t_quadric_soa *s, t_ray *ray, uint32_t j,
+		__m256d od[2][3])
+{
+	__m256d	rel[3];
+	__m256d	row[3];
+	int		k;
+
+	rel[0] = _mm256_sub_pd(_mm256_set1_pd(ray->origin.x),
+			_mm256_loadu_pd(s->f[9] + j));
+	rel[1] = _mm256_sub_pd(_mm256_set1_pd(ray->origin.y),
+			_mm256_loadu_pd(s->f[10] + j));
+	rel[2] = _mm256_sub_pd(_mm256_set1_pd(ray->origin.z),
+			_mm256_loadu_pd(s->f[11] + j));
+	k = -1;
+	while (++k < 3)
+	{
+		row[0] = _mm256_loadu_pd(s->f[3 * k] + j);
+		row[1] = _mm256_loadu_pd(s->f[3 * k + 1] + j);
+		row[2] = _mm256_loadu_pd(s->f[3 * k + 2] + j);
+		od[0][k] = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(row[0], rel[0]),
+					_mm256_mul_pd(row[1], rel[1])),
+				_mm256_mul_pd(row[2], rel[2]));
+		od[1][k] = _mm256_add_pd(_mm256_add_pd(
+					_mm256_mul_pd(row[0], _mm256_set1_pd(ray->direction.x)),
+					_mm256_mul_pd(row[1], _mm256_set1_pd(ray->direction.y))),
+				_mm256_mul_pd(row[2], _mm256_set1_pd(ray->direction.z)));
+	}
+}
+
+__attribute__((target("avx2")))
+static __m256d	form4(t_quadric_soa *s, uint32_t j, __m256d u[3],
+		__m256d v[3])
+{
+	return (_mm256_add_pd(_mm256_add_pd(
+				_mm256_mul_pd(_mm256_mul_pd(_mm256_loadu_pd(s->f[12] + j),
+						u[0]), v[0]),
+				_mm256_mul_pd(_mm256_mul_pd(_mm256_loadu_pd(s->f[13] + j),
+						u[1]), v[1])),
+			_mm256_mul_pd(_mm256_mul_pd(_mm256_loadu_pd(s->f[14] + j),
+					u[2]), v[2])));
+}
+
+/*
+** The same for entries j to j + 3.
+*/
+__attribute__((target("avx2")))
+static __m256d	side4(t_quadric_soa *s, __m256d od[2][3], __m256d t,
+		uint32_t j)
+{
+	__m256d	p[3];
+	__m256d	ok;
+	int		k;
+
+	k = -1;
+	while (++k < 3)
+		p[k] = _mm256_add_pd(od[0][k], _mm256_mul_pd(t, od[1][k]));
+	ok = _mm256_and_pd(_mm256_cmp_pd(t, _mm256_set1_pd(EPSILON), _CMP_GT_OQ),
+			_mm256_and_pd(_mm256_cmp_pd(p[2], _mm256_loadu_pd(s->f[16] + j),
+					_CMP_GE_OQ), _mm256_cmp_pd(p[2],
+					_mm256_loadu_pd(s->f[17] + j), _CMP_LE_OQ)));
+	ok = _mm256_and_pd(ok, _mm256_cmp_pd(_mm256_add_pd(_mm256_add_pd(
+						_mm256_mul_pd(p[0], p[0]), _mm256_mul_pd(p[1], p[1])),
+					_mm256_mul_pd(p[2], p[2])), _mm256_loadu_pd(s->f[20] + j),
+				_CMP_LE_OQ));
+	return (_mm256_blendv_pd(_mm256_set1_pd(INFINITY), t, ok));
+}
+
+__attribute__((target("avx2")))
+static __m256d	cap4(t_quadric_soa *s, __m256d od[2][3], uint32_t j, int cap)
+{
+	__m256d	p[3];
+	__m256d	t;
+	__m256d	ok;
+
+	p[2] = _mm256_loadu_pd(s->f[18 + cap] + j);
+	t = _mm256_div_pd(_mm256_sub_pd(p[2], od[0][2]), od[1][2]);
+	p[0] = _mm256_add_pd(od[0][0], _mm256_mul_pd(t, od[1][0]));
+	p[1] = _mm256_add_pd(od[0][1], _mm256_mul_pd(t, od[1][1]));
+	ok = _mm256_and_pd(_mm256_cmp_pd(_mm256_andnot_pd(_mm256_set1_pd(-0.0),
+					od[1][2]), _mm256_set1_pd(EPSILON), _CMP_NLT_UQ),
+			_mm256_cmp_pd(t, _mm256_set1_pd(EPSILON), _CMP_GT_OQ));
+	ok = _mm256_and_pd(ok, _mm256_cmp_pd(_mm256_add_pd(form4(s, j, p, p),
+					_mm256_loadu_pd(s->f[15] + j)), _mm256_setzero_pd(),
+				_CMP_LE_OQ));
+	return (_mm256_blendv_pd(_mm256_set1_pd(INFINITY), t, ok));
+}
+
+__attribute__((target("avx2")))
+static void	nearest4(t_quadric_soa *s, __m256d od[2][3], __m256d t[2],
+		uint32_t j)
+{
+	__m256d	hit[4];
+	__m256d	mask;
+	int		k;
+
+	hit[0] = side4(s, od, _mm256_min_pd(t[0], t[1]), j);
+	hit[1] = side4(s, od, _mm256_max_pd(t[0], t[1]), j);
+	hit[2] = cap4(s, od, j, 0);
+	hit[3] = cap4(s, od, j, 1);
+	t[0] = _mm256_set1_pd(INFINITY);
+	t[1] = _mm256_set1_pd(PART_SIDE);
+	k = -1;
+	while (++k < 4)
+	{
+		mask = _mm256_cmp_pd(hit[k], t[0], _CMP_LT_OQ);
+		t[0] = _mm256_blendv_pd(t[0], hit[k], mask);
+		if (k > 1)
+			t[1] = _mm256_blendv_pd(t[1],
+					_mm256_set1_pd(PART_SIDE + k - 1), mask);
+	}
+}
+
+__attribute__((target("avx2")))
+static void	quadric_roots4(t_quadric_soa *s, t_ray *ray, t_prim_run *run,
+		uint32_t i)
+{
+	__m256d	od[2][3];
+	__m256d	abc[3];
+	__m256d	t[2];
+	__m256d	mask;
+
+	i += run->first;
+	frame4(s, ray, i, od);
+	abc[0] = form4(s, i, od[1], od[1]);
+	abc[1] = form4(s, i, od[0], od[1]);
+	abc[2] = _mm256_add_pd(form4(s, i, od[0], od[0]),
+			_mm256_loadu_pd(s->f[15] + i));
+	t[0] = _mm256_sub_pd(_mm256_mul_pd(abc[1], abc[1]),
+			_mm256_mul_pd(abc[0], abc[2]));
+	mask = _mm256_cmp_pd(t[0], _mm256_setzero_pd(), _CMP_NLT_UQ);
+	_mm256_storeu_pd(run->t + i - run->first, _mm256_set1_pd(INFINITY));
+	if (!_mm256_movemask_pd(mask))
+		return ;
+	t[0] = _mm256_xor_pd(_mm256_add_pd(abc[1], _mm256_or_pd(
+					_mm256_sqrt_pd(t[0]), _mm256_and_pd(_mm256_set1_pd(-0.0),
+						abc[1]))), _mm256_set1_pd(-0.0));
+	t[1] = _mm256_div_pd(abc[2], t[0]);
+	t[0] = _mm256_div_pd(t[0], abc[0]);
+	nearest4(s, od, t, i);
+	_mm256_storeu_pd(run->t + i - run->first,
+		_mm256_blendv_pd(_mm256_set1_pd(INFINITY), t[0], mask));
+	_mm_storeu_si128((__m128i *)(run->part + i - run->first),
+		_mm256_cvtpd_epi32(t[1]));
+}
+
+#endif
+
+/*
+** Nearest hit and part of every quadric of the run, four or two at a time
+** where the CPU allows and the rest one by one. Mixed cylinders, cones
+** and hyperboloids share a run.
+*/
+void	quadric_roots(t_quadric_soa *s, t_ray *ray, t_prim_run *run, int avx2)
+{
+	t_quadric	q;
+	uint32_t	i;
+
+	i = 0;
+#ifdef __SSE2__
+	while (avx2 && i + 4 <= run->count)
+	{
+		quadric_roots4(s, ray, run, i);
+		i += 4;
+	}
+	while (i + 2 <= run->count)
+	{
+		quadric_roots2(s, ray, run, i);
+		i += 2;
+	}
+#else
+	(void)avx2;
+#endif
+	while (i < run->count)
+	{
+		quadric_load(s, run->first + i, &q);
+		run->t[i] = quadric_distance(&q, ray, &run->part[i]);
+		i++;
+	}
+}
@@ -0,0 +1,155 @@
+#include "../includes/minirt.h"
+
+/*
+** Nearest root past EPSILON of sphere `j`, or INFINITY.
+*/
+static double	sphere_root(t_sphere_soa *s, uint32_t j, t_ray *ray, double a)
+{
+	t_vector	oc;
+	double		b;
+	double		c;
+	double		disc;
+	double		t;
+
+	oc = (t_vector){ray->origin.x - s->x[j], ray->origin.y - s->y[j],
+		ray->origin.z - s->z[j]};
+	b = 2.0 * (oc.x * ray->direction.x + oc.y * ray->direction.y
+			+ oc.z * ray->direction.z);
+	c = (oc.x * oc.x + oc.y * oc.y + oc.z * oc.z) - s->r2[j];
+	disc = b * b - 4 * a * c;
+	if (disc < 0)
+		return (INFINITY);
+	t = sqrt(disc);
+	c = (-b - t) / (2.0 * a);
+	t = (-b + t) / (2.0 * a);
+	t = (t > EPSILON) ? t : INFINITY;
+	return ((c > EPSILON) ? c : t);
+}
+
+#ifdef __SSE2__
+
+/*
+** sphere_root for entries i and i + 1 of the run, with the same operations
+** in the same order so both find the same roots.
+*/
+static void	sphere_roots2(t_sphere_soa *s, t_ray *ray, t_prim_run *run,
+		uint32_t i)
+{
+	__m128d	oc[3];
+	__m128d	a;
+	__m128d	b;
+	__m128d	c;
+	__m128d	disc;
+
+	i += run->first;
+	oc[0] = _mm_sub_pd(_mm_set1_pd(ray->origin.x), _mm_loadu_pd(s->x + i));
+	oc[1] = _mm_sub_pd(_mm_set1_pd(ray->origin.y), _mm_loadu_pd(s->y + i));
+	oc[2] = _mm_sub_pd(_mm_set1_pd(ray->origin.z), _mm_loadu_pd(s->z + i));
+	a = _mm_set1_pd(vec_dot(ray->direction, ray->direction));
+	b = _mm_mul_pd(_mm_set1_pd(2.0), _mm_add_pd(_mm_add_pd(
+					_mm_mul_pd(oc[0], _mm_set1_pd(ray->direction.x)),
+					_mm_mul_pd(oc[1], _mm_set1_pd(ray->direction.y))),
+				_mm_mul_pd(oc[2], _mm_set1_pd(ray->direction.z))));
+	c = _mm_sub_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(oc[0], oc[0]),
+					_mm_mul_pd(oc[1], oc[1])), _mm_mul_pd(oc[2], oc[2])),
+			_mm_loadu_pd(s->r2 + i));
+	disc = _mm_sub_pd(_mm_mul_pd(b, b),
+			_mm_mul_pd(_mm_mul_pd(_mm_set1_pd(4.0), a), c));
+	oc[0] = _mm_cmpnlt_pd(disc, _mm_setzero_pd());
+	_mm_storeu_pd(run->t + i - run->first, _mm_set1_pd(INFINITY));
+	if (!_mm_movemask_pd(oc[0]))
+		return ;
+	disc = _mm_sqrt_pd(disc);
+	a = _mm_mul_pd(_mm_set1_pd(2.0), a);
+	b = _mm_xor_pd(b, _mm_set1_pd(-0.0));
+	c = _mm_div_pd(_mm_sub_pd(b, disc), a);
+	b = _mm_div_pd(_mm_add_pd(b, disc), a);
+	oc[1] = _mm_cmpgt_pd(b, _mm_set1_pd(EPSILON));
+	b = _mm_or_pd(_mm_and_pd(oc[1], b),
+			_mm_andnot_pd(oc[1], _mm_set1_pd(INFINITY)));
+	oc[2] = _mm_cmpgt_pd(c, _mm_set1_pd(EPSILON));
+	c = _mm_or_pd(_mm_and_pd(oc[2], c), _mm_andnot_pd(oc[2], b));
+	_mm_storeu_pd(run->t + i - run->first, _mm_or_pd(_mm_and_pd(oc[0], c),
+			_mm_andnot_pd(oc[0], _mm_set1_pd(INFINITY))));
+}
+
+/*
+** The same for entries i to i + 3.
+*/
+__attribute__((target("avx2")))
+static void	sphere_roots4(t_sphere_soa *s, t_ray *ray, t_prim_run *run,
+		uint32_t i)
+{
+	__m256d	oc[3];
+	__m256d	a;
+	__m256d	b;
+	__m256d	c;
+	__m256d	disc;
+
+	i += run->first;
+	oc[0] = _mm256_sub_pd(_mm256_set1_pd(ray->origin.x),
+			_mm256_loadu_pd(s->x + i));
+	oc[1] = _mm256_sub_pd(_mm256_set1_pd(ray->origin.y),
+			_mm256_loadu_pd(s->y + i));
+	oc[2] = _mm256_sub_pd(_mm256_set1_pd(ray->origin.z),
+			_mm256_loadu_pd(s->z + i));
+	a = _mm256_set1_pd(vec_dot(ray->direction, ray->direction));
+	b = _mm256_mul_pd(_mm256_set1_pd(2.0), _mm256_add_pd(_mm256_add_pd(
+					_mm256_mul_pd(oc[0], _mm256_set1_pd(ray->direction.x)),
+					_mm256_mul_pd(oc[1], _mm256_set1_pd(ray->direction.y))),
+				_mm256_mul_pd(oc[2], _mm256_set1_pd(ray->direction.z))));
+	c = _mm256_sub_pd(_mm256_add_pd(_mm256_add_pd(
+					_mm256_mul_pd(oc[0], oc[0]), _mm256_mul_pd(oc[1], oc[1])),
+				_mm256_mul_pd(oc[2], oc[2])), _mm256_loadu_pd(s->r2 + i));
+	disc = _mm256_sub_pd(_mm256_mul_pd(b, b),
+			_mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(4.0), a), c));
+	oc[0] = _mm256_cmp_pd(disc, _mm256_setzero_pd(), _CMP_NLT_UQ);
+	_mm256_storeu_pd(run->t + i - run->first, _mm256_set1_pd(INFINITY));
+	if (!_mm256_movemask_pd(oc[0]))
+		return ;
+	disc = _mm256_sqrt_pd(disc);
+	a = _mm256_mul_pd(_mm256_set1_pd(2.0), a);
+	b = _mm256_xor_pd(b, _mm256_set1_pd(-0.0));
+	c = _mm256_div_pd(_mm256_sub_pd(b, disc), a);
+	b = _mm256_div_pd(_mm256_add_pd(b, disc), a);
+	b = _mm256_blendv_pd(_mm256_set1_pd(INFINITY), b,
+			_mm256_cmp_pd(b, _mm256_set1_pd(EPSILON), _CMP_GT_OQ));
+	c = _mm256_blendv_pd(b, c,
+			_mm256_cmp_pd(c, _mm256_set1_pd(EPSILON), _CMP_GT_OQ));
+	_mm256_storeu_pd(run->t + i - run->first,
+		_mm256_blendv_pd(_mm256_set1_pd(INFINITY), c, oc[0]));
+}
+
+#endif
+
+/*
+** Nearest root of every sphere of the run, four or two at a time where
+** the CPU allows and the rest one by one.
+*/
+void	sphere_roots(t_sphere_soa *s, t_ray *ray, t_prim_run *run, int avx2)
+{
+	double		a;
+	uint32_t	i;
+
+	a = vec_dot(ray->direction, ray->direction);
+	i = 0;
+#ifdef __SSE2__
+	while (avx2 && i + 4 <= run->count)
+	{
+		sphere_roots4(s, ray, run, i);
+		i += 4;
+	}
+	while (i + 2 <= run->count)
+	{
+		sphere_roots2(s, ray, run, i);
+		i += 2;
+	}
+#else
+	(void)avx2;
+#endif
+	while (i < run->count)
+	{
+		run->t[i] = sphere_root(s, run->first + i, ray, a);
+		i++;
+	}
+}
@@ -0,0 +1,241 @@
+#include "../includes/minirt.h"
+
+/*
+** Triangle kernels of double-precision builds; simd_triangle_float.c has
+** the single-precision ones.
+*/
+#ifdef RT_DOUBLE
+
+/*
+** Moller-Trumbore against triangle `tri` of the mesh. Returns the hit
+** distance, or INFINITY when the ray misses it.
+*/
+static double	triangle_distance(t_ray *ray, t_mesh_query *q, uint32_t tri)
+{
+	uint32_t	*idx;
+	t_vector	v0;
+	t_vector	edge1;
+	t_vector	edge2;
+	t_vector	h;
+	double		fuv[3];
+
+	idx = q->mesh->indices + tri * 3;
+	v0 = vertex_to_vec(q->mesh->vertices[idx[0]]);
+	edge1 = vec_sub(vertex_to_vec(q->mesh->vertices[idx[1]]), v0);
+	edge2 = vec_sub(vertex_to_vec(q->mesh->vertices[idx[2]]), v0);
+	h = vec_cross(ray->direction, edge2);
+	fuv[0] = vec_dot(edge1, h);
+	if (fuv[0] > -q->min_det && fuv[0] < q->min_det)
+		return (INFINITY);
+	fuv[0] = 1.0 / fuv[0];
+	v0 = vec_sub(ray->origin, v0);
+	fuv[1] = fuv[0] * vec_dot(v0, h);
+	if (fuv[1] < 0.0 || fuv[1] > 1.0)
+		return (INFINITY);
+	h = vec_cross(v0, edge1);
+	fuv[2] = fuv[0] * vec_dot(ray->direction, h);
+	if (fuv[2] < 0.0 || fuv[1] + fuv[2] > 1.0)
+		return (INFINITY);
+	return (fuv[0] * vec_dot(edge2, h));
+}
+
+#ifdef __SSE2__
+
+/*
+** Corner `corner` of triangles tris[0] and tris[1], one register per axis.
+*/
+static void	load2(t_mesh *m, uint32_t *tris, int corner, __m128d v[3])
+{
+	t_vertex	a;
+	t_vertex	b;
+
+	a = m->vertices[m->indices[tris[0] * 3 + corner]];
+	b = m->vertices[m->indices[tris[1] * 3 + corner]];
+	v[0] = _mm_set_pd(b.x, a.x);
+	v[1] = _mm_set_pd(b.y, a.y);
+	v[2] = _mm_set_pd(b.z, a.z);
+}
+
+static __m128d	dot2(__m128d a[3], __m128d b[3])
+{
+	return (_mm_add_pd(_mm_add_pd(_mm_mul_pd(a[0], b[0]),
+				_mm_mul_pd(a[1], b[1])), _mm_mul_pd(a[2], b[2])));
+}
+
+static void	cross2(__m128d a[3], __m128d b[3], __m128d out[3])
+{
+	out[0] = _mm_sub_pd(_mm_mul_pd(a[1], b[2]), _mm_mul_pd(a[2], b[1]));
+	out[1] = _mm_sub_pd(_mm_mul_pd(a[2], b[0]), _mm_mul_pd(a[0], b[2]));
+	out[2] = _mm_sub_pd(_mm_mul_pd(a[0], b[1]), _mm_mul_pd(a[1], b[0]));
+}
+
+/*
+** triangle_distance for triangles i and i + 1 of the run, with the same
+** operations in the same order, and rejected by the same tests. e holds
+** the ray origin relative to the first vertex and the two edges, f the
+** inverse determinant, u, v and the mask of rejected lanes.
+*/
+static void	triangles2(t_mesh_query *q, t_ray *ray, t_tri_run *run,
+		uint32_t i)
+{
+	__m128d	e[3][3];
+	__m128d	d[3];
+	__m128d	h[3];
+	__m128d	f[4];
+	int		k;
+
+	load2(q->mesh, run->tris + i, 0, e[0]);
+	load2(q->mesh, run->tris + i, 1, e[1]);
+	load2(q->mesh, run->tris + i, 2, e[2]);
+	d[0] = _mm_set1_pd(ray->direction.x);
+	d[1] = _mm_set1_pd(ray->direction.y);
+	d[2] = _mm_set1_pd(ray->direction.z);
+	h[0] = _mm_set1_pd(ray->origin.x);
+	h[1] = _mm_set1_pd(ray->origin.y);
+	h[2] = _mm_set1_pd(ray->origin.z);
+	k = -1;
+	while (++k < 3)
+	{
+		e[1][k] = _mm_sub_pd(e[1][k], e[0][k]);
+		e[2][k] = _mm_sub_pd(e[2][k], e[0][k]);
+		e[0][k] = _mm_sub_pd(h[k], e[0][k]);
+	}
+	cross2(d, e[2], h);
+	f[0] = dot2(e[1], h);
+	f[3] = _mm_and_pd(_mm_cmpgt_pd(f[0], _mm_set1_pd(-q->min_det)),
+			_mm_cmplt_pd(f[0], _mm_set1_pd(q->min_det)));
+	f[0] = _mm_div_pd(_mm_set1_pd(1.0), f[0]);
+	f[1] = _mm_mul_pd(f[0], dot2(e[0], h));
+	f[3] = _mm_or_pd(f[3], _mm_or_pd(_mm_cmplt_pd(f[1], _mm_setzero_pd()),
+				_mm_cmpgt_pd(f[1], _mm_set1_pd(1.0))));
+	_mm_storeu_pd(run->t + i, _mm_set1_pd(INFINITY));
+	if (_mm_movemask_pd(f[3]) == 3)
+		return ;
+	cross2(e[0], e[1], h);
+	f[2] = _mm_mul_pd(f[0], dot2(d, h));
+	f[3] = _mm_or_pd(f[3], _mm_or_pd(_mm_cmplt_pd(f[2], _mm_setzero_pd()),
+				_mm_cmpgt_pd(_mm_add_pd(f[1], f[2]), _mm_set1_pd(1.0))));
+	f[0] = _mm_mul_pd(f[0], dot2(e[2], h));
+	_mm_storeu_pd(run->t + i, _mm_or_pd(_mm_andnot_pd(f[3], f[0]),
+			_mm_and_pd(f[3], _mm_set1_pd(INFINITY))));
+}
+
+__attribute__((target("avx2")))
+static void	load4(t_mesh *m, uint32_t *tris, int corner, __m256d v[3])
+{
+	t_vertex	p[4];
+	int			k;
+
+	k = 0;
+	while (k < 4)
+	{
+		p[k] = m->vertices[m->indices[tris[k] * 3 + corner]];
+		k++;
+	}
+	v[0] = _mm256_set_pd(p[3].x, p[2].x, p[1].x, p[0].x);
+	v[1] = _mm256_set_pd(p[3].y, p[2].y, p[1].y, p[0].y);
+	v[2] = _mm256_set_pd(p[3].z, p[2].z, p[1].z, p[0].z);
+}
+
+__attribute__((target("avx2")))
+static __m256d	dot4(__m256d a[3], __m256d b[3])
+{
+	return (_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(a[0], b[0]),
+				_mm256_mul_pd(a[1], b[1])), _mm256_mul_pd(a[2], b[2])));
+}
+
+__attribute__((target("avx2")))
+static void	cross4(__m256d a[3], __m256d b[3], __m256d out[3])
+{
+	out[0] = _mm256_sub_pd(_mm256_mul_pd(a[1], b[2]),
+			_mm256_mul_pd(a[2], b[1]));
+	out[1] = _mm256_sub_pd(_mm256_mul_pd(a[2], b[0]),
+			_mm256_mul_pd(a[0], b[2]));
+	out[2] = _mm256_sub_pd(_mm256_mul_pd(a[0], b[1]),
+			_mm256_mul_pd(a[1], b[0]));
+}
+
+/*
+** The same for triangles i to i + 3.
+*/
+__attribute__((target("avx2")))
+static void	triangles4(t_mesh_query *q, t_ray *ray, t_tri_run *run,
+		uint32_t i)
+{
+	__m256d	e[3][3];
+	__m256d	d[3];
+	__m256d	h[3];
+	__m256d	f[4];
+	int		k;
+
+	load4(q->mesh, run->tris + i, 0, e[0]);
+	load4(q->mesh, run->tris + i, 1, e[1]);
+	load4(q->mesh, run->tris + i, 2, e[2]);
+	d[0] = _mm256_set1_pd(ray->direction.x);
+	d[1] = _mm256_set1_pd(ray->direction.y);
+	d[2] = _mm256_set1_pd(ray->direction.z);
+	h[0] = _mm256_set1_pd(ray->origin.x);
+	h[1] = _mm256_set1_pd(ray->origin.y);
+	h[2] = _mm256_set1_pd(ray->origin.z);
+	k = -1;
+	while (++k < 3)
+	{
+		e[1][k] = _mm256_sub_pd(e[1][k], e[0][k]);
+		e[2][k] = _mm256_sub_pd(e[2][k], e[0][k]);
+		e[0][k] = _mm256_sub_pd(h[k], e[0][k]);
+	}
+	cross4(d, e[2], h);
+	f[0] = dot4(e[1], h);
+	f[3] = _mm256_and_pd(
+			_mm256_cmp_pd(f[0], _mm256_set1_pd(-q->min_det), _CMP_GT_OQ),
+			_mm256_cmp_pd(f[0], _mm256_set1_pd(q->min_det), _CMP_LT_OQ));
+	f[0] = _mm256_div_pd(_mm256_set1_pd(1.0), f[0]);
+	f[1] = _mm256_mul_pd(f[0], dot4(e[0], h));
+	f[3] = _mm256_or_pd(f[3], _mm256_or_pd(
+				_mm256_cmp_pd(f[1], _mm256_setzero_pd(), _CMP_LT_OQ),
+				_mm256_cmp_pd(f[1], _mm256_set1_pd(1.0), _CMP_GT_OQ)));
+	_mm256_storeu_pd(run->t + i, _mm256_set1_pd(INFINITY));
+	if (_mm256_movemask_pd(f[3]) == 15)
+		return ;
+	cross4(e[0], e[1], h);
+	f[2] = _mm256_mul_pd(f[0], dot4(d, h));
+	f[3] = _mm256_or_pd(f[3], _mm256_or_pd(
+				_mm256_cmp_pd(f[2], _mm256_setzero_pd(), _CMP_LT_OQ),
+				_mm256_cmp_pd(_mm256_add_pd(f[1], f[2]), _mm256_set1_pd(1.0),
+					_CMP_GT_OQ)));
+	f[0] = _mm256_mul_pd(f[0], dot4(e[2], h));
+	_mm256_storeu_pd(run->t + i,
+		_mm256_blendv_pd(f[0], _mm256_set1_pd(INFINITY), f[3]));
+}
+
+#endif
+
+/*
+** Hit distance of every triangle of the run, four or two at a time where
+** the CPU allows and the rest one by one.
+*/
+void	triangle_distances(t_mesh_query *q, t_ray *ray, t_tri_run *run)
+{
+	uint32_t	i;
+
+	i = 0;
+#ifdef __SSE2__
+	while (q->avx2 && i + 4 <= run->count)
+	{
+		triangles4(q, ray, run, i);
+		i += 4;
+	}
+	while (i + 2 <= run->count)
+	{
+		triangles2(q, ray, run, i);
+		i += 2;
+	}
+#endif
+	while (i < run->count)
+	{
+		run->t[i] = triangle_distance(ray, q, run->tris[i]);
+		i++;
+	}
+}
+
+#endif
@@ -0,0 +1,193 @@
+#include "../includes/minirt.h"
+
+/*
+** Triangle kernels of single-precision builds. Mesh leaves hold at most
+** BVH_MAX_LEAF triangles, so one SSE register of floats covers a leaf.
+*/
+#ifndef RT_DOUBLE
+
+static t_vertex	vertex_sub(t_vertex a, t_vertex b)
+{
+	return ((t_vertex){a.x - b.x, a.y - b.y, a.z - b.z});
+}
+
+static float	vertex_dot(t_vertex a, t_vertex b)
+{
+	return (a.x * b.x + a.y * b.y + a.z * b.z);
+}
+
+static t_vertex	vertex_cross(t_vertex a, t_vertex b)
+{
+	return ((t_vertex){a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z,
+		a.x * b.y - a.y * b.x});
+}
+
+/*
+** Moller-Trumbore against triangle `tri` in single precision, with the
+** ray's origin and direction rounded to floats in od. Returns the hit
+** distance, or INFINITY when the ray misses it.
+*/
+static float	triangle_distance(t_vertex od[2], t_mesh_query *q,
+		uint32_t tri)
+{
+	uint32_t	*idx;
+	t_vertex	v0;
+	t_vertex	edge1;
+	t_vertex	edge2;
+	t_vertex	h;
+	float		fuv[3];
+
+	idx = q->mesh->indices + tri * 3;
+	v0 = q->mesh->vertices[idx[0]];
+	edge1 = vertex_sub(q->mesh->vertices[idx[1]], v0);
+	edge2 = vertex_sub(q->mesh->vertices[idx[2]], v0);
+	h = vertex_cross(od[1], edge2);
+	fuv[0] = vertex_dot(edge1, h);
+	if (fuv[0] > -(float)q->min_det && fuv[0] < (float)q->min_det)
+		return (INFINITY);
+	fuv[0] = 1.0f / fuv[0];
+	v0 = vertex_sub(od[0], v0);
+	fuv[1] = fuv[0] * vertex_dot(v0, h);
+	if (fuv[1] < 0.0f || fuv[1] > 1.0f)
+		return (INFINITY);
+	h = vertex_cross(v0, edge1);
+	fuv[2] = fuv[0] * vertex_dot(od[1], h);
+	if (fuv[2] < 0.0f || fuv[1] + fuv[2] > 1.0f)
+		return (INFINITY);
+	return (fuv[0] * vertex_dot(edge2, h));
+}
+
+# ifdef __SSE2__
+
+/*
+** Corner `corner` of triangles tris[0] to tris[3], one register per axis.
+*/
+static void	load4(t_mesh *m, uint32_t *tris, int corner, __m128 v[3])
+{
+	t_vertex	p[4];
+	int			k;
+
+	k = -1;
+	while (++k < 4)
+		p[k] = m->vertices[m->indices[tris[k] * 3 + corner]];
+	v[0] = _mm_set_ps(p[3].x, p[2].x, p[1].x, p[0].x);
+	v[1] = _mm_set_ps(p[3].y, p[2].y, p[1].y, p[0].y);
+	v[2] = _mm_set_ps(p[3].z, p[2].z, p[1].z, p[0].z);
+}
+
+static __m128	dot4(__m128 a[3], __m128 b[3])
+{
+	return (_mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]),
+				_mm_mul_ps(a[1], b[1])), _mm_mul_ps(a[2], b[2])));
+}
+
+static void	cross4(__m128 a[3], __m128 b[3], __m128 out[3])
+{
+	out[0] = _mm_sub_ps(_mm_mul_ps(a[1], b[2]), _mm_mul_ps(a[2], b[1]));
+	out[1] = _mm_sub_ps(_mm_mul_ps(a[2], b[0]), _mm_mul_ps(a[0], b[2]));
+	out[2] = _mm_sub_ps(_mm_mul_ps(a[0], b[1]), _mm_mul_ps(a[1], b[0]));
+}
+
+/*
+** triangle_distance for four triangles, with the same operations in the
+** same order, and rejected by the same tests.
+*/
+static __m128	triangles4(t_mesh_query *q, __m128 od[2][3], uint32_t *tris)
+{
+	__m128	e[3][3];
+	__m128	h[3];
+	__m128	f[4];
+	int		k;
+
+	load4(q->mesh, tris, 0, e[0]);
+	load4(q->mesh, tris, 1, e[1]);
+	load4(q->mesh, tris, 2, e[2]);
+	k = -1;
+	while (++k < 3)
+	{
+		e[1][k] = _mm_sub_ps(e[1][k], e[0][k]);
+		e[2][k] = _mm_sub_ps(e[2][k], e[0][k]);
+		e[0][k] = _mm_sub_ps(od[0][k], e[0][k]);
+	}
+	cross4(od[1], e[2], h);
+	f[0] = dot4(e[1], h);
+	f[3] = _mm_and_ps(_mm_cmpgt_ps(f[0], _mm_set1_ps(-q->min_det)),
+			_mm_cmplt_ps(f[0], _mm_set1_ps(q->min_det)));
+	f[0] = _mm_div_ps(_mm_set1_ps(1.0f), f[0]);
+	f[1] = _mm_mul_ps(f[0], dot4(e[0], h));
+	f[3] = _mm_or_ps(f[3], _mm_or_ps(_mm_cmplt_ps(f[1], _mm_setzero_ps()),
+				_mm_cmpgt_ps(f[1], _mm_set1_ps(1.0f))));
+	if (_mm_movemask_ps(f[3]) == 15)
+		return (_mm_set1_ps(INFINITY));
+	cross4(e[0], e[1], h);
+	f[2] = _mm_mul_ps(f[0], dot4(od[1], h));
+	f[3] = _mm_or_ps(f[3], _mm_or_ps(_mm_cmplt_ps(f[2], _mm_setzero_ps()),
+				_mm_cmpgt_ps(_mm_add_ps(f[1], f[2]), _mm_set1_ps(1.0f))));
+	f[0] = _mm_mul_ps(f[0], dot4(e[2], h));
+	return (_mm_or_ps(_mm_andnot_ps(f[3], f[0]),
+			_mm_and_ps(f[3], _mm_set1_ps(INFINITY))));
+}
+
+static void	ray_floats(t_ray *ray, __m128 od[2][3])
+{
+	od[0][0] = _mm_set1_ps(ray->origin.x);
+	od[0][1] = _mm_set1_ps(ray->origin.y);
+	od[0][2] = _mm_set1_ps(ray->origin.z);
+	od[1][0] = _mm_set1_ps(ray->direction.x);
+	od[1][1] = _mm_set1_ps(ray->direction.y);
+	od[1][2] = _mm_set1_ps(ray->direction.z);
+}
+
+/*
+** triangles4 over the run while at least two triangles remain. Returns
+** how many it covered.
+*/
+static uint32_t	triangle_groups(t_mesh_query *q, t_ray *ray, t_tri_run *run)
+{
+	__m128		od[2][3];
+	uint32_t	tris[4];
+	float		t[4];
+	uint32_t	i;
+	uint32_t	k;
+
+	ray_floats(ray, od);
+	i = 0;
+	while (i + 2 <= run->count)
+	{
+		k = -1;
+		while (++k < 4)
+			tris[k] = run->tris[(i + k < run->count) ? i + k : run->count - 1];
+		_mm_storeu_ps(t, triangles4(q, od, tris));
+		k = 0;
+		while (k < 4 && i < run->count)
+			run->t[i++] = t[k++];
+	}
+	return (i);
+}
+
+# endif
+
+/*
+** Hit distance of every triangle of the run. Groups of several triangles
+** go four at a time, the last group padded with copies of its final
+** triangle whose results are dropped; a lone triangle is cheaper alone.
+*/
+void	triangle_distances(t_mesh_query *q, t_ray *ray, t_tri_run *run)
+{
+	t_vertex	od[2];
+	uint32_t	i;
+
+	od[0] = vec_to_vertex(ray->origin);
+	od[1] = vec_to_vertex(ray->direction);
+	i = 0;
+# ifdef __SSE2__
+	i = triangle_groups(q, ray, run);
+# endif
+	while (i < run->count)
+	{
+		run->t[i] = triangle_distance(od, q, run->tris[i]);
+		i++;
+	}
+}
+
+#endif
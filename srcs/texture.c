@@ -1,65 +1,52 @@
 #include "../includes/minirt.h"
 
-void calculate_uv(t_object obj, t_vector point, double *u, double *v)
+/*
+** Texture coordinates of a hit, from the local coordinates hit_record
+** already derived.
+*/
+void calculate_uv(t_hit *hit)
 {
-    t_vector dir;
+    t_object *obj;
     
-    if (obj.type == SPHERE)
+    obj = hit->obj;
+    if (obj->type == SPHERE)
     {
-        dir = vec_normalize(vec_sub(point, obj.sphere.center));
-        *u = 0.5 + atan2(dir.z, dir.x) / (2 * M_PI);
-        *v = 0.5 - asin(dir.y) / M_PI;
+        hit->u = 0.5 + atan2(hit->local.z, hit->local.x) / (2 * M_PI);
+        hit->v = 0.5 - asin(hit->local.y) / M_PI;
     }
-    else if (obj.type == PLANE)
+    else if (obj->type == PLANE)
     {
         t_vector x_axis, y_axis;
-        t_vector local_point;
         
-        if (fabs(obj.plane.normal.y) > 0.9)
+        if (fabs(obj->plane.normal.y) > 0.9)
             x_axis = vec_normalize((t_vector){1, 0, 0});
         else
-            x_axis = vec_normalize(vec_cross((t_vector){0, 1, 0}, obj.plane.normal));
+            x_axis = vec_normalize(vec_cross((t_vector){0, 1, 0}, obj->plane.normal));
         
-        y_axis = vec_normalize(vec_cross(obj.plane.normal, x_axis));
+        y_axis = vec_normalize(vec_cross(obj->plane.normal, x_axis));
         
-        local_point = vec_sub(point, obj.plane.point);
-        *u = fmod(vec_dot(local_point, x_axis) * 0.1, 1.0);
-        *v = fmod(vec_dot(local_point, y_axis) * 0.1, 1.0);
+        hit->u = fmod(vec_dot(hit->local, x_axis) * 0.1, 1.0);
+        hit->v = fmod(vec_dot(hit->local, y_axis) * 0.1, 1.0);
         
-        if (*u < 0) *u += 1.0;
-        if (*v < 0) *v += 1.0;
+        if (hit->u < 0) hit->u += 1.0;
+        if (hit->v < 0) hit->v += 1.0;
     }
-    else if (obj.type == CYLINDER)
+    else if (obj->type == CYLINDER)
     {
-        t_vector cp = vec_sub(point, obj.cylinder.center);
-        t_vector proj = vec_mul(obj.cylinder.axis, vec_dot(cp, obj.cylinder.axis));
-        t_vector local_point = vec_sub(cp, proj);
+        t_vector proj = vec_mul(obj->cylinder.axis, hit->height);
         
-        *u = 0.5 + atan2(local_point.z, local_point.x) / (2 * M_PI);
-        *v = fmod(vec_length(proj) / obj.cylinder.height, 1.0);
+        hit->u = 0.5 + atan2(hit->radial.z, hit->radial.x) / (2 * M_PI);
+        hit->v = fmod(vec_length(proj) / obj->cylinder.height, 1.0);
     }
-    else if (obj.type == CONE)
+    else if (obj->type == CONE)
     {
-        t_vector vp = vec_sub(point, obj.cone.vertex);
-        double height = vec_dot(vp, obj.cone.axis);
-        t_vector proj = vec_mul(obj.cone.axis, height);
-        t_vector local_point = vec_sub(vp, proj);
-        
-        *u = 0.5 + atan2(local_point.z, local_point.x) / (2 * M_PI);
-        *v = height / obj.cone.height;
+        hit->u = 0.5 + atan2(hit->radial.z, hit->radial.x) / (2 * M_PI);
+        hit->v = hit->height / obj->cone.height;
     }
-    else if (obj.type == HYPERBOLOID)
-    {
-        // Hyperboloid mapping
-        t_vector cp = vec_sub(point, obj.hyperboloid.center);
-        
-        *u = 0.5 + atan2(cp.z, cp.x) / (2 * M_PI);
-        *v = 0.5 + cp.y / obj.hyperboloid.height;
-    }
-    else
+    else if (obj->type == HYPERBOLOID)
     {
-        *u = 0;
-        *v = 0;
+        hit->u = 0.5 + atan2(hit->local.z, hit->local.x) / (2 * M_PI);
+        hit->v = 0.5 + hit->local.y / obj->hyperboloid.height;
     }
 }
 
@@ -87,27 +74,25 @@ t_color get_texture_color(t_texture *texture, double u, double v)
     return (color);
 }
 
-t_vector bump_map_normal(t_object obj, t_vector normal, t_vector point)
+t_vector bump_map_normal(t_texture *texture, t_vector normal, double u,
+                double v)
 {
-    double u, v;
     int x, y;
     uint32_t bump;
     t_vector tangent, bitangent;
     t_vector bump_normal;
     double bump_strength = 0.05;
     
-    if (!obj.texture || !obj.texture->bump_map)
+    if (!texture || !texture->bump_map)
         return (normal);
     
-    calculate_uv(obj, point, &u, &v);
-    
-    x = (int)(u * (obj.texture->width - 1)) % obj.texture->width;
-    y = (int)(v * (obj.texture->height - 1)) % obj.texture->height;
+    x = (int)(u * (texture->width - 1)) % texture->width;
+    y = (int)(v * (texture->height - 1)) % texture->height;
     
-    if (x < 0) x += obj.texture->width;
-    if (y < 0) y += obj.texture->height;
+    if (x < 0) x += texture->width;
+    if (y < 0) y += texture->height;
     
-    bump = obj.texture->bump_map[y * obj.texture->width + x];
+    bump = texture->bump_map[y * texture->width + x];
     
     // Calculate tangent and bitangent vectors
     if (fabs(normal.x) > 0.9)
@@ -214,6 +199,7 @@ t_texture *load_texture(char *path)
     texture->data = NULL;
     texture->bump_map = NULL;
     texture->has_bump_map = 0;
+    texture->path = NULL;
     
     mlx_texture = mlx_load_png(fixed_path);
     if (!mlx_texture)
@@ -289,7 +275,7 @@ t_texture *load_texture(char *path)
     }
     
     mlx_delete_texture(mlx_texture);
-    free(fixed_path);
+    texture->path = fixed_path;
     
     ft_putendl_fd("Texture loaded successfully", 1);
     return (texture);
@@ -71,3 +71,22 @@ t_vector	vec_cross(t_vector v1, t_vector v2)
 	result.z = v1.x * v2.y - v1.y * v2.x;
 	return (result);
 }
+
+double	vec_axis(t_vector v, int axis)
+{
+	if (axis == 0)
+		return (v.x);
+	if (axis == 1)
+		return (v.y);
+	return (v.z);
+}
+
+t_vector	vertex_to_vec(t_vertex v)
+{
+	return ((t_vector){v.x, v.y, v.z});
+}
+
+t_vertex	vec_to_vertex(t_vector v)
+{
+	return ((t_vertex){v.x, v.y, v.z});
+}